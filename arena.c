@@ -0,0 +1,155 @@
+/**
+ * A bump-pointer arena for the 'mmake' program. Memory is
+ * handed out from large chunks by moving a pointer forward
+ * and is never freed on its own. Everything allocated from
+ * an arena is released at once when the arena is deleted.
+ *
+ * @file arena.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define MIN_CHUNK_SIZE 4096
+#define MIN_VEC_CAP 16
+#define ALIGNMENT _Alignof(max_align_t)
+
+typedef struct chunk {
+	struct chunk *next;      // The previously filled chunk
+	size_t size;             // Usable bytes in the chunk
+	size_t used;             // Bytes handed out so far
+	max_align_t data[];      // The memory of the chunk
+} chunk;
+
+typedef struct arena {
+	chunk *head;             // The chunk allocations are made from
+	size_t next_size;        // Size of the next chunk to allocate
+	bool failed;             // Set if an allocation has failed
+} arena;
+
+// * Internal functions
+
+/**
+ * Allocates memory from an arena with a given alignment,
+ * starting a new chunk if the current one is full.
+ *
+ * @param a			The arena
+ * @param size		The amount of bytes to allocate
+ * @param align		The alignment, a power of two
+ *
+ * @return			A pointer to the memory, or NULL on error.
+ */
+static void *bump(arena *a, size_t size, size_t align)
+{
+	chunk *c = a->head;
+	size_t start = c == NULL ? 0 : (c->used + align - 1) & ~(align - 1);
+
+	if (c == NULL || start + size > c->size)
+	{
+		// Grow geometrically, so the amount of chunks stays
+		//	logarithmic in the amount of memory used
+		size_t chunk_size = a->next_size;
+		while (chunk_size < size)
+			chunk_size *= 2;
+
+		c = malloc(sizeof(*c) + chunk_size);
+		if (c == NULL)
+		{
+			a->failed = true;
+			return NULL;
+		}
+
+		c->next = a->head;
+		c->size = chunk_size;
+		c->used = 0;
+		a->head = c;
+		a->next_size = chunk_size * 2;
+		start = 0;
+	}
+
+	c->used = start + size;
+
+	return (char *)c->data + start;
+}
+
+// * Visible functions
+
+arena *arena_new(size_t hint)
+{
+	arena *a = malloc(sizeof(*a));
+
+	if (a == NULL)
+		return NULL;
+
+	a->head = NULL;
+	a->next_size = hint < MIN_CHUNK_SIZE ? MIN_CHUNK_SIZE : hint;
+	a->failed = false;
+
+	return a;
+}
+
+void *arena_alloc(arena *a, size_t size)
+{
+	return bump(a, size, ALIGNMENT);
+}
+
+char *arena_strndup(arena *a, const char *str, size_t n)
+{
+	char *copy = bump(a, n + 1, 1);
+
+	if (copy == NULL)
+		return NULL;
+
+	memcpy(copy, str, n);
+	copy[n] = '\0';
+
+	return copy;
+}
+
+int arena_vec_push(arena *a, arena_vec *vec, void *item)
+{
+	if (vec->len == vec->cap)
+	{
+		size_t new_cap = vec->cap == 0 ? MIN_VEC_CAP : vec->cap * 2;
+		void **new_items = arena_alloc(a, new_cap * sizeof(*new_items));
+
+		if (new_items == NULL)
+			return 1;
+
+		if (vec->len > 0)
+			memcpy(new_items, vec->items, vec->len * sizeof(*new_items));
+
+		vec->items = new_items;
+		vec->cap = new_cap;
+	}
+
+	vec->items[vec->len++] = item;
+
+	return 0;
+}
+
+bool arena_failed(arena *a)
+{
+	return a->failed;
+}
+
+void arena_del(arena *a)
+{
+	if (a == NULL)
+		return;
+
+	chunk *c = a->head;
+	while (c != NULL)
+	{
+		chunk *next = c->next;
+		free(c);
+		c = next;
+	}
+
+	free(a);
+}
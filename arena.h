@@ -0,0 +1,87 @@
+#pragma once
+
+/**
+ * A bump-pointer arena for the 'mmake' program. Memory is
+ * handed out from large chunks by moving a pointer forward
+ * and is never freed on its own. Everything allocated from
+ * an arena is released at once when the arena is deleted.
+ *
+ * @file arena.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+
+typedef struct arena arena;
+
+// A growable array of pointers whose storage lives in an arena.
+//	Start from { NULL, 0, 0 } and reset len to reuse the storage
+typedef struct arena_vec {
+	void **items;            // The stored pointers
+	size_t len;              // Amount of stored pointers
+	size_t cap;              // Amount of pointers that fit in items
+} arena_vec;
+
+/**
+ * Creates an empty arena.
+ *
+ * @param hint		Expected amount of memory that will be
+ *					allocated, used to size the first chunk
+ *
+ * @return			A pointer to the arena, or NULL on error.
+ */
+arena *arena_new(size_t hint);
+
+/**
+ * Allocates memory from an arena, aligned for any type.
+ *
+ * @param a			The arena
+ * @param size		The amount of bytes to allocate
+ *
+ * @return			A pointer to the memory, or NULL on error.
+ */
+void *arena_alloc(arena *a, size_t size);
+
+/**
+ * Copies at most n characters of a string into an arena and
+ * terminates the copy with a NULL character.
+ *
+ * @param a			The arena
+ * @param str		The string to copy
+ * @param n			The length of the string
+ *
+ * @return			A pointer to the copy, or NULL on error.
+ */
+char *arena_strndup(arena *a, const char *str, size_t n);
+
+/**
+ * Appends a pointer to a vector, moving its storage to a
+ * block twice as large in the arena when it is full. The old
+ * block is left unused in the arena, so reusing one vector is
+ * cheaper than creating many.
+ *
+ * @param a			The arena
+ * @param vec		The vector
+ * @param item		The pointer to append
+ *
+ * @return			0 on success, else 1.
+ */
+int arena_vec_push(arena *a, arena_vec *vec, void *item);
+
+/**
+ * Checks if any allocation from an arena has failed.
+ *
+ * @param a			The arena
+ *
+ * @return			true if an allocation has failed, else false.
+ */
+bool arena_failed(arena *a);
+
+/**
+ * Deletes an arena, releasing all memory allocated from it.
+ *
+ * @param a			The arena, may be NULL
+ */
+void arena_del(arena *a);
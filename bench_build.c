@@ -0,0 +1,645 @@
+/**
+ * Measures the 'mmake' program on generated makefiles. For
+ * every shape and size a makefile is written to a fresh
+ * directory together with its source files, then 'mmake' is
+ * timed on a cold build, a no-op build and a build after one
+ * source file was touched.
+ *
+ * Generated makefiles have one of the shapes
+ *  wide	: Every target is built from a source file of its own
+ *  deep	: Every target depends on the previous one, in one chain
+ *  diamond	: Pairs of targets depend on the previous join target
+ *  random	: Targets depend on a few random earlier targets and
+ *			  source files
+ *
+ * The targets are built with 'touch', so the files they name
+ * exist afterwards and a second build has nothing to do. The
+ * parse and check times come from the --stats output of
+ * 'mmake', and the peak RSS from the rusage of the child.
+ *
+ * The program supports the use of the optional flags
+ *  -s SHAPES	: Comma-separated shapes to run, defaults to all
+ *  -n SIZES	: Comma-separated rule counts, defaults to
+ *				  1000,10000,100000
+ *  -j JOBS		: Jobs of the cold build, defaults to the CPU count
+ *  -m MMAKE	: Path of the program to measure, defaults to ./mmake
+ *  -d DIR		: Directory to generate into, defaults to a new
+ *				  directory in /tmp that is removed afterwards
+ *  -r SEED		: Seed of the random shape, defaults to 1
+ *
+ * Every result is printed as one line of key=value pairs.
+ *
+ * Usage:
+ *  ./bench_build [-s SHAPES] [-n SIZES] [-j JOBS] [-m MMAKE] [-d DIR]
+ *                [-r SEED]
+ *
+ * @file bench_build.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define DEFAULT_SHAPES "wide,deep,diamond,random"
+#define DEFAULT_SIZES "1000,10000,100000"
+#define RANDOM_PREREQS 4
+#define RANDOM_WINDOW 64
+#define LEAVES_PER_RANDOM_RULE 4
+#define MAX_STATS_OUTPUT 4096
+
+typedef struct runresult {
+	int status;              // Wait status of 'mmake'
+	double wall_ms;          // Wall time of the whole run
+	long max_rss_kb;         // Peak resident set size of 'mmake'
+	double parse_ms;         // Loading or parsing the makefile
+	double link_ms;          // Linking the dependency graph
+	double stat_ms;          // Collecting and stating targets
+	double build_ms;         // Checking targets and running commands
+	long targets_checked;    // Targets checked for being up to date
+	long commands_started;   // Commands run by the build
+} runresult;
+
+typedef struct shape {
+	const char *name;
+	long (*generate)(FILE *fp, long n_rules, uint64_t *seed);
+} shape;
+
+// * Internal functions
+
+/**
+ * Advances a xorshift random number generator.
+ *
+ * @param seed	The state of the generator
+ *
+ * @return		The next random number
+ */
+static uint64_t next_random(uint64_t *seed)
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+
+	return *seed;
+}
+
+/**
+ * Writes the rule of a target built with 'touch'.
+ *
+ * @param fp		The file to write to
+ * @param target	The number of the target
+ */
+static void write_command(FILE *fp, long target)
+{
+	fprintf(fp, "\n\ttouch t%ld\n", target);
+}
+
+/**
+ * Writes a makefile where every target has a source file of
+ * its own and the first rule depends on all targets.
+ *
+ * @param fp		The file to write to
+ * @param n_rules	The amount of rules to write
+ * @param seed		Unused
+ *
+ * @return			The amount of source files used
+ */
+static long generate_wide(FILE *fp, long n_rules, uint64_t *seed)
+{
+	(void)seed;
+
+	fprintf(fp, "all:");
+	for (long i = 0; i < n_rules - 1; i++)
+		fprintf(fp, " t%ld", i);
+	fprintf(fp, "\n\ttouch all\n");
+
+	for (long i = 0; i < n_rules - 1; i++)
+	{
+		fprintf(fp, "t%ld: s/%ld", i, i);
+		write_command(fp, i);
+	}
+
+	return n_rules - 1;
+}
+
+/**
+ * Writes a makefile where every target depends on the one
+ * before it, ending in a single source file.
+ *
+ * @param fp		The file to write to
+ * @param n_rules	The amount of rules to write
+ * @param seed		Unused
+ *
+ * @return			The amount of source files used
+ */
+static long generate_deep(FILE *fp, long n_rules, uint64_t *seed)
+{
+	(void)seed;
+
+	fprintf(fp, "all: t%ld\n\ttouch all\n", n_rules - 2);
+	fprintf(fp, "t0: s/0");
+	write_command(fp, 0);
+
+	for (long i = 1; i < n_rules - 1; i++)
+	{
+		fprintf(fp, "t%ld: t%ld", i, i - 1);
+		write_command(fp, i);
+	}
+
+	return 1;
+}
+
+/**
+ * Writes a makefile of stacked diamonds. Every third target
+ * joins the two targets before it, which both depend on the
+ * previous join.
+ *
+ * @param fp		The file to write to
+ * @param n_rules	The amount of rules to write
+ * @param seed		Unused
+ *
+ * @return			The amount of source files used
+ */
+static long generate_diamond(FILE *fp, long n_rules, uint64_t *seed)
+{
+	(void)seed;
+
+	long n_joins = (n_rules - 1) / 3;
+	if (n_joins < 1)
+		n_joins = 1;
+
+	fprintf(fp, "all: t%ld\n\ttouch all\n", 3 * (n_joins - 1) + 2);
+
+	for (long k = 0; k < n_joins; k++)
+	{
+		long left = 3 * k;
+		long right = left + 1;
+		long join = left + 2;
+
+		if (k == 0)
+		{
+			fprintf(fp, "t%ld: s/0", left);
+			write_command(fp, left);
+			fprintf(fp, "t%ld: s/0", right);
+			write_command(fp, right);
+		}
+		else
+		{
+			fprintf(fp, "t%ld: t%ld", left, join - 3);
+			write_command(fp, left);
+			fprintf(fp, "t%ld: t%ld", right, join - 3);
+			write_command(fp, right);
+		}
+
+		fprintf(fp, "t%ld: t%ld t%ld", join, left, right);
+		write_command(fp, join);
+	}
+
+	return 1;
+}
+
+/**
+ * Writes a makefile where every target depends on a few random
+ * targets shortly before it and a random source file, and the
+ * first rule depends on all targets.
+ *
+ * @param fp		The file to write to
+ * @param n_rules	The amount of rules to write
+ * @param seed		The state of the random number generator
+ *
+ * @return			The amount of source files used
+ */
+static long generate_random(FILE *fp, long n_rules, uint64_t *seed)
+{
+	long n_leaves = (n_rules - 1) / LEAVES_PER_RANDOM_RULE + 1;
+
+	fprintf(fp, "all:");
+	for (long i = 0; i < n_rules - 1; i++)
+		fprintf(fp, " t%ld", i);
+	fprintf(fp, "\n\ttouch all\n");
+
+	for (long i = 0; i < n_rules - 1; i++)
+	{
+		fprintf(fp, "t%ld: s/%ld", i, (long)(next_random(seed) % n_leaves));
+
+		long n_prereqs = i == 0 ? 0 : (long)(next_random(seed) % (RANDOM_PREREQS + 1));
+		for (long j = 0; j < n_prereqs; j++)
+		{
+			long window = i < RANDOM_WINDOW ? i : RANDOM_WINDOW;
+			fprintf(fp, " t%ld", i - 1 - (long)(next_random(seed) % window));
+		}
+
+		write_command(fp, i);
+	}
+
+	return n_leaves;
+}
+
+static const shape shapes[] = {
+	{ "wide", generate_wide },
+	{ "deep", generate_deep },
+	{ "diamond", generate_diamond },
+	{ "random", generate_random }
+};
+#define N_SHAPES (sizeof(shapes) / sizeof(shapes[0]))
+
+/**
+ * Gets the current time of a monotonic clock in seconds.
+ *
+ * @return			The current time
+ */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Creates a directory with a generated makefile and its source
+ * files.
+ *
+ * @param dir		The directory to create
+ * @param sh		The shape of the makefile
+ * @param n_rules	The amount of rules
+ * @param seed		The state of the random number generator
+ *
+ * @return			0 on success, else 1.
+ */
+static int generate_tree(const char *dir, const shape *sh, long n_rules, uint64_t *seed)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/s", dir);
+	if (mkdir(dir, 0755) != 0 || mkdir(path, 0755) != 0)
+	{
+		perror(dir);
+		return 1;
+	}
+
+	snprintf(path, sizeof(path), "%s/mmakefile", dir);
+	FILE *fp = fopen(path, "w");
+	if (fp == NULL)
+	{
+		perror(path);
+		return 1;
+	}
+
+	long n_leaves = sh->generate(fp, n_rules, seed);
+
+	if (fclose(fp) != 0)
+	{
+		perror(path);
+		return 1;
+	}
+
+	for (long i = 0; i < n_leaves; i++)
+	{
+		snprintf(path, sizeof(path), "%s/s/%ld", dir, i);
+		int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		if (fd == -1)
+		{
+			perror(path);
+			return 1;
+		}
+		close(fd);
+	}
+
+	return 0;
+}
+
+/**
+ * Reads the value of a line of --stats output.
+ *
+ * @param output	The output of 'mmake'
+ * @param name		The name of the value
+ *
+ * @return			The value, or -1 if it wasn't printed
+ */
+static double stats_value(const char *output, const char *name)
+{
+	size_t len = strlen(name);
+
+	for (const char *line = output; *line != '\0'; )
+	{
+		if (strncmp(line, name, len) == 0 && line[len] == ' ')
+			return strtod(line + len, NULL);
+
+		const char *eol = strchr(line, '\n');
+		if (eol == NULL)
+			break;
+		line = eol + 1;
+	}
+
+	return -1;
+}
+
+/**
+ * Runs 'mmake' with --stats in a directory and measures it.
+ *
+ * @param mmake		The path of the program
+ * @param dir		The directory to run in
+ * @param jobs		The amount of jobs to use
+ * @param result	Filled in with the measurements
+ *
+ * @return			0 on success, else 1.
+ */
+static int run_mmake(const char *mmake, const char *dir, long jobs, runresult *result)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		perror("pipe");
+		return 1;
+	}
+
+	char jobs_arg[32];
+	snprintf(jobs_arg, sizeof(jobs_arg), "%ld", jobs);
+
+	double start = now();
+	pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		int devnull = open("/dev/null", O_WRONLY);
+
+		if (chdir(dir) != 0 || devnull == -1 || dup2(devnull, STDOUT_FILENO) == -1
+			|| dup2(fds[1], STDERR_FILENO) == -1)
+			_exit(127);
+
+		close(fds[0]);
+		execl(mmake, mmake, "-s", "--stats", "-j", jobs_arg, (char *)NULL);
+		_exit(127);
+	}
+
+	close(fds[1]);
+
+	if (pid == -1)
+	{
+		perror("fork");
+		close(fds[0]);
+		return 1;
+	}
+
+	// Keep the end of the output, where the statistics are
+	char output[MAX_STATS_OUTPUT];
+	size_t len = 0;
+	ssize_t n;
+
+	while ((n = read(fds[0], output + len, sizeof(output) - 1 - len)) > 0)
+	{
+		len += n;
+		if (len == sizeof(output) - 1)
+		{
+			memmove(output, output + len / 2, len - len / 2);
+			len -= len / 2;
+		}
+	}
+	output[len] = '\0';
+	close(fds[0]);
+
+	struct rusage usage;
+	if (wait4(pid, &result->status, 0, &usage) == -1)
+	{
+		perror("wait4");
+		return 1;
+	}
+
+	result->wall_ms = (now() - start) * 1e3;
+	result->max_rss_kb = usage.ru_maxrss;
+	result->parse_ms = stats_value(output, "parse_ms");
+	result->link_ms = stats_value(output, "link_ms");
+	result->stat_ms = stats_value(output, "stat_ms");
+	result->build_ms = stats_value(output, "build_ms");
+	result->targets_checked = stats_value(output, "targets_checked");
+	result->commands_started = stats_value(output, "commands_started");
+
+	return 0;
+}
+
+/**
+ * Prints the measurements of one run.
+ *
+ * @param sh		The shape of the makefile
+ * @param n_rules	The amount of rules
+ * @param mode		The kind of build that was run
+ * @param r			The measurements
+ */
+static void print_result(const shape *sh, long n_rules, const char *mode, const runresult *r)
+{
+	printf("shape=%s rules=%ld mode=%s status=%s wall_ms=%.3f parse_ms=%.3f "
+		"link_ms=%.3f stat_ms=%.3f build_ms=%.3f max_rss_kb=%ld checked=%ld "
+		"commands=%ld rules_per_s=%.0f\n",
+		sh->name, n_rules, mode,
+		WIFEXITED(r->status) && WEXITSTATUS(r->status) == 0 ? "ok" : "failed",
+		r->wall_ms, r->parse_ms, r->link_ms, r->stat_ms, r->build_ms,
+		r->max_rss_kb, r->targets_checked, r->commands_started,
+		r->wall_ms > 0 ? n_rules / (r->wall_ms / 1e3) : 0);
+	fflush(stdout);
+}
+
+/**
+ * Generates a makefile and measures a cold, a no-op and a
+ * touch build of it.
+ *
+ * @param mmake		The path of the program to measure
+ * @param root		The directory to generate the makefile in
+ * @param jobs		The amount of jobs to use
+ * @param sh		The shape of the makefile
+ * @param n_rules	The amount of rules
+ * @param seed		The state of the random number generator
+ *
+ * @return			0 on success, else 1.
+ */
+static int bench(const char *mmake, const char *root, long jobs, const shape *sh,
+	long n_rules, uint64_t *seed)
+{
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%s/%s-%ld", root, sh->name, n_rules);
+
+	if (generate_tree(dir, sh, n_rules, seed) != 0)
+		return 1;
+
+	runresult r;
+	if (run_mmake(mmake, dir, jobs, &r) != 0)
+		return 1;
+	print_result(sh, n_rules, "cold", &r);
+
+	if (run_mmake(mmake, dir, jobs, &r) != 0)
+		return 1;
+	print_result(sh, n_rules, "noop", &r);
+
+	// Touch the source file every shape starts from
+	char leaf[sizeof(dir) + sizeof("/s/0")];
+	snprintf(leaf, sizeof(leaf), "%s/s/0", dir);
+	if (utimensat(AT_FDCWD, leaf, NULL, 0) != 0)
+	{
+		perror(leaf);
+		return 1;
+	}
+
+	if (run_mmake(mmake, dir, jobs, &r) != 0)
+		return 1;
+	print_result(sh, n_rules, "touch", &r);
+
+	return 0;
+}
+
+/**
+ * Removes one file or directory, for nftw.
+ *
+ * @param path		The path of the entry
+ * @param sb		Unused
+ * @param flag		Unused
+ * @param ftw		Unused
+ *
+ * @return			0 on success, else -1.
+ */
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw)
+{
+	(void)sb;
+	(void)flag;
+	(void)ftw;
+
+	return remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	char *shape_list = strdup(DEFAULT_SHAPES);
+	char *size_list = strdup(DEFAULT_SIZES);
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *mmake = "./mmake";
+	const char *root = NULL;
+	uint64_t seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:n:j:m:d:r:")) != -1)
+	{
+		switch (opt)
+		{
+		case 's':
+			free(shape_list);
+			shape_list = strdup(optarg);
+			break;
+		case 'n':
+			free(size_list);
+			size_list = strdup(optarg);
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		case 'm':
+			mmake = optarg;
+			break;
+		case 'd':
+			root = optarg;
+			break;
+		case 'r':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-s SHAPES] [-n SIZES] [-j JOBS] [-m MMAKE] "
+				"[-d DIR] [-r SEED]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (shape_list == NULL || size_list == NULL)
+	{
+		perror("Allocation failed");
+		return EXIT_FAILURE;
+	}
+
+	if (jobs < 1 || seed == 0)
+	{
+		fprintf(stderr, "%s: Jobs and seed must be positive\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Run from the generated directories, so the program must be
+	//	found by an absolute path
+	char mmake_path[PATH_MAX];
+	if (realpath(mmake, mmake_path) == NULL)
+	{
+		perror(mmake);
+		return EXIT_FAILURE;
+	}
+
+	char tmp_root[] = "/tmp/mmake-bench-XXXXXX";
+	int remove_root = root == NULL;
+
+	if (root == NULL && (root = mkdtemp(tmp_root)) == NULL)
+	{
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	int result = 0;
+
+	for (char *size = strtok(size_list, ","); size != NULL && result == 0;
+		size = strtok(NULL, ","))
+	{
+		long n_rules = strtol(size, NULL, 10);
+
+		if (n_rules < 2)
+		{
+			fprintf(stderr, "%s: Sizes must be at least 2 rules\n", argv[0]);
+			result = 1;
+			break;
+		}
+
+		char *shape_save = NULL;
+		char *names = strdup(shape_list);
+
+		if (names == NULL)
+		{
+			perror("Allocation failed");
+			result = 1;
+			break;
+		}
+
+		for (char *name = strtok_r(names, ",", &shape_save); name != NULL && result == 0;
+			name = strtok_r(NULL, ",", &shape_save))
+		{
+			const shape *sh = NULL;
+			for (size_t i = 0; i < N_SHAPES; i++)
+			{
+				if (strcmp(shapes[i].name, name) == 0)
+					sh = &shapes[i];
+			}
+
+			if (sh == NULL)
+			{
+				fprintf(stderr, "%s: Unknown shape '%s'\n", argv[0], name);
+				result = 1;
+			}
+			else
+				result = bench(mmake_path, root, jobs, sh, n_rules, &seed);
+		}
+
+		free(names);
+	}
+
+	if (remove_root)
+		nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	free(shape_list);
+	free(size_list);
+
+	return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,388 @@
+/**
+ * Measures the parse throughput of the makefile parser used
+ * by the 'mmake' program. Every given makefile is parsed a
+ * number of times and the best round is reported in MB/s.
+ * Without any files a synthetic makefile is generated.
+ *
+ * The program supports the use of the optional flags
+ *  -r ROUNDS	: Parses every makefile [ROUNDS] times, defaults to 20
+ *  -n RULES	: Amount of rules to generate, defaults to 20000
+ *  -p PREREQS	: Prerequisites of every generated rule, defaults to 8
+ *  -i IMPL		: Uses the [IMPL] tokenizer (scalar, sse2 or avx2)
+ *				  instead of the fastest one supported
+ *  -c COUNT	: Instead of measuring, checks that every supported
+ *				  tokenizer gives the same rules as the scalar one,
+ *				  for the makefiles and [COUNT] random ones
+ *
+ * Every result is printed as one line of key=value pairs.
+ *
+ * Usage:
+ *  ./bench_parse [-r ROUNDS] [-n RULES] [-p PREREQS] [-i IMPL] [-c COUNT]
+ *                [FILES ...]
+ *
+ * @file bench_parse.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "parser.h"
+#include "scan.h"
+
+#define DEFAULT_ROUNDS 20
+#define DEFAULT_RULES 20000
+#define DEFAULT_PREREQS 8
+#define MAX_RANDOM_LEN 512
+
+static const char *const impls[] = { "scalar", "sse2", "avx2" };
+#define N_IMPLS (sizeof(impls) / sizeof(impls[0]))
+
+// * Internal functions
+
+/**
+ * Writes a makefile resembling the ones of a C project: every
+ * rule compiles an object from its source and some headers.
+ *
+ * @param fp		The file to write to
+ * @param n_rules	The amount of rules to write
+ * @param n_prereqs	The amount of prerequisites of every rule
+ */
+static void generate(FILE *fp, long n_rules, long n_prereqs)
+{
+	fprintf(fp, "all:");
+	for (long i = 0; i < n_rules; i++)
+		fprintf(fp, " obj/module_%ld.o", i);
+	fprintf(fp, "\n\tgcc -o all");
+	for (long i = 0; i < n_rules; i++)
+		fprintf(fp, " obj/module_%ld.o", i);
+	fprintf(fp, "\n");
+
+	for (long i = 0; i < n_rules; i++)
+	{
+		fprintf(fp, "\nobj/module_%ld.o: src/module_%ld.c", i, i);
+		for (long j = 1; j < n_prereqs; j++)
+			fprintf(fp, " include/header_%ld.h", (i + j) % n_rules);
+		fprintf(fp, "\n\tgcc -O2 -Wall -Iinclude -c src/module_%ld.c -o obj/module_%ld.o\n",
+			i, i);
+	}
+}
+
+/**
+ * Gets the current time of a monotonic clock in seconds.
+ *
+ * @return			The current time
+ */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Parses a makefile a number of times and prints the result.
+ *
+ * @param name		The name to report the makefile as
+ * @param fp		The opened makefile
+ * @param rounds	The amount of times to parse it
+ *
+ * @return			0 on success, else 1.
+ */
+static int bench(const char *name, FILE *fp, long rounds)
+{
+	struct stat fileinfo;
+	if (fstat(fileno(fp), &fileinfo) == -1)
+	{
+		perror(name);
+		return 1;
+	}
+
+	double best = -1;
+	long n_rules = 0;
+
+	for (long i = 0; i < rounds; i++)
+	{
+		rewind(fp);
+
+		double start = now();
+		makefile *mfile = parse_makefile(fp);
+		double elapsed = now() - start;
+
+		if (mfile == NULL)
+		{
+			fprintf(stderr, "Couldn't parse '%s'\n", name);
+			return 1;
+		}
+
+		n_rules = 0;
+		for (rule *r = makefile_first_rule(mfile); r != NULL; r = rule_next(r))
+			n_rules++;
+
+		makefile_del(mfile);
+
+		if (best < 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	printf("file=%s impl=%s bytes=%lld rules=%ld rounds=%ld best_ms=%.3f mb_per_s=%.1f\n",
+		name, scan_name(), (long long)fileinfo.st_size, n_rules, rounds,
+		best * 1e3, fileinfo.st_size / best / 1e6);
+
+	return 0;
+}
+
+/**
+ * Parses a makefile and writes out all of its rules, so that
+ * parses can be compared as strings.
+ *
+ * @param fp		The opened makefile
+ *
+ * @return			The rules, or NULL on error. Must be freed.
+ */
+static char *dump(FILE *fp)
+{
+	char *text = NULL;
+	size_t len = 0;
+	FILE *out = open_memstream(&text, &len);
+
+	if (out == NULL)
+		return NULL;
+
+	rewind(fp);
+	makefile *mfile = parse_makefile(fp);
+
+	if (mfile == NULL)
+		fprintf(out, "failed\n");
+	else
+	{
+		for (rule *r = makefile_first_rule(mfile); r != NULL; r = rule_next(r))
+		{
+			fprintf(out, "[%s]:", rule_target(r));
+			for (const char **p = rule_prereq(r); *p != NULL; p++)
+				fprintf(out, " [%s]", *p);
+			fprintf(out, "\n");
+			for (char **c = rule_cmd(r); *c != NULL; c++)
+				fprintf(out, " [%s]", *c);
+			fprintf(out, "\n");
+		}
+
+		makefile_del(mfile);
+	}
+
+	fclose(out);
+
+	return text;
+}
+
+/**
+ * Checks that every supported tokenizer parses a makefile the
+ * same way as the scalar one.
+ *
+ * @param name		The name to report the makefile as
+ * @param fp		The opened makefile
+ *
+ * @return			0 if they all agree, else 1.
+ */
+static int check(const char *name, FILE *fp)
+{
+	scan_select("scalar");
+	char *expected = dump(fp);
+	int result = expected == NULL;
+
+	for (size_t i = 1; i < N_IMPLS && result == 0; i++)
+	{
+		if (scan_select(impls[i]) != 0)
+			continue;
+
+		char *actual = dump(fp);
+		if (actual == NULL || strcmp(expected, actual) != 0)
+		{
+			fprintf(stderr, "Mismatch between scalar and %s on '%s'\n", impls[i], name);
+			result = 1;
+		}
+
+		free(actual);
+	}
+
+	free(expected);
+
+	return result;
+}
+
+/**
+ * Runs the check for a makefile, with the same signature as
+ * bench.
+ *
+ * @param name		The name to report the makefile as
+ * @param fp		The opened makefile
+ * @param rounds	Unused
+ *
+ * @return			0 if all tokenizers agree, else 1.
+ */
+static int check_file(const char *name, FILE *fp, long rounds)
+{
+	(void)rounds;
+
+	return check(name, fp);
+}
+
+/**
+ * Writes a random makefile-like text. Words of all lengths,
+ * every kind of whitespace, colons and NULL characters are
+ * mixed so that blocks are split at every possible position.
+ *
+ * @param fp		The file to write to
+ */
+static void generate_random(FILE *fp)
+{
+	static const char special[] = " \t\n\v\f\r:\0";
+	long len = rand() % MAX_RANDOM_LEN;
+
+	for (long i = 0; i < len; i++)
+	{
+		int kind = rand() % 16;
+
+		if (kind == 0)
+			fputc(special[rand() % (sizeof(special) - 1)], fp);
+		else if (kind == 1)
+			fputc(rand() % 256, fp);
+		else if (kind < 4)
+			fputc(" \n\t:"[kind - 2 + rand() % 3], fp);
+		else
+			fputc('a' + rand() % 26, fp);
+	}
+}
+
+/**
+ * Runs the check for a number of random makefiles.
+ *
+ * @param count		The amount of random makefiles
+ *
+ * @return			0 if every tokenizer agrees on all of them,
+ *					else 1.
+ */
+static int check_random(long count)
+{
+	int result = 0;
+
+	for (long i = 0; i < count && result == 0; i++)
+	{
+		FILE *fp = tmpfile();
+		if (fp == NULL)
+		{
+			perror("tmpfile");
+			return 1;
+		}
+
+		generate_random(fp);
+		fflush(fp);
+
+		char name[32];
+		snprintf(name, sizeof(name), "random-%ld", i);
+		result = check(name, fp);
+		fclose(fp);
+	}
+
+	return result;
+}
+
+int main(int argc, char **argv)
+{
+	long rounds = DEFAULT_ROUNDS;
+	long n_rules = DEFAULT_RULES;
+	long n_prereqs = DEFAULT_PREREQS;
+	long n_random = -1;
+	const char *impl = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:n:p:i:c:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'r':
+			rounds = strtol(optarg, NULL, 10);
+			break;
+		case 'n':
+			n_rules = strtol(optarg, NULL, 10);
+			break;
+		case 'p':
+			n_prereqs = strtol(optarg, NULL, 10);
+			break;
+		case 'i':
+			impl = optarg;
+			break;
+		case 'c':
+			n_random = strtol(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r ROUNDS] [-n RULES] [-p PREREQS] "
+				"[-i IMPL] [-c COUNT] [FILES ...]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (rounds < 1 || n_rules < 1 || n_prereqs < 1)
+	{
+		fprintf(stderr, "%s: Arguments must be positive\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (impl != NULL && scan_select(impl) != 0)
+	{
+		fprintf(stderr, "%s: Tokenizer '%s' isn't supported\n", argv[0], impl);
+		return EXIT_FAILURE;
+	}
+
+	// Measure or check, with the same makefiles
+	int (*run)(const char *, FILE *, long) = n_random < 0 ? bench : check_file;
+	int result = n_random < 0 ? 0 : check_random(n_random);
+
+	if (optind == argc)
+	{
+		FILE *fp = tmpfile();
+		if (fp == NULL)
+		{
+			perror("tmpfile");
+			return EXIT_FAILURE;
+		}
+
+		generate(fp, n_rules, n_prereqs);
+		fflush(fp);
+		result |= run("generated", fp, rounds);
+		fclose(fp);
+	}
+
+	for (int i = optind; i < argc; i++)
+	{
+		FILE *fp = fopen(argv[i], "r");
+		if (fp == NULL)
+		{
+			perror(argv[i]);
+			result = 1;
+			continue;
+		}
+
+		result |= run(argv[i], fp, rounds);
+		fclose(fp);
+	}
+
+	if (n_random >= 0)
+	{
+		printf("check impls=%s", impls[0]);
+		for (size_t i = 1; i < N_IMPLS; i++)
+		{
+			if (scan_select(impls[i]) == 0)
+				printf(",%s", impls[i]);
+		}
+		printf(" random=%ld result=%s\n", n_random, result == 0 ? "ok" : "mismatch");
+	}
+
+	return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
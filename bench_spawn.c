@@ -0,0 +1,177 @@
+/**
+ * Measures the latency of starting and waiting for a command
+ * with each of the launch methods of the 'mmake' program: a
+ * plain fork and execvp, posix_spawnp and the spawn helper.
+ * Before measuring, the process fills a large heap to mimic
+ * the memory held by a big parsed makefile, which is what
+ * makes fork slow.
+ *
+ * The program supports the use of the optional flags
+ *  -n COUNT	: Starts the command [COUNT] times per method,
+ *				  defaults to 1000
+ *  -m MB		: Megabytes of heap to fill first, defaults to 512
+ *
+ * Every result is printed as one line of key=value pairs.
+ *
+ * Usage:
+ *  ./bench_spawn [-n COUNT] [-m MB] [COMMAND ...]
+ *
+ * @file bench_spawn.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+#define DEFAULT_COUNT 1000
+#define DEFAULT_MB 512
+
+// * Internal functions
+
+/**
+ * Starts a command with fork and execvp, as 'mmake' used to.
+ *
+ * @param cmd		The command
+ *
+ * @return			The pid of the child, or -1 on error.
+ */
+static pid_t fork_command(char **cmd)
+{
+	pid_t pid = fork();
+
+	if (pid == 0)
+	{
+		execvp(cmd[0], cmd);
+		_exit(127);
+	}
+
+	return pid;
+}
+
+/**
+ * Starts a command with spawn_command, with the output of
+ * this process.
+ *
+ * @param cmd		The command
+ *
+ * @return			The pid of the child, or -1 on error.
+ */
+static pid_t spawn_inherit(char **cmd)
+{
+	return spawn_command(cmd, -1, -1);
+}
+
+/**
+ * Gets the current time of a monotonic clock in seconds.
+ *
+ * @return			The current time
+ */
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Starts and waits for a command a number of times and prints
+ * the average latency.
+ *
+ * @param method	The name of the launch method
+ * @param launch	The launch function
+ * @param cmd		The command
+ * @param count		The amount of times to start it
+ * @param heap_mb	The size of the filled heap, for the report
+ *
+ * @return			0 on success, 1 if a launch failed.
+ */
+static int bench(const char *method, pid_t (*launch)(char **), char **cmd,
+	long count, long heap_mb)
+{
+	double start = now();
+
+	for (long i = 0; i < count; i++)
+	{
+		int status;
+		pid_t pid = launch(cmd);
+
+		if (pid < 0 || waitpid(pid, &status, 0) != pid)
+		{
+			fprintf(stderr, "Launch with %s failed\n", method);
+			return 1;
+		}
+	}
+
+	double elapsed = now() - start;
+
+	printf("method=%s heap_mb=%ld count=%ld total_ms=%.1f us_per_spawn=%.1f\n",
+		method, heap_mb, count, elapsed * 1e3, elapsed / count * 1e6);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long count = DEFAULT_COUNT;
+	long heap_mb = DEFAULT_MB;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:m:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			count = strtol(optarg, NULL, 10);
+			break;
+		case 'm':
+			heap_mb = strtol(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n COUNT] [-m MB] [COMMAND ...]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (count < 1 || heap_mb < 0)
+	{
+		fprintf(stderr, "%s: Invalid arguments\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	char *default_cmd[] = { "true", NULL };
+	char **cmd = optind < argc ? &argv[optind] : default_cmd;
+
+	// Like 'mmake', fork the helper before the heap grows
+	if (spawn_helper_start() != 0)
+	{
+		perror("Couldn't start spawn helper");
+		return EXIT_FAILURE;
+	}
+
+	size_t heap_len = (size_t)heap_mb << 20;
+	char *heap = malloc(heap_len);
+	if (heap_len > 0 && heap == NULL)
+	{
+		perror("Allocation failed");
+		return EXIT_FAILURE;
+	}
+	memset(heap, 1, heap_len);
+
+	int result = bench("helper", spawn_inherit, cmd, count, heap_mb);
+	spawn_helper_stop();
+
+	result |= bench("posix_spawnp", spawn_inherit, cmd, count, heap_mb);
+	result |= bench("fork", fork_command, cmd, count, heap_mb);
+
+	free(heap);
+
+	return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
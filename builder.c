@@ -8,8 +8,114 @@
  * @date 2025.10.01
  */
 
+#include <errno.h>
+#include <poll.h>
+
 #include "builder.h"
 #include "program_handler.h"
+#include "jobserver.h"
+#include "prefetch.h"
+#include "sigdb.h"
+#include "hash.h"
+#include "buildlog.h"
+#include "spawn.h"
+#include "trace.h"
+#include "stats.h"
+#include "output.h"
+#include "cache.h"
+#include "dispatch.h"
+
+#define SIGDB_SUFFIX ".sigdb"
+#define BUILDLOG_SUFFIX ".mmlog"
+
+// Expected run time of every command when no target has been
+//	built before, only its ratio to the real times matters
+#define DEFAULT_DURATION_NS 100000000ULL
+#define NS_PER_SEC 1e9
+
+// Failure statuses that aren't the wait status of a command
+#define STATUS_NOT_STARTED -1
+#define STATUS_NO_RULE -2
+
+typedef struct job {
+	pid_t pid;        // Pid of the job's child process
+	node *target;     // Node being built, NULL if the slot is free
+	struct timespec start;  // Time the job was started
+	uint64_t trace_start;   // Time spawning the job began, for --trace
+	int has_token;    // Set if the job holds a jobserver token
+	char token;       // The jobserver token held by the job
+	capture *output;  // Captured output of the job, or NULL
+	int cacheable;    // Set if the target is stored in the result cache
+	cachekey key;     // Result cache key of the target
+} job;
+
+typedef struct visit {
+	node *target;     // Node being collected
+	size_t next;      // Index of the next prerequisite to visit
+} visit;
+
+typedef struct failure {
+	node *target;     // The node that failed
+	int status;       // Wait status of its command, or STATUS_*
+} failure;
+
+typedef struct scheduler {
+	optioninfo *options;  // Information about the program's flags
+	node **plan;          // All nodes to decide, in post-order
+	size_t n_plan;        // Amount of nodes in the plan
+	node **leaves;        // All reachable leaves
+	size_t n_leaves;      // Amount of reachable leaves
+	size_t n_finished;    // Amount of planned nodes that have finished
+	node **ready;         // Max-heap of nodes whose prerequisites are done,
+	                      //	ordered by priority
+	size_t n_ready;       // Amount of nodes in the heap
+	node *deferred;       // Node to rebuild that is waiting for a token,
+	                      //	or for a job to release its output buffers
+	job *jobs;            // Job slots, the local ones first and then
+	                      //	one per worker
+	int max_jobs;         // Amount of job slots
+	int n_local;          // Amount of local job slots, related to -j flag
+	int n_running;        // Amount of occupied job slots
+	int n_local_running;  // Amount of occupied local job slots
+	int n_tokens;         // Amount of jobserver tokens held by jobs
+	int peak_tokens;      // Most jobserver tokens held at once
+	worker **workers;     // Workers of the remote job slots, or NULL
+	int failed;           // Set once any node has failed
+	int keep_going;       // Set if independent nodes are built after
+	                      //	a failure, related to -k flag
+	int dry_run;          // Set if commands are printed instead of run,
+	                      //	related to -n flag
+	int question;         // Set if only staleness is checked, related
+	                      //	to -q flag
+	int stale;            // Set once a node was found out of date with -q
+	failure *failures;    // Nodes that failed themselves
+	size_t n_failures;    // Amount of nodes that failed themselves
+	size_t n_skipped;     // Amount of nodes not built due to a failure
+	node **stack;         // Scratch stack for skipping dependents
+	visit *path;          // Stack of nodes being collected, from a
+	                      //	target down to the current node
+	sigdb *db;            // Content signatures, NULL unless --hash is used
+	buildlog *log;        // Log of the commands run for each target
+	resultcache *cache;   // Cache of built targets, NULL unless
+	                      //	--cache-dir is used
+	struct timespec start; // Time the schedule started running
+	outputsync sync;      // How the output of jobs is kept apart
+	struct pollfd *polls; // Output and error pipes of the running jobs,
+	                      //	to wait on
+	capture **held;       // Output of finished jobs by plan order, kept
+	                      //	until all earlier nodes have finished
+	size_t next_flush;    // Plan position of the next output to show
+} scheduler;
+
+// Kept open between builds, so a repeated build doesn't load
+//	them again
+static struct {
+	sigdb *db;        // Content signatures, NULL unless --hash is used
+	buildlog *log;    // Log of the commands run for each target
+	resultcache *cache; // Cache of built targets, or NULL
+	worker **workers; // Workers jobs are sent to, or NULL
+	size_t n_workers; // Amount of connected workers
+} records = { NULL, NULL, NULL, NULL, 0 };
 
 // * Internal functions
 
@@ -59,33 +165,33 @@ static int edited_sooner(struct timespec time1, struct timespec time2)
  * Checks if any prerequisites have been updated sooner than the
  * target or if the target doesn't exist.
  *
- * @param target	The target to check
- * @param prereqs	A NULL-terminated list of the target's prerequisites 
+ * @param target	The target node to check
  *
  * @return	1 if target doesn't exit of a prerequisite has updated,
  *			else 0.
  */
-static int check_should_rebuild(const char *target, const char**prereqs)
+static int check_should_rebuild(node *target)
 {
-	struct timespec target_mod_time = get_last_mod_time(target);
+	struct timespec target_mod_time = get_last_mod_time(target->name);
 
 	// Check if get_last_mod_time() failed
 	if (target_mod_time.tv_sec == -1)
 		return 1;
 
-	int i = -1;
-	while (prereqs[++i] != NULL)
+	for (size_t i = 0; i < target->n_prereqs; i++)
 	{
-		if (!file_exists(prereqs[i]))
+		const char *prereq = target->prereqs[i]->name;
+
+		if (!file_exists(prereq))
 			return 1;
 
-		struct timespec prereq_mod_time = get_last_mod_time(prereqs[i]);
+		struct timespec prereq_mod_time = get_last_mod_time(prereq);
 	
 		// Check if get_last_mod_time() failed
 		if (prereq_mod_time.tv_sec == -1)
 			return 1;
 
-		if (!file_exists(target) || edited_sooner(prereq_mod_time, target_mod_time))
+		if (!file_exists(target->name) || edited_sooner(prereq_mod_time, target_mod_time))
 			return 1;
 	}
 
@@ -93,104 +199,1655 @@ static int check_should_rebuild(const char *target, const char**prereqs)
 }
 
 /**
- * Runs the building process for a given rule. Returns 0 on
- * success, else 1 if any step during the process fails.
+ * Adds a command, formatted as by print_command, to the
+ * captured output of its job.
+ *
+ * @param output	The captured output
+ * @param cmd		A command as a list of arguments
+ */
+static void capture_command(capture *output, char **cmd)
+{
+	size_t len = 1;
+	for (int i = 0; cmd[i]; i++)
+		len += strlen(cmd[i]) + 1;
+
+	char *line = malloc(len);
+	if (line == NULL)
+	{
+		print_command(cmd);
+		return;
+	}
+
+	size_t pos = 0;
+	for (int i = 0; cmd[i]; i++)
+	{
+		size_t arg_len = strlen(cmd[i]);
+		memcpy(line + pos, cmd[i], arg_len);
+		pos += arg_len;
+
+		if (cmd[i+1])
+			line[pos++] = ' ';
+	}
+	line[pos++] = '\n';
+
+	capture_append(output, STREAM_OUT, line, pos);
+	free(line);
+}
+
+/**
+ * Starts the building process for a given rule without waiting
+ * for it to finish. The command is printed unless silenced,
+ * or added to the captured output if there is one.
  *
  * @param options	Information about the program's flags
  * @param ruleptr	Pointer to the rule to build
+ * @param output	Capture for the output of the command, or NULL
  *
- * @return		0 on success, else 1.
+ * @return		The pid of the started child process, or -1 on error.
  */
-static int build(optioninfo *options, rule *ruleptr)
+static pid_t build(optioninfo *options, rule *ruleptr, capture *output)
 {
 	char **cmd = rule_cmd(ruleptr);
 
+	if (output != NULL)
+	{
+		if (!uses_flag(options, SILENCE_COMMANDS))
+			capture_command(output, cmd);
+
+		pid_t pid = spawn_command(cmd, capture_child_fd(output, STREAM_OUT),
+			capture_child_fd(output, STREAM_ERR));
+		capture_close_child_fd(output);
+
+		return pid;
+	}
+
 	if (!uses_flag(options, SILENCE_COMMANDS))
 		print_command(cmd);
-	
-	pid_t pid = fork();
-	
-	if (pid < 0)
+
+	// Flush so the command is printed before the child's output
+	fflush(stdout);
+
+	return spawn_command(cmd, -1, -1);
+}
+
+/**
+ * Sends the command of a node to a worker. The command is
+ * added to the captured output unless silenced, like a local
+ * one.
+ *
+ * @param options	Information about the program's flags
+ * @param w			The worker
+ * @param target	The node to build
+ * @param output	Capture for the output of the command
+ *
+ * @return		0 on success, else 1.
+ */
+static int dispatch(optioninfo *options, worker *w, node *target, capture *output)
+{
+	if (!uses_flag(options, SILENCE_COMMANDS))
+		capture_command(output, rule_cmd(target->ruleptr));
+
+	return worker_send(w, target);
+}
+
+/**
+ * Prints the cycle closed by an edge to a node that is still
+ * being collected, e.g. "a -> b -> a".
+ *
+ * @param sched		The scheduler
+ * @param depth		The amount of nodes on the collect path
+ * @param target	The node the cycle returns to
+ */
+static void print_cycle(scheduler *sched, size_t depth, node *target)
+{
+	size_t first = depth;
+	while (sched->path[first - 1].target != target)
+		first--;
+
+	fprintf(stderr, "Circular dependency detected: ");
+	for (size_t i = first - 1; i < depth; i++)
+		fprintf(stderr, "%s -> ", sched->path[i].target->name);
+	fprintf(stderr, "%s\n", target->name);
+}
+
+/**
+ * Collects all nodes reachable from a target that have not
+ * yet been decided into the schedule. Collected nodes are
+ * marked as waiting and appended in post-order, so every
+ * node comes after all of its prerequisites. Leaves are
+ * gathered separately since they have no command to run.
+ *
+ * The graph is walked depth-first on an explicit stack, where
+ * in-progress nodes are the ones on the current path, so the
+ * depth of a chain is only limited by memory and a cycle is
+ * found as an edge back to such a node.
+ *
+ * @param sched		The scheduler
+ * @param target	The node to collect
+ *
+ * @return	0 on success, 1 if a cycle was found.
+ */
+static int collect_nodes(scheduler *sched, node *target)
+{
+	size_t depth = 0;
+	node *next = target;
+
+	for (;;)
 	{
-		perror("Fork failed");
-		return 1;
+		int result = 0;
+
+		switch (next == NULL ? NODE_WAITING : next->state)
+		{
+			case NODE_UNVISITED:
+				if (next->is_leaf)
+				{
+					next->state = NODE_WAITING;
+					sched->leaves[sched->n_leaves++] = next;
+				}
+				else
+				{
+					next->state = NODE_IN_PROGRESS;
+					sched->path[depth++] = (visit){ next, 0 };
+				}
+				break;
+			case NODE_IN_PROGRESS:
+				print_cycle(sched, depth, next);
+				result = 1;
+				break;
+			case NODE_FAILED:
+				result = 1;
+				break;
+			default:
+				break;
+		}
+
+		// Everything on the path depends on the failed node
+		if (result != 0)
+		{
+			while (depth > 0)
+				sched->path[--depth].target->state = NODE_FAILED;
+			return 1;
+		}
+
+		if (depth == 0)
+			return 0;
+
+		// Finish nodes whose prerequisites are all collected, then
+		//	continue with the next prerequisite on the path
+		visit *top = &sched->path[depth - 1];
+		if (top->next < top->target->n_prereqs)
+			next = top->target->prereqs[top->next++];
+		else
+		{
+			top->target->state = NODE_WAITING;
+			sched->plan[sched->n_plan++] = top->target;
+			depth--;
+			next = NULL;
+		}
 	}
+}
+
+/**
+ * Prefetches the file information of every collected node in
+ * one batch, so that the decisions during the build are made
+ * from memory. Then checks that all leaves exist.
+ *
+ * @param sched		The scheduler
+ *
+ * @return	0 on success, 1 if a leaf is missing.
+ */
+static int check_leaves(scheduler *sched)
+{
+	size_t n_paths = sched->n_plan + sched->n_leaves;
+	const char **paths = malloc(n_paths * sizeof(*paths));
 
-	// Child process logic
-	if (pid == 0)
+	if (paths != NULL)
 	{
-		execvp(cmd[0], cmd);
-		perror("execvp failed");
-		return 1;
+		for (size_t i = 0; i < sched->n_plan; i++)
+			paths[i] = sched->plan[i]->name;
+		for (size_t i = 0; i < sched->n_leaves; i++)
+			paths[sched->n_plan + i] = sched->leaves[i]->name;
+
+		uint64_t prefetch_start = trace_now();
+		prefetch_file_info(paths, n_paths);
+		trace_span("prefetch_file_info", "stat", TRACE_MAIN_TRACK, prefetch_start,
+			trace_now());
+		free(paths);
 	}
-		
-	// Parent process logic
-	int child_status = -1;
-	waitpid(pid, &child_status, 0);
 
-	// Validate child process exit status
-	if (child_status != 0)
-		return 1;
+	int result = 0;
+	for (size_t i = 0; i < sched->n_leaves; i++)
+	{
+		node *leaf = sched->leaves[i];
 
-	return 0;
+		// If the rule nor its file exists there is an error, else
+		//	if the file exists the build process should continue.
+		if (!file_exists(leaf->name))
+		{
+			fprintf(stderr, "A rule for '%s' does not exist\n", leaf->name);
+			leaf->state = NODE_FAILED;
+			sched->failures[sched->n_failures++] = (failure){ leaf, STATUS_NO_RULE };
+			result = 1;
+		}
+		else
+			leaf->state = NODE_UP_TO_DATE;
+	}
+
+	return result;
 }
 
-// * Visible functions
+/**
+ * Gets the time passed since a given time.
+ *
+ * @param start		The earlier time
+ *
+ * @return	The elapsed time in nanoseconds
+ */
+static uint64_t elapsed_since(struct timespec start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
-int check_target_build(optioninfo *options, makefile *mfile, const char *target)
+	return (now.tv_sec - start.tv_sec) * 1000000000ULL
+		+ now.tv_nsec - start.tv_nsec;
+}
+
+/**
+ * Checks if a node should be started before another. The node
+ * with the longest expected path to the end of the build goes
+ * first, ties are broken by the order of the plan.
+ *
+ * @param a		The first node
+ * @param b		The second node
+ *
+ * @return	1 if 'a' goes before 'b', else 0.
+ */
+static int runs_before(node *a, node *b)
 {
-	if (target == NULL) return 0;
-	int target_exists = file_exists(target);
+	if (a->priority_ns != b->priority_ns)
+		return a->priority_ns > b->priority_ns;
 
-	rule *ruleptr = makefile_rule(mfile, target);
-	
-	if (ruleptr == NULL) 
+	return a->order < b->order;
+}
+
+/**
+ * Adds a node to the ready heap.
+ *
+ * @param sched		The scheduler
+ * @param target	The node whose prerequisites are done
+ */
+static void push_ready(scheduler *sched, node *target)
+{
+	size_t i = sched->n_ready++;
+
+	while (i > 0 && runs_before(target, sched->ready[(i - 1) / 2]))
 	{
-		// If the rule nor its file exists there is an error, else
-		//	if the file exists the build process should continue.
-		if (!target_exists)
+		sched->ready[i] = sched->ready[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+
+	sched->ready[i] = target;
+}
+
+/**
+ * Removes the most critical node from the ready heap.
+ *
+ * @param sched		The scheduler
+ *
+ * @return	The node, or NULL if the heap is empty.
+ */
+static node *pop_ready(scheduler *sched)
+{
+	if (sched->n_ready == 0)
+		return NULL;
+
+	node *top = sched->ready[0];
+	node *last = sched->ready[--sched->n_ready];
+	size_t i = 0;
+
+	while (2 * i + 1 < sched->n_ready)
+	{
+		size_t child = 2 * i + 1;
+
+		if (child + 1 < sched->n_ready
+			&& runs_before(sched->ready[child + 1], sched->ready[child]))
+			child++;
+
+		if (!runs_before(sched->ready[child], last))
+			break;
+
+		sched->ready[i] = sched->ready[child];
+		i = child;
+	}
+
+	if (sched->n_ready > 0)
+		sched->ready[i] = last;
+
+	return top;
+}
+
+/**
+ * Weighs every planned node by the longest expected run time
+ * from it to the end of the build, following its dependents.
+ * The run time of each command is taken from the build log,
+ * and targets that have never been built are expected to take
+ * the average time of the ones that have.
+ *
+ * @param sched		The scheduler
+ */
+static void estimate_priorities(scheduler *sched)
+{
+	uint64_t known_total = 0;
+	size_t n_known = 0;
+
+	for (size_t i = 0; i < sched->n_plan; i++)
+	{
+		node *target = sched->plan[i];
+		logentry entry;
+
+		target->order = i;
+		target->estimate_ns = 0;
+		target->elapsed_ns = 0;
+
+		// Targets logged while up to date have no run time
+		if (sched->log != NULL && buildlog_lookup(sched->log, target->name, &entry)
+			&& entry.duration_ns > 0)
 		{
-			fprintf(stderr, "A rule for '%s' does not exist\n", target);
-			return 1;
+			// Keep 0 free to mark targets without history
+			target->estimate_ns = entry.duration_ns + 1;
+			known_total += target->estimate_ns;
+			n_known++;
 		}
-		return 0;
 	}
 
-	const char **prereqs = rule_prereq(ruleptr);
+	uint64_t fallback = n_known > 0 ? known_total / n_known : DEFAULT_DURATION_NS;
 
-	// Build prerequisites recursively
-	int i = -1;
-	while (prereqs[++i] != NULL)
+	// Every dependent comes after its prerequisites in the plan,
+	//	so walking it backwards finishes dependents first
+	for (size_t i = sched->n_plan; i-- > 0;)
 	{
-		if (check_target_build(options, mfile, prereqs[i]) != 0)
-			return 1;
+		node *target = sched->plan[i];
+		uint64_t longest = 0;
+
+		if (target->estimate_ns == 0)
+			target->estimate_ns = fallback;
+
+		for (size_t j = 0; j < target->n_dependents; j++)
+		{
+			node *dependent = target->dependents[j];
+
+			if (dependent->state == NODE_WAITING && dependent->priority_ns > longest)
+				longest = dependent->priority_ns;
+		}
+
+		target->priority_ns = target->estimate_ns + longest;
+	}
+}
+
+/**
+ * Prints how long the build took compared with the lower
+ * bound for any schedule of the commands that were run: the
+ * longest chain of dependent commands, or all of the work
+ * spread evenly over the job slots, whichever is longer. As a
+ * jobserver client, the local slots are only those the tokens
+ * held at once allowed, as the slot count is just an upper
+ * bound there.
+ *
+ * @param sched		The scheduler
+ */
+static void print_report(scheduler *sched)
+{
+	uint64_t wall_ns = elapsed_since(sched->start);
+	uint64_t work_ns = 0;
+	uint64_t critical_ns = 0;
+	size_t n_run = 0;
+
+	// Reuse the priorities as the time of the longest chain of
+	//	commands ending at each node, prerequisites come first
+	for (size_t i = 0; i < sched->n_plan; i++)
+	{
+		node *target = sched->plan[i];
+		uint64_t longest = 0;
+
+		for (size_t j = 0; j < target->n_prereqs; j++)
+		{
+			node *prereq = target->prereqs[j];
+
+			if (!prereq->is_leaf && prereq->priority_ns > longest)
+				longest = prereq->priority_ns;
+		}
+
+		target->priority_ns = longest + target->elapsed_ns;
+		work_ns += target->elapsed_ns;
+		n_run += target->elapsed_ns > 0;
+
+		if (target->priority_ns > critical_ns)
+			critical_ns = target->priority_ns;
+	}
+
+	int n_slots = sched->max_jobs;
+	if (jobserver_is_client())
+		n_slots += sched->peak_tokens + 1 - sched->n_local;
+	uint64_t spread_ns = work_ns / n_slots;
+	uint64_t bound_ns = critical_ns > spread_ns ? critical_ns : spread_ns;
+
+	fprintf(stderr, "mmake: ran %zu commands, %.3f s of work on %d job slots\n",
+		n_run, work_ns / NS_PER_SEC, n_slots);
+	fprintf(stderr, "mmake: took %.3f s, lower bound %.3f s "
+		"(critical path %.3f s, work per slot %.3f s)",
+		wall_ns / NS_PER_SEC, bound_ns / NS_PER_SEC,
+		critical_ns / NS_PER_SEC, spread_ns / NS_PER_SEC);
+
+	if (wall_ns > 0)
+		fprintf(stderr, ", %.1f%% of optimal", 100.0 * bound_ns / wall_ns);
+
+	fprintf(stderr, "\n");
+}
+
+/**
+ * Marks every node that depends on a failed node, directly or
+ * through other nodes, as failed without building it.
+ *
+ * @param sched		The scheduler
+ * @param target	The failed node
+ */
+static void skip_dependents(scheduler *sched, node *target)
+{
+	size_t n_stack = 0;
+	sched->stack[n_stack++] = target;
+
+	// Every node is pushed at most once, since it stops waiting
+	while (n_stack > 0)
+	{
+		node *current = sched->stack[--n_stack];
+
+		for (size_t i = 0; i < current->n_dependents; i++)
+		{
+			node *dependent = current->dependents[i];
+
+			if (dependent->state != NODE_WAITING)
+				continue;
+
+			dependent->state = NODE_FAILED;
+			sched->n_finished++;
+			sched->n_skipped++;
+			sched->stack[n_stack++] = dependent;
+		}
+	}
+}
+
+/**
+ * Marks a node as finished and releases every dependent that
+ * was only waiting for this node into the ready queue. With
+ * --hash, the signature the node was decided on is recorded,
+ * unless nothing is built, e.g. with -n. The dependents of a
+ * failed node are never built.
+ *
+ * @param sched		The scheduler
+ * @param target	The finished node
+ * @param state		The final state of the node
+ */
+static void finish_node(scheduler *sched, node *target, nodestate state)
+{
+	target->state = state;
+	sched->n_finished++;
+
+	if (state == NODE_FAILED)
+	{
+		sched->failed = 1;
+		skip_dependents(sched, target);
+		return;
+	}
+
+	if (sched->db != NULL && target->has_signature && !sched->dry_run
+		&& !sched->question)
+		sigdb_set_signature(sched->db, target->name, target->signature);
+
+	for (size_t i = 0; i < target->n_dependents; i++)
+	{
+		node *dependent = target->dependents[i];
+
+		if (dependent->state == NODE_WAITING && --dependent->n_pending == 0)
+			push_ready(sched, dependent);
+	}
+}
+
+/**
+ * Finishes a node whose command failed and remembers why, for
+ * the summary printed with -k.
+ *
+ * @param sched		The scheduler
+ * @param target	The failed node
+ * @param status	Wait status of the command, or STATUS_*
+ */
+static void fail_node(scheduler *sched, node *target, int status)
+{
+	sched->failures[sched->n_failures++] = (failure){ target, status };
+	finish_node(sched, target, NODE_FAILED);
+}
+
+/**
+ * Prints every node that failed and why, and how many nodes
+ * weren't built because of them.
+ *
+ * @param sched		The scheduler
+ */
+static void print_failures(scheduler *sched)
+{
+	if (sched->n_failures == 0)
+		return;
+
+	fprintf(stderr, "mmake: %zu target%s failed:\n", sched->n_failures,
+		sched->n_failures == 1 ? "" : "s");
+
+	for (size_t i = 0; i < sched->n_failures; i++)
+	{
+		int status = sched->failures[i].status;
+		const char *name = sched->failures[i].target->name;
+
+		if (status == STATUS_NO_RULE)
+			fprintf(stderr, "  %s: no rule and no file\n", name);
+		else if (status == STATUS_NOT_STARTED)
+			fprintf(stderr, "  %s: command couldn't be started\n", name);
+		else if (WIFSIGNALED(status))
+			fprintf(stderr, "  %s: killed by signal %d\n", name, WTERMSIG(status));
+		else
+			fprintf(stderr, "  %s: exit status %d\n", name, WEXITSTATUS(status));
 	}
 
-	// Check if this target needs to be rebuilt
-	int should_rebuild = uses_flag(options, FORCE_REBUILD);
+	if (sched->n_skipped > 0)
+		fprintf(stderr, "mmake: %zu target%s not built because a prerequisite failed\n",
+			sched->n_skipped, sched->n_skipped == 1 ? "" : "s");
+}
 
-	if (check_should_rebuild(target, prereqs) == 1)
-		should_rebuild = 1;
+/**
+ * Computes the content signature of a node's prerequisites,
+ * which changes whenever the contents of any prerequisite
+ * change. The signature is stored in the node.
+ *
+ * @param sched		The scheduler
+ * @param target	The node to compute the signature for
+ *
+ * @return	0 on success, 1 if any prerequisite can't be hashed.
+ */
+static int compute_signature(scheduler *sched, node *target)
+{
+	uint64_t signature = 0;
+	target->has_signature = 0;
 
-	// Run rebuild logic
-	if (should_rebuild)
+	for (size_t i = 0; i < target->n_prereqs; i++)
 	{
-		if (build(options, ruleptr) == 1)
+		const char *prereq = target->prereqs[i]->name;
+		uint64_t content = 0;
+
+		if (sigdb_file_hash(sched->db, prereq, get_file_size(prereq),
+			get_last_mod_time(prereq), &content) != 0)
 			return 1;
+
+		signature = hash_bytes(prereq, strlen(prereq), signature);
+		signature = hash_bytes(&content, sizeof(content), signature);
 	}
 
+	target->signature = signature;
+	target->has_signature = 1;
+
 	return 0;
 }
 
-int validate_targets(makefile *mfile, char **targets)
+/**
+ * Decides if a node whose prerequisites have all finished
+ * must be rebuilt. With --hash, a target is only rebuilt if
+ * the contents of its prerequisites differ from when it was
+ * last built. Targets without a recorded signature are
+ * decided by modification times. A target is always rebuilt
+ * if its command differs from the one in the build log, or
+ * if its file was modified after it was logged.
+ *
+ * @param sched		The scheduler
+ * @param target	The node to check
+ *
+ * @return	1 if the node must be rebuilt, else 0.
+ */
+static int needs_rebuild(scheduler *sched, node *target)
 {
-	int i = -1;
-	while (targets[++i])
+	int force = uses_flag(sched->options, FORCE_REBUILD);
+
+	if (sched->db != NULL)
+		compute_signature(sched, target);
+
+	if (force)
+		return 1;
+
+	// Rebuild if the command differs from the one last used, or
+	//	if the output was changed since, e.g. edited by hand
+	logentry entry;
+	if (sched->log != NULL && buildlog_lookup(sched->log, target->name, &entry))
 	{
-		if (makefile_rule(mfile, targets[i]) == NULL)
+		struct timespec mtime = get_last_mod_time(target->name);
+
+		if (entry.cmd_hash != hash_command(rule_cmd(target->ruleptr))
+			|| entry.mtime.tv_sec != mtime.tv_sec
+			|| entry.mtime.tv_nsec != mtime.tv_nsec)
 			return 1;
 	}
 
-	return 0;
+	if (sched->db != NULL && target->has_signature)
+	{
+		uint64_t recorded = 0;
+
+		if (!file_exists(target->name))
+			return 1;
+
+		if (sigdb_get_signature(sched->db, target->name, &recorded))
+			return recorded != target->signature;
+	}
+
+	for (size_t i = 0; i < target->n_prereqs; i++)
+	{
+		if (target->prereqs[i]->state == NODE_REBUILT)
+			return 1;
+	}
+
+	return check_should_rebuild(target);
 }
 
+/**
+ * Records a successfully finished job in the build log.
+ *
+ * @param sched		The scheduler
+ * @param target	The node built by the job
+ */
+static void log_job(scheduler *sched, node *target)
+{
+	if (sched->log == NULL)
+		return;
+
+	logentry entry = {
+		.cmd_hash = hash_command(rule_cmd(target->ruleptr)),
+		.mtime = get_last_mod_time(target->name),
+		.duration_ns = target->elapsed_ns
+	};
+
+	buildlog_record(sched->log, target->name, &entry);
+}
+
+/**
+ * Records a node found up to date in the build log, unless it
+ * was logged before. Without an entry, a later change of its
+ * command would go unnoticed. Its run time is unknown and is
+ * logged as 0.
+ *
+ * @param sched		The scheduler
+ * @param target	The node found up to date
+ */
+static void log_up_to_date(scheduler *sched, node *target)
+{
+	logentry entry;
+
+	if (sched->log == NULL || buildlog_lookup(sched->log, target->name, &entry))
+		return;
+
+	target->elapsed_ns = 0;
+	log_job(sched, target);
+}
+
+/**
+ * Computes the result cache key of a node from its command,
+ * its name and the contents of its prerequisites.
+ *
+ * @param sched		The scheduler
+ * @param target	The node
+ * @param key		Set to the key
+ *
+ * @return	0 on success, 1 if a prerequisite couldn't be hashed,
+ *			e.g. because it isn't a file.
+ */
+static int compute_cache_key(scheduler *sched, node *target, cachekey *key)
+{
+	char **cmd = rule_cmd(target->ruleptr);
+	uint32_t argc = 0;
+
+	cache_key_init(key);
+
+	while (cmd[argc] != NULL)
+	{
+		cache_key_add(key, cmd[argc], strlen(cmd[argc]) + 1);
+		argc++;
+	}
+
+	cache_key_add(key, &argc, sizeof(argc));
+	cache_key_add(key, target->name, strlen(target->name) + 1);
+
+	for (size_t i = 0; i < target->n_prereqs; i++)
+	{
+		const char *prereq = target->prereqs[i]->name;
+		uint64_t content = 0;
+
+		// The signature database saves hashing unchanged files again
+		int failed = sched->db != NULL
+			? sigdb_file_hash(sched->db, prereq, get_file_size(prereq),
+				get_last_mod_time(prereq), &content)
+			: hash_file(prereq, &content);
+
+		if (failed)
+			return 1;
+
+		cache_key_add(key, prereq, strlen(prereq) + 1);
+		cache_key_add(key, &content, sizeof(content));
+	}
+
+	return 0;
+}
+
+/**
+ * Restores the file of a node from the result cache and
+ * finishes the node as rebuilt, without running its command.
+ *
+ * @param sched		The scheduler
+ * @param target	The node to rebuild
+ * @param key		The result cache key of the node
+ *
+ * @return	1 if the node was restored, else 0.
+ */
+static int restore_node(scheduler *sched, node *target, const cachekey *key)
+{
+	if (cache_restore(sched->cache, key, target->name) != 0)
+		return 0;
+
+	invalidate_file_info(target->name);
+	get_last_mod_time(target->name);
+
+	// Keep the run time of the command in the log, it's still
+	//	the time a rebuild would take
+	logentry entry;
+	target->elapsed_ns = 0;
+	if (sched->log != NULL && buildlog_lookup(sched->log, target->name, &entry))
+		target->elapsed_ns = entry.duration_ns;
+
+	log_job(sched, target);
+	finish_node(sched, target, NODE_REBUILT);
+
+	return 1;
+}
+
+/**
+ * Starts the command of a node in a free job slot, or sends it
+ * to the slot's worker, unless the node can be restored from
+ * the result cache. A node that can't be sent is made ready
+ * again, to run in another slot. If the output of the node
+ * can't be captured, e.g. when out of descriptors, the node
+ * waits for a running job to exit and free its buffers, or
+ * runs without capture if no job is running.
+ *
+ * @param sched		The scheduler
+ * @param target	The node to rebuild
+ * @param slot		The free job slot
+ * @param has_token	Set if a jobserver token was taken for the job
+ * @param token		The jobserver token taken for the job
+ *
+ * @return	1 if the node must wait for a job to exit, else 0.
+ */
+static int start_node(scheduler *sched, node *target, int slot, int has_token,
+	char token)
+{
+	uint64_t spawn_start = trace_now();
+	capture *output = NULL;
+	pid_t pid = -1;
+	cachekey key = { 0, 0 };
+	int cacheable = sched->cache != NULL && compute_cache_key(sched, target, &key) == 0;
+
+	if (cacheable && restore_node(sched, target, &key))
+	{
+		if (has_token)
+			jobserver_release(token);
+		trace_span(target->name, "restore", TRACE_MAIN_TRACK, spawn_start, trace_now());
+		return 0;
+	}
+
+	int remote = slot >= sched->n_local;
+
+	if (remote || sched->sync != OUTPUT_NONE)
+	{
+		output = remote ? capture_open() : capture_start();
+
+		if (output == NULL && (remote || sched->n_running > 0))
+		{
+			if (has_token)
+				jobserver_release(token);
+			return 1;
+		}
+
+		if (output == NULL)
+			perror("Couldn't capture output");
+	}
+
+	if (remote)
+	{
+		worker *w = sched->workers[slot - sched->n_local];
+
+		if (dispatch(sched->options, w, target, output) != 0)
+		{
+			fprintf(stderr, "Lost worker '%s', running its jobs locally\n",
+				worker_address(w));
+			capture_release(output);
+			push_ready(sched, target);
+			return 0;
+		}
+
+		// Remote jobs have no local process
+		pid = 0;
+	}
+	else
+		pid = build(sched->options, target->ruleptr, output);
+
+	if (pid < 0)
+	{
+		// Still show the command that couldn't be run
+		if (output != NULL)
+		{
+			fflush(stdout);
+			capture_flush(output, STDOUT_FILENO, STDERR_FILENO);
+			capture_release(output);
+		}
+
+		if (has_token)
+			jobserver_release(token);
+		fail_node(sched, target, STATUS_NOT_STARTED);
+		return 0;
+	}
+
+	stats_add(STAT_COMMANDS_STARTED, 1);
+
+	sched->jobs[slot] = (job){ 
+		.pid = pid, 
+		.target = target, 
+		.has_token = has_token, 
+		.token = token,
+		.trace_start = spawn_start,
+		.output = output,
+		.cacheable = cacheable,
+		.key = key
+	};
+	clock_gettime(CLOCK_MONOTONIC, &sched->jobs[slot].start);
+	trace_span("spawn", "spawn", slot + 1, spawn_start, trace_now());
+	sched->n_running++;
+	sched->n_tokens += has_token;
+	if (sched->n_tokens > sched->peak_tokens)
+		sched->peak_tokens = sched->n_tokens;
+	if (!remote)
+		sched->n_local_running++;
+	target->state = NODE_RUNNING;
+
+	return 0;
+}
+
+/**
+ * Picks a free job slot for a node. Local slots are preferred,
+ * and every local job except the first running one needs a
+ * jobserver token. Jobs sent to workers need none.
+ *
+ * @param sched		The scheduler
+ * @param has_token	Set if a jobserver token was taken
+ * @param token		Set to the jobserver token taken
+ *
+ * @return		The slot, or -1 if none can be used right now.
+ */
+static int pick_slot(scheduler *sched, int *has_token, char *token)
+{
+	*has_token = 0;
+
+	if (sched->n_local_running < sched->n_local)
+	{
+		int slot = 0;
+		while (sched->jobs[slot].target != NULL)
+			slot++;
+
+		if (sched->n_local_running == 0)
+			return slot;
+
+		*has_token = jobserver_acquire(token);
+		if (*has_token)
+			return slot;
+	}
+
+	for (int slot = sched->n_local; slot < sched->max_jobs; slot++)
+	{
+		if (sched->jobs[slot].target == NULL
+			&& worker_alive(sched->workers[slot - sched->n_local]))
+			return slot;
+	}
+
+	return -1;
+}
+
+/**
+ * Starts ready nodes while there are free job slots, the most
+ * critical first. Nodes that are up to date are finished right
+ * away. If no slot can be used, e.g. when no jobserver token
+ * is available, the node is deferred until a job has exited.
+ *
+ * @param sched		The scheduler
+ */
+static void start_ready_nodes(scheduler *sched)
+{
+	while ((!sched->failed || sched->keep_going) && sched->n_running < sched->max_jobs)
+	{
+		node *target = sched->deferred;
+		sched->deferred = NULL;
+
+		if (target == NULL)
+		{
+			target = pop_ready(sched);
+
+			if (target == NULL)
+				return;
+
+			uint64_t check_start = trace_now();
+			int rebuild = needs_rebuild(sched, target);
+			stats_add(STAT_TARGETS_CHECKED, 1);
+			trace_span(target->name, "check", TRACE_MAIN_TRACK, check_start, trace_now());
+
+			if (!rebuild)
+			{
+				log_up_to_date(sched, target);
+				finish_node(sched, target, NODE_UP_TO_DATE);
+				continue;
+			}
+
+			// Nothing is run with -q or -n. The first stale node
+			//	answers the question, and with -n every stale node is
+			//	shown and counts as rebuilt for its dependents
+			if (sched->question)
+			{
+				sched->stale = 1;
+				return;
+			}
+
+			if (sched->dry_run)
+			{
+				print_command(rule_cmd(target->ruleptr));
+				finish_node(sched, target, NODE_REBUILT);
+				continue;
+			}
+		}
+
+		char token = 0;
+		int has_token = 0;
+		int slot = pick_slot(sched, &has_token, &token);
+
+		if (slot == -1)
+		{
+			sched->deferred = target;
+			return;
+		}
+
+		if (start_node(sched, target, slot, has_token, token) != 0)
+		{
+			sched->deferred = target;
+			return;
+		}
+	}
+}
+
+/**
+ * Writes out captured output and returns its buffer.
+ *
+ * @param output	The captured output
+ */
+static void show_output(capture *output)
+{
+	// Anything 'mmake' printed itself goes first
+	fflush(stdout);
+	capture_flush(output, STDOUT_FILENO, STDERR_FILENO);
+	capture_release(output);
+}
+
+/**
+ * Shows the held output of finished jobs in plan order, up to
+ * the first node that hasn't finished yet.
+ *
+ * @param sched		The scheduler
+ * @param all		Set to show all held output, e.g. when no more
+ *					nodes will finish
+ */
+static void show_held_output(scheduler *sched, int all)
+{
+	while (sched->next_flush < sched->n_plan)
+	{
+		nodestate state = sched->plan[sched->next_flush]->state;
+
+		if (!all && (state == NODE_WAITING || state == NODE_RUNNING))
+			return;
+
+		if (sched->held[sched->next_flush] != NULL)
+		{
+			show_output(sched->held[sched->next_flush]);
+			sched->held[sched->next_flush] = NULL;
+		}
+
+		sched->next_flush++;
+	}
+}
+
+/**
+ * Finishes the node of a job that has exited, and shows the
+ * job's output if it was captured.
+ *
+ * @param sched			The scheduler
+ * @param slot			The slot of the job
+ * @param child_status	Wait status of the job
+ * @param usage			Resources used by the job
+ */
+static void finish_job(scheduler *sched, int slot, int child_status,
+	struct rusage *usage)
+{
+	job *finished = &sched->jobs[slot];
+	node *target = finished->target;
+	finished->target = NULL;
+
+	stats_add(STAT_CHILD_CPU_NS,
+		(usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000000000ULL
+		+ (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) * 1000ULL);
+	sched->n_running--;
+	if (slot < sched->n_local)
+		sched->n_local_running--;
+	target->elapsed_ns = elapsed_since(finished->start);
+	trace_span(target->name, "job", slot + 1, finished->trace_start, trace_now());
+
+	// The command may have changed the target file. It is read
+	//	again now, so the cache holds what the build left behind
+	//	and --watch can tell the build's own changes apart
+	invalidate_file_info(target->name);
+	get_last_mod_time(target->name);
+
+	if (child_status == 0)
+	{
+		log_job(sched, target);
+
+		if (finished->cacheable)
+			cache_store(sched->cache, &finished->key, target->name);
+	}
+
+	if (finished->has_token)
+	{
+		jobserver_release(finished->token);
+		sched->n_tokens--;
+	}
+
+	if (finished->output != NULL)
+	{
+		if (sched->sync == OUTPUT_MAKEFILE)
+			sched->held[target->order] = finished->output;
+		else
+			show_output(finished->output);
+		finished->output = NULL;
+	}
+
+	// Validate child process exit status
+	if (child_status == 0)
+	{
+		stats_add(STAT_TARGETS_REBUILT, 1);
+		finish_node(sched, target, NODE_REBUILT);
+	}
+	else
+		fail_node(sched, target, child_status);
+
+	if (sched->sync == OUTPUT_MAKEFILE)
+		show_held_output(sched, 0);
+}
+
+/**
+ * Waits for any running job to exit and finishes its node.
+ *
+ * @param sched		The scheduler
+ */
+static void reap_job(scheduler *sched)
+{
+	int child_status = -1;
+	struct rusage usage;
+	pid_t pid = wait4(-1, &child_status, 0, &usage);
+
+	if (pid < 0)
+	{
+		if (errno != EINTR)
+		{
+			perror("Waitpid failed");
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
+
+	for (int slot = 0; slot < sched->max_jobs; slot++)
+	{
+		if (sched->jobs[slot].pid == pid && sched->jobs[slot].target != NULL)
+		{
+			finish_job(sched, slot, child_status, &usage);
+			return;
+		}
+	}
+}
+
+/**
+ * Waits for the local job in a slot to exit and finishes its
+ * node.
+ *
+ * @param sched		The scheduler
+ * @param slot		The slot of the job
+ */
+static void wait_job(scheduler *sched, int slot)
+{
+	int child_status = -1;
+	struct rusage usage;
+	pid_t pid;
+
+	do
+		pid = wait4(sched->jobs[slot].pid, &child_status, 0, &usage);
+	while (pid == -1 && errno == EINTR);
+
+	if (pid == -1)
+	{
+		perror("Waitpid failed");
+		exit(EXIT_FAILURE);
+	}
+
+	finish_job(sched, slot, child_status, &usage);
+}
+
+/**
+ * Reads the next part of the reply of a worker. Once the reply
+ * has ended, the job is finished. If the worker is lost, its
+ * node is made ready again, to run in another slot.
+ *
+ * @param sched		The scheduler
+ * @param slot		The slot of the job
+ *
+ * @return		1 if the slot became free, else 0.
+ */
+static int read_remote_job(scheduler *sched, int slot)
+{
+	job *running = &sched->jobs[slot];
+	worker *w = sched->workers[slot - sched->n_local];
+	int child_status = -1;
+	int result = worker_read(w, running->output, &child_status);
+
+	if (result == 1)
+	{
+		// The command's resources were used on the worker
+		struct rusage usage;
+		memset(&usage, 0, sizeof(usage));
+		finish_job(sched, slot, child_status, &usage);
+		return 1;
+	}
+
+	if (result == -1)
+	{
+		node *target = running->target;
+
+		fprintf(stderr, "Lost worker '%s' while building '%s', running it "
+			"locally\n", worker_address(w), target->name);
+		capture_release(running->output);
+		running->output = NULL;
+		running->target = NULL;
+		sched->n_running--;
+		target->state = NODE_WAITING;
+		push_ready(sched, target);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Moves the output of running jobs into their buffers as it
+ * arrives. Once the output of a job ends, its command has
+ * exited or is about to, so it is waited for and finished.
+ * Waiting on the pipes keeps a job from blocking on a full
+ * one. Replies of workers are read as they arrive. A job whose
+ * output couldn't be captured has no pipes, and is waited for
+ * directly.
+ *
+ * @param sched		The scheduler
+ */
+static void reap_captured_job(scheduler *sched)
+{
+	for (int slot = 0; slot < sched->n_local; slot++)
+	{
+		job *running = &sched->jobs[slot];
+
+		if (running->target != NULL && running->output == NULL)
+		{
+			wait_job(sched, slot);
+			return;
+		}
+	}
+
+	// Only occupied slots are waited on, as poll fails if given
+	//	more entries than descriptors may be open
+	int n_polled = 0;
+
+	for (int slot = 0; slot < sched->max_jobs; slot++)
+	{
+		job *running = &sched->jobs[slot];
+		struct pollfd *pipes = &sched->polls[N_STREAMS * n_polled];
+
+		if (running->target == NULL)
+			continue;
+
+		n_polled++;
+		for (int i = 0; i < N_STREAMS; i++)
+		{
+			pipes[i].fd = -1;
+			pipes[i].events = POLLIN;
+			pipes[i].revents = 0;
+		}
+
+		if (slot >= sched->n_local)
+			pipes[0].fd = worker_fd(sched->workers[slot - sched->n_local]);
+		else
+		{
+			for (int i = 0; i < N_STREAMS; i++)
+				pipes[i].fd = capture_poll_fd(running->output, i);
+		}
+	}
+
+	if (poll(sched->polls, N_STREAMS * n_polled, -1) == -1)
+	{
+		if (errno != EINTR)
+		{
+			perror("Poll failed");
+			exit(EXIT_FAILURE);
+		}
+		return;
+	}
+
+	n_polled = 0;
+
+	for (int slot = 0; slot < sched->max_jobs; slot++)
+	{
+		job *running = &sched->jobs[slot];
+		struct pollfd *pipes = &sched->polls[N_STREAMS * n_polled];
+
+		if (running->target == NULL)
+			continue;
+
+		n_polled++;
+		if (pipes[0].revents == 0 && pipes[1].revents == 0)
+			continue;
+
+		if (slot >= sched->n_local)
+		{
+			if (read_remote_job(sched, slot))
+				return;
+			continue;
+		}
+
+		if (!capture_drain(running->output))
+			continue;
+
+		// One job at a time, so new jobs are started right away
+		wait_job(sched, slot);
+		return;
+	}
+}
+
+/**
+ * Runs the schedule. Ready nodes are started while there are
+ * free job slots and jobserver tokens, most critical first,
+ * then the scheduler waits for a job to exit.
+ * After a failure no new jobs are started, but the running
+ * ones are waited for. With -k, only the nodes depending on
+ * the failed one are skipped and all others are still built.
+ *
+ * @param sched		The scheduler
+ */
+static void run_schedule(scheduler *sched)
+{
+	clock_gettime(CLOCK_MONOTONIC, &sched->start);
+
+	for (int slot = 0; slot < sched->max_jobs && trace_enabled(); slot++)
+	{
+		char track_name[128];
+		if (slot < sched->n_local)
+			snprintf(track_name, sizeof(track_name), "job slot %d", slot + 1);
+		else
+			snprintf(track_name, sizeof(track_name), "worker %s",
+				worker_address(sched->workers[slot - sched->n_local]));
+		trace_name_track(slot + 1, track_name);
+	}
+	estimate_priorities(sched);
+
+	// Missing files fail their dependents up front
+	for (size_t i = 0; i < sched->n_leaves; i++)
+	{
+		if (sched->leaves[i]->state == NODE_FAILED)
+			skip_dependents(sched, sched->leaves[i]);
+	}
+
+	// Nodes without unfinished prerequisites are ready from the start
+	for (size_t i = 0; i < sched->n_plan; i++)
+	{
+		node *target = sched->plan[i];
+
+		if (target->state != NODE_WAITING)
+			continue;
+
+		target->n_pending = 0;
+		for (size_t j = 0; j < target->n_prereqs; j++)
+		{
+			if (target->prereqs[j]->state == NODE_WAITING)
+				target->n_pending++;
+		}
+
+		if (target->n_pending == 0)
+			push_ready(sched, target);
+	}
+
+	while (sched->n_finished < sched->n_plan)
+	{
+		start_ready_nodes(sched);
+
+		if (sched->n_running == 0)
+			break;
+
+		if (sched->sync == OUTPUT_NONE)
+			reap_job(sched);
+		else
+			reap_captured_job(sched);
+	}
+
+	if (sched->held != NULL)
+		show_held_output(sched, 1);
+
+	if (sched->keep_going)
+		print_failures(sched);
+
+	if (uses_flag(sched->options, BUILD_REPORT))
+		print_report(sched);
+}
+
+/**
+ * Gets the path of a file kept next to the makefile, named
+ * after the makefile with a suffix.
+ *
+ * @param options	Information about the program's flags
+ * @param suffix	The suffix of the file
+ *
+ * @return	The path, which must be freed, or NULL on error.
+ */
+static char *sidecar_path(optioninfo *options, const char *suffix)
+{
+	const char *makefile_name = get_makefile_name(options);
+	size_t path_len = strlen(makefile_name) + strlen(suffix) + 1;
+	char *path = malloc(path_len);
+
+	if (path != NULL)
+		snprintf(path, path_len, "%s%s", makefile_name, suffix);
+
+	return path;
+}
+
+/**
+ * Opens the signature database and build log belonging to the
+ * makefile, unless an earlier build has opened them already.
+ * The signature database is only used with --hash. With -n
+ * and -q nothing is built, so the records are only read and
+ * no cache is used. A build log that can't be opened only
+ * costs the run times used for scheduling, so the build goes
+ * on without it.
+ *
+ * @param sched		The scheduler
+ *
+ * @return	0 on success, else 1.
+ */
+static int open_records(scheduler *sched)
+{
+	int read_only = sched->dry_run || sched->question;
+
+	if (records.log == NULL)
+	{
+		char *log_path = sidecar_path(sched->options, BUILDLOG_SUFFIX);
+		if (log_path == NULL)
+		{
+			perror("Allocation failed");
+			return 1;
+		}
+
+		records.log = buildlog_open(log_path, read_only);
+		free(log_path);
+
+		if (records.log == NULL)
+			fprintf(stderr, "Building without a build log\n");
+	}
+
+	if (records.db == NULL && uses_flag(sched->options, CONTENT_HASH))
+	{
+		char *db_path = sidecar_path(sched->options, SIGDB_SUFFIX);
+		if (db_path == NULL)
+		{
+			perror("Allocation failed");
+			return 1;
+		}
+
+		records.db = sigdb_open(db_path, read_only);
+		free(db_path);
+
+		if (records.db == NULL)
+			return 1;
+	}
+
+	// The build goes on without a cache it can't use
+	const char *cache_dir = get_cache_dir(sched->options);
+	if (records.cache == NULL && cache_dir != NULL && !read_only)
+	{
+		records.cache = cache_open(cache_dir, get_cache_size(sched->options));
+
+		if (records.cache == NULL)
+			fprintf(stderr, "Couldn't open cache directory '%s': %s\n", cache_dir,
+				strerror(errno));
+	}
+
+	sched->log = records.log;
+	sched->db = records.db;
+	sched->cache = records.cache;
+
+	return 0;
+}
+
+/**
+ * Connects to the workers given with --workers, unless an
+ * earlier build has connected already. Nothing is sent with
+ * -n or -q, so no workers are used then.
+ *
+ * @param options	Information about the program's flags
+ */
+static void open_workers(optioninfo *options)
+{
+	const char *list = get_workers(options);
+
+	if (records.workers != NULL || list == NULL || uses_flag(options, DRY_RUN)
+		|| uses_flag(options, QUESTION))
+		return;
+
+	// The build goes on locally without workers it can't reach
+	records.workers = workers_connect(list, &records.n_workers);
+}
+
+/**
+ * Keeps the nodes of a finished schedule that are up to date
+ * and resets all others, so that the next build of the same
+ * graph only collects nodes that still need to be decided.
+ * The files of failed nodes are stated again, so that the
+ * cache holds whatever their commands left behind.
+ *
+ * @param sched		The scheduler
+ */
+static void settle_nodes(scheduler *sched)
+{
+	node **lists[] = { sched->plan, sched->leaves };
+	size_t lengths[] = { sched->n_plan, sched->n_leaves };
+
+	for (size_t l = 0; l < 2; l++)
+	{
+		for (size_t i = 0; i < lengths[l]; i++)
+		{
+			node *target = lists[l][i];
+
+			if (target->state == NODE_REBUILT)
+				target->state = NODE_UP_TO_DATE;
+			else if (target->state != NODE_UP_TO_DATE)
+			{
+				if (target->state == NODE_FAILED)
+					get_last_mod_time(target->name);
+				target->state = NODE_UNVISITED;
+			}
+		}
+	}
+}
+
+/**
+ * Frees the memory used by a scheduler.
+ *
+ * @param sched		The scheduler
+ */
+static void free_scheduler(scheduler *sched)
+{
+	free(sched->plan);
+	free(sched->leaves);
+	free(sched->ready);
+	free(sched->jobs);
+	free(sched->failures);
+	free(sched->stack);
+	free(sched->path);
+	free(sched->polls);
+	free(sched->held);
+	capture_pool_free();
+}
+
+// * Visible functions
+
+int build_targets(optioninfo *options, graph *dag, const char **targets)
+{
+	size_t n_nodes = graph_size(dag);
+
+	open_workers(options);
+
+	scheduler sched = {
+		.options = options,
+		.n_local = get_job_count(options),
+		.max_jobs = get_job_count(options) + records.n_workers,
+		.workers = records.workers,
+		.plan = malloc(n_nodes * sizeof(*sched.plan)),
+		.leaves = malloc(n_nodes * sizeof(*sched.leaves)),
+		.ready = malloc(n_nodes * sizeof(*sched.ready)),
+		.failures = malloc(n_nodes * sizeof(*sched.failures)),
+		.stack = malloc(n_nodes * sizeof(*sched.stack)),
+		.path = malloc(n_nodes * sizeof(*sched.path)),
+		.keep_going = uses_flag(options, KEEP_GOING),
+		.dry_run = uses_flag(options, DRY_RUN),
+		.question = uses_flag(options, QUESTION),
+		.sync = get_output_sync(options),
+	};
+
+	// Replies of workers are waited for with the output of
+	//	local jobs
+	if (records.n_workers > 0 && sched.sync == OUTPUT_NONE)
+		sched.sync = OUTPUT_COMPLETION;
+
+	sched.jobs = calloc(sched.max_jobs, sizeof(*sched.jobs));
+	sched.polls = malloc(N_STREAMS * sched.max_jobs * sizeof(*sched.polls));
+
+	if (sched.sync == OUTPUT_MAKEFILE)
+		sched.held = calloc(n_nodes + 1, sizeof(*sched.held));
+
+	if ((n_nodes > 0 && (sched.plan == NULL || sched.leaves == NULL 
+		|| sched.ready == NULL || sched.failures == NULL || sched.stack == NULL
+		|| sched.path == NULL))
+		|| sched.jobs == NULL || sched.polls == NULL
+		|| (sched.sync == OUTPUT_MAKEFILE && sched.held == NULL))
+	{
+		perror("Allocation failed");
+		free_scheduler(&sched);
+		return 1;
+	}
+
+	if (open_records(&sched) != 0)
+	{
+		free_scheduler(&sched);
+		return 1;
+	}
+
+	int result = 0;
+	uint64_t phase_start = stats_clock();
+
+	// Collect the part of the graph reachable from all targets
+	int i = -1;
+	while (result == 0 && targets[++i] != NULL)
+	{
+		node *target = graph_node(dag, targets[i]);
+		
+		if (target == NULL) 
+		{
+			// Targets outside the graph can only be existing files
+			if (!file_exists(targets[i]))
+			{
+				fprintf(stderr, "A rule for '%s' does not exist\n", targets[i]);
+				result = 1;
+			}
+			continue;
+		}
+
+		result = collect_nodes(&sched, target);
+	}
+
+	// With -k, everything that doesn't need a missing file is
+	//	still built
+	if (result == 0)
+	{
+		result = check_leaves(&sched);
+		stats_end_phase(PHASE_STAT, phase_start);
+
+		if (result == 0 || sched.keep_going)
+		{
+			phase_start = stats_clock();
+			run_schedule(&sched);
+			stats_end_phase(PHASE_BUILD, phase_start);
+
+			if (sched.cache != NULL)
+				cache_trim(sched.cache);
+			result |= sched.failed | sched.stale;
+		}
+	}
+
+	settle_nodes(&sched);
+	free_scheduler(&sched);
+
+	return result;
+}
+
+void close_build_records(void)
+{
+	if (records.db != NULL)
+		sigdb_close(records.db);
+	if (records.log != NULL)
+		buildlog_close(records.log);
+	cache_close(records.cache);
+	workers_close(records.workers, records.n_workers);
+
+	records.db = NULL;
+	records.log = NULL;
+	records.cache = NULL;
+	records.workers = NULL;
+	records.n_workers = 0;
+}
+
+int validate_targets(makefile *mfile, char **targets)
+{
+	int i = -1;
+	while (targets[++i])
+	{
+		if (makefile_rule(mfile, targets[i]) == NULL)
+			return 1;
+	}
+
+	return 0;
+}
@@ -14,27 +14,53 @@
 #include <time.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 
 #include "parser.h"
 #include "program_handler.h"
 #include "file_handler.h"
+#include "graph.h"
 
 /**
- * Handles logic related to checking if a target should be
- * built or not, and if so builds it. A rule will be rebuilt if:
+ * Handles logic related to checking if targets should be
+ * built or not, and if so builds them. A rule will be rebuilt if:
  *  1. The target doesn't exit
  *  2. Any prerequisite has been updated sooner than the target
- *  3. The force rebuild flag has been specified
+ *  3. Any prerequisite was rebuilt during this run
+ *  4. The force rebuild flag has been specified
  *
- * This will be checked recursively for all prerequisites.
+ * All targets are scheduled together. The part of the graph
+ * reachable from them is collected first, then every node is
+ * decided once all of its prerequisites are done, with up to
+ * the -j job count of commands running in parallel. Every node
+ * is evaluated at most once per run, and a dependency cycle is
+ * reported as an error.
+ *
+ * With the dry-run flag, the commands of stale targets are
+ * printed in the order they would run, and the targets count
+ * as rebuilt. With the question flag, the build stops at the
+ * first stale target and 1 is returned. Neither runs any
+ * command.
+ *
+ * Afterwards, nodes that are up to date or were rebuilt are
+ * kept as up to date, and all others are reset, so that a
+ * later call only checks nodes that have been reset since.
  *
  * @param options	Information about the program's flags
- * @param target	The target to build if necessary
+ * @param dag		The linked dependency graph of the makefile
+ * @param targets	A NULL-terminated list of the targets to build
  *
- * @return	0 on success, else 1.
+ * @return	0 on success, else 1. With the question flag, 1 is
+ *			also returned if any target is out of date.
+ */
+int build_targets(optioninfo *options, graph *dag, const char **targets);
+
+/**
+ * Closes the build log and signature database kept open
+ * between calls to 'build_targets', writing them to disk.
  */
-int check_target_build(optioninfo *options, makefile *mfile, const char *target);
+void close_build_records(void);
 
 /**
  * Validates that all targets in a NULL-terminated list
@@ -0,0 +1,381 @@
+/**
+ * The build log records every command run by the 'mmake'
+ * program, similar to the .ninja_log of ninja. For every
+ * built target it stores a hash of the command line, the
+ * time of last modification of the output and how long the
+ * command took to run. Targets found up to date are logged
+ * too, with a run time of 0.
+ *
+ * The log is an append-only binary file next to the
+ * makefile. It is memory-mapped and loaded in a single
+ * pass when opened, and is compacted when most of its
+ * records have been superseded by newer ones.
+ *
+ * @file buildlog.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "buildlog.h"
+#include "hash.h"
+
+#define LOG_MAGIC "MMBLOG01"
+#define LOG_MAGIC_LEN 8
+#define MIN_TABLE_SIZE 64
+
+// Compact once the log holds this many times more records than
+//	targets, but never bother for small logs
+#define COMPACT_RATIO 3
+#define COMPACT_MIN_RECORDS 1024
+
+typedef struct record {
+	uint32_t target_len;     // Length of the target following the record
+	uint32_t reserved;       // Padding, always 0
+	uint64_t cmd_hash;       // Hash of the command line used
+	int64_t mtime_sec;       // Time of last modification of the output
+	int64_t mtime_nsec;
+	uint64_t duration_ns;    // Run time of the command in nanoseconds
+} record;
+
+typedef struct entry {
+	char *target;            // Name of the target, NULL if empty
+	logentry data;           // The latest logged data
+} entry;
+
+typedef struct buildlog {
+	char *path;              // Path of the log file
+	int fd;                  // Descriptor the log is appended through
+	entry *entries;          // Open-addressing hash table of targets
+	size_t size;             // Size of the table, a power of two
+	size_t used;             // Amount of occupied slots
+	size_t n_records;        // Amount of records in the file
+	int read_only;           // Set if the file is never written
+} buildlog;
+
+// * Internal functions
+
+/**
+ * Finds the slot for a target. The slot either holds the entry
+ * for that target or is empty.
+ *
+ * @param entries	The hash table to search
+ * @param size		The size of the table
+ * @param target	The target to look for
+ *
+ * @return			A pointer to the slot
+ */
+static entry *find_slot(entry *entries, size_t size, const char *target)
+{
+	size_t i = hash_string(target) & (size - 1);
+
+	while (entries[i].target != NULL && strcmp(entries[i].target, target) != 0)
+		i = (i + 1) & (size - 1);
+
+	return &entries[i];
+}
+
+/**
+ * Stores the data of a target in memory, replacing any older
+ * data of the same target.
+ *
+ * @param log		The build log
+ * @param target	The name of the target
+ * @param len		The length of the name
+ * @param data		The data to store
+ *
+ * @return			0 on success, else 1.
+ */
+static int store_entry(buildlog *log, const char *target, size_t len,
+	const logentry *data)
+{
+	// Keep the table at most half full
+	if (2 * (log->used + 1) > log->size)
+	{
+		size_t new_size = log->size == 0 ? MIN_TABLE_SIZE : log->size * 2;
+		entry *new_entries = calloc(new_size, sizeof(*new_entries));
+
+		if (new_entries == NULL)
+			return 1;
+
+		for (size_t i = 0; i < log->size; i++)
+		{
+			if (log->entries[i].target != NULL)
+				*find_slot(new_entries, new_size, log->entries[i].target) = log->entries[i];
+		}
+
+		free(log->entries);
+		log->entries = new_entries;
+		log->size = new_size;
+	}
+
+	char *name = strndup(target, len);
+	if (name == NULL)
+		return 1;
+
+	entry *slot = find_slot(log->entries, log->size, name);
+
+	if (slot->target == NULL)
+	{
+		slot->target = name;
+		log->used++;
+	}
+	else
+		free(name);
+
+	slot->data = *data;
+
+	return 0;
+}
+
+/**
+ * Loads all records of the log file in a single pass over a
+ * memory mapping of it. Loading stops at the first truncated
+ * record, e.g. one left behind by an interrupted run, which is
+ * then cut off.
+ *
+ * @param log		The build log
+ * @param fd		Descriptor of the opened log file
+ *
+ * @return			0 if the file is a valid log, else 1.
+ */
+static int load_records(buildlog *log, int fd)
+{
+	struct stat fileinfo;
+	if (fstat(fd, &fileinfo) == -1 || fileinfo.st_size < LOG_MAGIC_LEN)
+		return 1;
+
+	size_t len = fileinfo.st_size;
+	const char *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (data == MAP_FAILED)
+		return 1;
+
+	if (memcmp(data, LOG_MAGIC, LOG_MAGIC_LEN) != 0)
+	{
+		munmap((void *)data, len);
+		return 1;
+	}
+
+	size_t pos = LOG_MAGIC_LEN;
+	while (len - pos >= sizeof(record))
+	{
+		record rec;
+		memcpy(&rec, data + pos, sizeof(rec));
+
+		if (rec.target_len == 0 || len - pos - sizeof(rec) < rec.target_len)
+			break;
+
+		logentry entry = {
+			.cmd_hash = rec.cmd_hash,
+			.mtime = { rec.mtime_sec, rec.mtime_nsec },
+			.duration_ns = rec.duration_ns
+		};
+
+		if (store_entry(log, data + pos + sizeof(rec), rec.target_len, &entry) != 0)
+			break;
+
+		pos += sizeof(rec) + rec.target_len;
+		log->n_records++;
+	}
+
+	munmap((void *)data, len);
+
+	// Drop a truncated record, so new records are appended right
+	//	after the last complete one
+	if (pos < len && !log->read_only && ftruncate(fd, pos) == -1)
+		return 1;
+
+	return 0;
+}
+
+/**
+ * Writes one record to a log file.
+ *
+ * @param fd		Descriptor of the log file
+ * @param target	The name of the target
+ * @param data		The data of the record
+ *
+ * @return			0 on success, else 1.
+ */
+static int write_record(int fd, const char *target, const logentry *data)
+{
+	size_t target_len = strlen(target);
+	size_t len = sizeof(record) + target_len;
+	char *buf = malloc(len);
+
+	if (buf == NULL)
+		return 1;
+
+	record rec = {
+		.target_len = target_len,
+		.cmd_hash = data->cmd_hash,
+		.mtime_sec = data->mtime.tv_sec,
+		.mtime_nsec = data->mtime.tv_nsec,
+		.duration_ns = data->duration_ns
+	};
+
+	// Write the record with a single call so that it is never
+	//	interleaved with records appended by other processes
+	memcpy(buf, &rec, sizeof(rec));
+	memcpy(buf + sizeof(rec), target, target_len);
+
+	int result = write(fd, buf, len) == (ssize_t)len ? 0 : 1;
+	free(buf);
+
+	return result;
+}
+
+/**
+ * Rewrites the log file with only the latest record of every
+ * target.
+ *
+ * @param log		The build log
+ */
+static void compact(buildlog *log)
+{
+	size_t tmp_len = strlen(log->path) + sizeof(".tmp");
+	char *tmp_path = malloc(tmp_len);
+
+	if (tmp_path == NULL)
+		return;
+
+	snprintf(tmp_path, tmp_len, "%s.tmp", log->path);
+
+	int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	int failed = fd == -1 || write(fd, LOG_MAGIC, LOG_MAGIC_LEN) != LOG_MAGIC_LEN;
+
+	for (size_t i = 0; i < log->size && !failed; i++)
+	{
+		if (log->entries[i].target != NULL)
+			failed = write_record(fd, log->entries[i].target, &log->entries[i].data);
+	}
+
+	if (fd != -1 && close(fd) != 0)
+		failed = 1;
+
+	if (failed || rename(tmp_path, log->path) != 0)
+		unlink(tmp_path);
+
+	free(tmp_path);
+}
+
+// * Visible functions
+
+buildlog *buildlog_open(const char *path, int read_only)
+{
+	buildlog *log = calloc(1, sizeof(*log));
+
+	if (log == NULL || (log->path = strdup(path)) == NULL)
+	{
+		perror("Allocation failed");
+		free(log);
+		return NULL;
+	}
+
+	log->read_only = read_only;
+
+	// A log that is only read is left as it is, and a missing one
+	//	is the same as an empty one
+	if (read_only)
+	{
+		log->fd = open(path, O_RDONLY | O_CLOEXEC);
+
+		if (log->fd == -1 && errno != ENOENT)
+		{
+			perror("Couldn't open build log");
+			buildlog_close(log);
+			return NULL;
+		}
+
+		if (log->fd != -1)
+			load_records(log, log->fd);
+
+		return log;
+	}
+
+	log->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if (log->fd == -1)
+	{
+		perror("Couldn't open build log");
+		buildlog_close(log);
+		return NULL;
+	}
+
+	// Start over if the file is new or not a valid log
+	if (load_records(log, log->fd) != 0)
+	{
+		if (ftruncate(log->fd, 0) == -1
+			|| write(log->fd, LOG_MAGIC, LOG_MAGIC_LEN) != LOG_MAGIC_LEN)
+		{
+			perror("Couldn't write build log");
+			buildlog_close(log);
+			return NULL;
+		}
+	}
+
+	return log;
+}
+
+int buildlog_lookup(buildlog *log, const char *target, logentry *entry)
+{
+	if (log->size == 0)
+		return 0;
+
+	struct entry *slot = find_slot(log->entries, log->size, target);
+
+	if (slot->target == NULL)
+		return 0;
+
+	*entry = slot->data;
+
+	return 1;
+}
+
+void buildlog_record(buildlog *log, const char *target, const logentry *entry)
+{
+	if (!log->read_only && write_record(log->fd, target, entry) == 0)
+		log->n_records++;
+
+	store_entry(log, target, strlen(target), entry);
+}
+
+uint64_t hash_command(char **cmd)
+{
+	uint64_t hash = 0;
+
+	// Include the terminating NULL character, so that moving
+	//	text between arguments changes the hash
+	int i = -1;
+	while (cmd[++i] != NULL)
+		hash = hash_bytes(cmd[i], strlen(cmd[i]) + 1, hash);
+
+	return hash;
+}
+
+void buildlog_close(buildlog *log)
+{
+	if (log->fd != -1)
+	{
+		if (!log->read_only && log->n_records >= COMPACT_MIN_RECORDS
+			&& log->n_records > COMPACT_RATIO * log->used)
+			compact(log);
+
+		close(log->fd);
+	}
+
+	for (size_t i = 0; i < log->size; i++)
+		free(log->entries[i].target);
+
+	free(log->entries);
+	free(log->path);
+	free(log);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+ * The build log records every command run by the 'mmake'
+ * program, similar to the .ninja_log of ninja. For every
+ * built target it stores a hash of the command line, the
+ * time of last modification of the output and how long the
+ * command took to run. Targets found up to date are logged
+ * too, with a run time of 0.
+ *
+ * The log is an append-only binary file next to the
+ * makefile. It is memory-mapped and loaded in a single
+ * pass when opened, and is compacted when most of its
+ * records have been superseded by newer ones.
+ *
+ * @file buildlog.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef struct buildlog buildlog;
+
+typedef struct logentry {
+	uint64_t cmd_hash;       // Hash of the command line used
+	struct timespec mtime;   // Time of last modification of the output
+	uint64_t duration_ns;    // Run time of the command in nanoseconds
+} logentry;
+
+/**
+ * Opens a build log, loading its latest entry for every
+ * target. A missing or broken log file is started over,
+ * unless the log is only read, e.g. with -n.
+ *
+ * @param path		The path of the log file
+ * @param read_only	Set to never create or write the file
+ *
+ * @return			A pointer to the build log, or NULL on error.
+ */
+buildlog *buildlog_open(const char *path, int read_only);
+
+/**
+ * Gets the latest entry logged for a target.
+ *
+ * @param log		The build log
+ * @param target	The name of the target
+ * @param entry		Set to the latest entry of the target
+ *
+ * @return			1 if the target has been logged, else 0.
+ */
+int buildlog_lookup(buildlog *log, const char *target, logentry *entry);
+
+/**
+ * Appends an entry for a target to the log.
+ *
+ * @param log		The build log
+ * @param target	The name of the target
+ * @param entry		The entry to append
+ */
+void buildlog_record(buildlog *log, const char *target, const logentry *entry);
+
+/**
+ * Hashes a command, given as a NULL-terminated list of
+ * arguments, for comparison with logged entries.
+ *
+ * @param cmd		The command
+ *
+ * @return			The hash of the command
+ */
+uint64_t hash_command(char **cmd);
+
+/**
+ * Closes a build log, compacting the file first if most of
+ * its records are outdated, and frees all memory used by it.
+ *
+ * @param log		The build log
+ */
+void buildlog_close(buildlog *log);
@@ -0,0 +1,454 @@
+/**
+ * The result cache keeps copies of built targets in a
+ * directory, keyed by everything that went into building
+ * them: the command, the target's name and the contents of
+ * its prerequisites. When a target would be built with the
+ * same inputs again, e.g. in another worktree, its file is
+ * restored from the cache instead of running the command.
+ *
+ * Every entry is a file named after its key, in one of 256
+ * subdirectories named after the key's first byte. Entries
+ * are written to a temporary file in the same subdirectory
+ * and renamed into place, and targets are restored the same
+ * way, so neither is ever seen half written, even by other
+ * 'mmake' processes using the cache at the same time.
+ *
+ * Files are cloned with FICLONE where the file system shares
+ * blocks between files, else copied in the kernel. Targets
+ * are never hard linked to entries, since a command that
+ * rewrites its target in place would then change the entry.
+ *
+ * The time of last modification of an entry is updated when
+ * it is used, so trimming the cache removes the entries that
+ * were used least recently.
+ *
+ * @file cache.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "hash.h"
+#include "stats.h"
+
+#define KEY_LOW_SEED 0x9e3779b97f4a7c15ULL
+#define KEY_NAME_LEN 32
+#define TEMP_ENTRY ".tmp-XXXXXX"
+#define TEMP_TARGET ".mmake-XXXXXX"
+#define COPY_CHUNK (1 << 16)
+
+// Share of the size limit the cache is trimmed down to, so
+//	that it isn't trimmed again by the next stored entry
+#define TRIM_PERCENT 90
+
+typedef struct resultcache {
+	char *dir;               // The cache directory
+	uint64_t max_bytes;      // Size limit of all entries together
+	int n_stored;            // Entries stored since the last trim
+} resultcache;
+
+typedef struct entryinfo {
+	char *path;              // Path of the entry
+	uint64_t size;           // Size of the entry in bytes
+	struct timespec used;    // Time the entry was last used
+} entryinfo;
+
+// * Internal functions
+
+/**
+ * Gets the path of an entry, or of its subdirectory.
+ *
+ * @param cache		The cache
+ * @param key		The key of the entry
+ * @param name		Set to include the name of the entry, else
+ *					only the subdirectory is included
+ *
+ * @return			The path, which must be freed, or NULL on error.
+ */
+static char *entry_path(resultcache *cache, const cachekey *key, int name)
+{
+	char key_name[KEY_NAME_LEN + 1];
+	snprintf(key_name, sizeof(key_name), "%016llx%016llx",
+		(unsigned long long)key->high, (unsigned long long)key->low);
+
+	size_t len = strlen(cache->dir) + sizeof("/xx/") + KEY_NAME_LEN;
+	char *path = malloc(len);
+
+	if (path == NULL)
+		return NULL;
+
+	if (name)
+		snprintf(path, len, "%s/%.2s/%s", cache->dir, key_name, key_name);
+	else
+		snprintf(path, len, "%s/%.2s", cache->dir, key_name);
+
+	return path;
+}
+
+/**
+ * Copies a file by reading and writing it, for when the
+ * kernel can't copy it on its own.
+ *
+ * @param src		The file to copy from, at its start
+ * @param dst		The file to copy to, at its start
+ *
+ * @return			0 on success, else 1.
+ */
+static int copy_by_hand(int src, int dst)
+{
+	char buf[COPY_CHUNK];
+	ssize_t n;
+
+	while ((n = read(src, buf, sizeof(buf))) != 0)
+	{
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return 1;
+		}
+
+		for (ssize_t done = 0; done < n; )
+		{
+			ssize_t written = write(dst, buf + done, n - done);
+
+			if (written == -1 && errno != EINTR)
+				return 1;
+
+			if (written > 0)
+				done += written;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Fills an empty file with the contents of another, sharing
+ * their blocks if the file system allows it.
+ *
+ * @param src		The file to copy from
+ * @param dst		The empty file to copy to
+ * @param size		The size of the file to copy from
+ *
+ * @return			0 on success, else 1.
+ */
+static int clone_file(int src, int dst, off_t size)
+{
+	if (ioctl(dst, FICLONE, src) == 0)
+		return 0;
+
+	off_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = copy_file_range(src, NULL, dst, NULL, size - done, 0);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		// Nothing has been copied yet if this fails on the first
+		//	call, e.g. across file systems on older kernels
+		if (n == -1 && done == 0 && (errno == EXDEV || errno == ENOSYS
+			|| errno == EINVAL || errno == EOPNOTSUPP))
+			return copy_by_hand(src, dst);
+
+		// The file may have shrunk since it was stated
+		if (n <= 0)
+			return n == 0 ? 0 : 1;
+
+		done += n;
+	}
+
+	return 0;
+}
+
+/**
+ * Replaces a file with a clone of another, by cloning it into
+ * a temporary file next to the file to replace and renaming
+ * that over it.
+ *
+ * @param src_path	The file to clone
+ * @param dst_path	The file to replace
+ * @param temp_len	Length of the part of dst_path naming its
+ *					directory, where the temporary file is made
+ * @param temp_name	Name of the temporary file, ending in XXXXXX
+ *
+ * @return			0 on success, else 1.
+ */
+static int replace_file(const char *src_path, const char *dst_path, size_t temp_len,
+	const char *temp_name)
+{
+	int src = open(src_path, O_RDONLY | O_CLOEXEC);
+	if (src == -1)
+		return 1;
+
+	struct stat info;
+	if (fstat(src, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(src);
+		return 1;
+	}
+
+	size_t len = temp_len + strlen(temp_name) + 1;
+	char *temp_path = malloc(len);
+	if (temp_path == NULL)
+	{
+		close(src);
+		return 1;
+	}
+
+	snprintf(temp_path, len, "%.*s%s", (int)temp_len, dst_path, temp_name);
+
+	int result = 1;
+	int dst = mkostemp(temp_path, O_CLOEXEC);
+
+	if (dst != -1)
+	{
+		result = clone_file(src, dst, info.st_size) != 0
+			|| fchmod(dst, info.st_mode & 07777) != 0;
+		result |= close(dst) != 0;
+
+		if (result == 0)
+			result = rename(temp_path, dst_path) != 0;
+		if (result != 0)
+			unlink(temp_path);
+	}
+
+	close(src);
+	free(temp_path);
+
+	return result;
+}
+
+/**
+ * Compares two entries by when they were last used.
+ *
+ * @param a		The first entry
+ * @param b		The second entry
+ *
+ * @return		Less than, equal to or greater than 0 if 'a' was used
+ *				before, at the same time as or after 'b'.
+ */
+static int compare_used(const void *a, const void *b)
+{
+	const struct timespec *used_a = &((const entryinfo *)a)->used;
+	const struct timespec *used_b = &((const entryinfo *)b)->used;
+
+	if (used_a->tv_sec != used_b->tv_sec)
+		return used_a->tv_sec < used_b->tv_sec ? -1 : 1;
+	if (used_a->tv_nsec != used_b->tv_nsec)
+		return used_a->tv_nsec < used_b->tv_nsec ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * Adds all entries in a subdirectory of the cache to a list.
+ *
+ * @param dir_path	The path of the subdirectory
+ * @param entries	The list, grown as needed
+ * @param n_entries	The amount of entries in the list
+ * @param capacity	The amount of entries the list has room for
+ * @param total		The total size of the entries
+ *
+ * @return			0 on success, else 1.
+ */
+static int list_entries(const char *dir_path, entryinfo **entries, size_t *n_entries,
+	size_t *capacity, uint64_t *total)
+{
+	DIR *dir = opendir(dir_path);
+	if (dir == NULL)
+		return 0;
+
+	int result = 0;
+	struct dirent *dirent;
+
+	while (result == 0 && (dirent = readdir(dir)) != NULL)
+	{
+		struct stat info;
+
+		if (fstatat(dirfd(dir), dirent->d_name, &info, AT_SYMLINK_NOFOLLOW) != 0
+			|| !S_ISREG(info.st_mode))
+			continue;
+
+		if (*n_entries == *capacity)
+		{
+			size_t new_capacity = *capacity == 0 ? 256 : *capacity * 2;
+			entryinfo *grown = realloc(*entries, new_capacity * sizeof(**entries));
+
+			if (grown == NULL)
+			{
+				result = 1;
+				break;
+			}
+
+			*entries = grown;
+			*capacity = new_capacity;
+		}
+
+		size_t len = strlen(dir_path) + strlen(dirent->d_name) + 2;
+		char *path = malloc(len);
+		if (path == NULL)
+		{
+			result = 1;
+			break;
+		}
+
+		snprintf(path, len, "%s/%s", dir_path, dirent->d_name);
+		(*entries)[(*n_entries)++] = (entryinfo){ path, info.st_size, info.st_mtim };
+		*total += info.st_size;
+	}
+
+	closedir(dir);
+
+	return result;
+}
+
+// * Visible functions
+
+resultcache *cache_open(const char *dir, uint64_t max_bytes)
+{
+	if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+		return NULL;
+
+	resultcache *cache = malloc(sizeof(*cache));
+	if (cache == NULL)
+		return NULL;
+
+	cache->dir = strdup(dir);
+	cache->max_bytes = max_bytes;
+	cache->n_stored = 0;
+
+	if (cache->dir == NULL)
+	{
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void cache_key_init(cachekey *key)
+{
+	key->high = 0;
+	key->low = KEY_LOW_SEED;
+}
+
+void cache_key_add(cachekey *key, const void *data, size_t len)
+{
+	key->high = hash_bytes(data, len, key->high);
+	key->low = hash_bytes(data, len, key->low);
+}
+
+int cache_restore(resultcache *cache, const cachekey *key, const char *target)
+{
+	char *path = entry_path(cache, key, 1);
+	if (path == NULL)
+		return 1;
+
+	// The temporary file is made next to the target, so it can
+	//	be renamed over it
+	const char *slash = strrchr(target, '/');
+	size_t dir_len = slash == NULL ? 0 : slash - target + 1;
+
+	int result = replace_file(path, target, dir_len, TEMP_TARGET);
+
+	if (result == 0)
+	{
+		// Mark the entry as recently used
+		utimensat(AT_FDCWD, path, NULL, 0);
+		stats_add(STAT_RESULT_HITS, 1);
+	}
+	else
+		stats_add(STAT_RESULT_MISSES, 1);
+
+	free(path);
+
+	return result;
+}
+
+void cache_store(resultcache *cache, const cachekey *key, const char *target)
+{
+	char *dir_path = entry_path(cache, key, 0);
+	char *path = entry_path(cache, key, 1);
+
+	if (dir_path != NULL && path != NULL
+		&& (mkdir(dir_path, 0777) == 0 || errno == EEXIST)
+		&& replace_file(target, path, strlen(dir_path) + 1, TEMP_ENTRY) == 0)
+	{
+		cache->n_stored++;
+		stats_add(STAT_RESULT_STORES, 1);
+	}
+
+	free(dir_path);
+	free(path);
+}
+
+void cache_trim(resultcache *cache)
+{
+	if (cache->n_stored == 0)
+		return;
+
+	cache->n_stored = 0;
+
+	entryinfo *entries = NULL;
+	size_t n_entries = 0;
+	size_t capacity = 0;
+	uint64_t total = 0;
+	int result = 0;
+
+	size_t len = strlen(cache->dir) + sizeof("/xx");
+	char *dir_path = malloc(len);
+	if (dir_path == NULL)
+		return;
+
+	for (int i = 0; result == 0 && i < 256; i++)
+	{
+		snprintf(dir_path, len, "%s/%02x", cache->dir, i);
+		result = list_entries(dir_path, &entries, &n_entries, &capacity, &total);
+	}
+
+	free(dir_path);
+
+	if (result == 0 && total > cache->max_bytes)
+	{
+		uint64_t goal = cache->max_bytes / 100 * TRIM_PERCENT;
+		qsort(entries, n_entries, sizeof(*entries), compare_used);
+
+		// Another process may have removed an entry already, which
+		//	frees its space all the same
+		for (size_t i = 0; i < n_entries && total > goal; i++)
+		{
+			if (unlink(entries[i].path) == 0)
+				stats_add(STAT_RESULT_EVICTIONS, 1);
+			total -= entries[i].size;
+		}
+	}
+
+	for (size_t i = 0; i < n_entries; i++)
+		free(entries[i].path);
+	free(entries);
+}
+
+void cache_close(resultcache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	cache_trim(cache);
+	free(cache->dir);
+	free(cache);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+/**
+ * The result cache keeps copies of built targets in a
+ * directory, keyed by everything that went into building
+ * them: the command, the target's name and the contents of
+ * its prerequisites. When a target would be built with the
+ * same inputs again, e.g. in another worktree, its file is
+ * restored from the cache instead of running the command.
+ *
+ * The cache may be shared by several 'mmake' processes at
+ * once. Entries are written to temporary files and renamed
+ * into place, so an entry is either complete or missing, and
+ * the least recently used entries are removed when the cache
+ * grows past its size limit.
+ *
+ * @file cache.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct resultcache resultcache;
+
+typedef struct cachekey {
+	uint64_t high;           // Hash of the inputs with one seed
+	uint64_t low;            // Hash of the inputs with another seed
+} cachekey;
+
+/**
+ * Opens a cache directory, creating it if it doesn't exist.
+ *
+ * @param dir		The cache directory
+ * @param max_bytes	The size the cache is trimmed to
+ *
+ * @return			The cache, or NULL on error.
+ */
+resultcache *cache_open(const char *dir, uint64_t max_bytes);
+
+/**
+ * Starts a new key.
+ *
+ * @param key		The key to reset
+ */
+void cache_key_init(cachekey *key);
+
+/**
+ * Adds an input to a key. The order inputs are added in
+ * matters.
+ *
+ * @param key		The key
+ * @param data		The input
+ * @param len		The length of the input
+ */
+void cache_key_add(cachekey *key, const void *data, size_t len);
+
+/**
+ * Restores a target from the cache. The target is replaced
+ * in one step, by a clone of the cached file where the file
+ * system supports it, else by a copy.
+ *
+ * @param cache		The cache
+ * @param key		The key of the target's inputs
+ * @param target	The path of the target
+ *
+ * @return			0 if the target was restored, 1 if it isn't
+ *					cached or couldn't be restored.
+ */
+int cache_restore(resultcache *cache, const cachekey *key, const char *target);
+
+/**
+ * Stores a built target in the cache. Targets that aren't
+ * regular files are not stored.
+ *
+ * @param cache		The cache
+ * @param key		The key of the target's inputs
+ * @param target	The path of the target
+ */
+void cache_store(resultcache *cache, const cachekey *key, const char *target);
+
+/**
+ * Removes the least recently used entries until the cache is
+ * below its size limit, if anything was stored since the
+ * last trim.
+ *
+ * @param cache		The cache
+ */
+void cache_trim(resultcache *cache);
+
+/**
+ * Trims and closes a cache.
+ *
+ * @param cache		The cache, may be NULL
+ */
+void cache_close(resultcache *cache);
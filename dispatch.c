@@ -0,0 +1,583 @@
+/**
+ * Sends jobs of the 'mmake' program to workers, see remote.h
+ * and worker.c. Every worker connection runs one job at a
+ * time, so a worker is used like a job slot, next to the
+ * local ones.
+ *
+ * The contents of an input are sent to a worker once, and
+ * after that only their hash, which the worker finds the
+ * contents it stored by. Each connection remembers the
+ * hashes it has sent in a small hash set.
+ *
+ * Replies are read without blocking, as much as has arrived,
+ * and a frame that has only partly arrived is continued on
+ * the next read. A worker that is slow to reply therefore
+ * only holds up its own job.
+ *
+ * @file dispatch.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "dispatch.h"
+#include "remote.h"
+#include "hash.h"
+#include "stats.h"
+
+#define MIN_SENT_SIZE 64
+#define CHUNK_SIZE (1 << 16)
+#define TEMP_TARGET ".mmake-XXXXXX"
+#define HEADER_LEN 8
+
+// A worker that accepts no part of a request for this long is
+//	considered lost
+#define SEND_TIMEOUT_SEC 60
+
+typedef struct worker {
+	char *address;           // Address of the worker
+	int fd;                  // Connection to the worker, or -1
+	const char *target;      // Target of the running job, or NULL
+	uint64_t *sent;          // Hashes of contents sent, 0 for empty slots
+	size_t n_sent;           // Amount of hashes in the set
+	size_t sent_size;        // Size of the set, a power of two
+	unsigned char head[HEADER_LEN]; // Header of the frame being received
+	size_t head_got;         // Amount of the header received
+	frameheader frame;       // The frame being received, once its
+	                         //	header is complete
+	size_t got;              // Amount of the frame's payload received
+	unsigned char fixed[4];  // Mode of a target file, or a wait status
+	int file_fd;             // File the target is received into, or -1
+	char *temp;              // Path of that file, or NULL
+	int file_failed;         // Set if the target couldn't be written
+} worker;
+
+// Working directory sent with every job
+static char *cwd = NULL;
+
+// * Internal functions
+
+/**
+ * Removes the file a target was being received into.
+ *
+ * @param w			The worker
+ */
+static void drop_file(worker *w)
+{
+	if (w->file_fd != -1)
+		close(w->file_fd);
+	if (w->temp != NULL)
+		unlink(w->temp);
+
+	free(w->temp);
+	w->file_fd = -1;
+	w->temp = NULL;
+}
+
+/**
+ * Disconnects from a worker, e.g. after a failed write.
+ *
+ * @param w			The worker
+ */
+static void disconnect(worker *w)
+{
+	if (w->fd != -1)
+		close(w->fd);
+
+	drop_file(w);
+	w->fd = -1;
+	w->target = NULL;
+	w->head_got = 0;
+}
+
+/**
+ * Adds a hash to the set of contents sent to a worker.
+ *
+ * @param w			The worker
+ * @param hash		The hash of the contents
+ *
+ * @return			1 if the hash was already in the set, else 0.
+ */
+static int mark_sent(worker *w, uint64_t hash)
+{
+	// 0 marks an empty slot
+	if (hash == 0)
+		hash = 1;
+
+	if (2 * (w->n_sent + 1) > w->sent_size)
+	{
+		size_t new_size = w->sent_size == 0 ? MIN_SENT_SIZE : w->sent_size * 2;
+		uint64_t *grown = calloc(new_size, sizeof(*grown));
+
+		// Without room, contents are just sent again
+		if (grown == NULL)
+			return 0;
+
+		for (size_t i = 0; i < w->sent_size; i++)
+		{
+			if (w->sent[i] == 0)
+				continue;
+
+			size_t j = w->sent[i] & (new_size - 1);
+			while (grown[j] != 0)
+				j = (j + 1) & (new_size - 1);
+			grown[j] = w->sent[i];
+		}
+
+		free(w->sent);
+		w->sent = grown;
+		w->sent_size = new_size;
+	}
+
+	size_t i = hash & (w->sent_size - 1);
+	while (w->sent[i] != 0)
+	{
+		if (w->sent[i] == hash)
+			return 1;
+		i = (i + 1) & (w->sent_size - 1);
+	}
+
+	w->sent[i] = hash;
+	w->n_sent++;
+
+	return 0;
+}
+
+/**
+ * Checks that a path can be recreated inside the scratch
+ * directory of a worker, i.e. is relative and has no '..'
+ * parts.
+ *
+ * @param path		The path
+ *
+ * @return			1 if the path can be sent, else 0.
+ */
+static int is_sendable(const char *path)
+{
+	if (path[0] == '/')
+		return 0;
+
+	for (const char *part = path; part != NULL; part = strchr(part, '/'))
+	{
+		if (*part == '/')
+			part++;
+		if (strncmp(part, "..", 2) == 0 && (part[2] == '/' || part[2] == '\0'))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Sends an input file to a worker, as a reference if its
+ * contents were sent before. Files that aren't regular files
+ * are left out.
+ *
+ * @param w			The worker
+ * @param name		The path of the file
+ *
+ * @return			0 on success, 1 if the connection failed.
+ */
+static int send_input(worker *w, const char *name)
+{
+	if (!is_sendable(name))
+		return 0;
+
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return 0;
+
+	stats_add(STAT_OPEN_CALLS, 1);
+
+	struct stat info;
+	void *contents = NULL;
+
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)
+		|| (info.st_size > 0 && (contents = mmap(NULL, info.st_size, PROT_READ,
+			MAP_PRIVATE, fd, 0)) == MAP_FAILED))
+	{
+		close(fd);
+		return 0;
+	}
+
+	uint64_t hash = hash_bytes(contents, info.st_size, 0);
+	int sent_before = mark_sent(w, hash);
+
+	size_t name_len = strlen(name);
+	unsigned char *head = malloc(16 + name_len);
+	int result = head == NULL;
+
+	if (head != NULL)
+	{
+		remote_put_u32(head, info.st_mode & 07777);
+		remote_put_u64(head + 4, hash);
+
+		if (sent_before)
+		{
+			memcpy(head + 12, name, name_len);
+			result = remote_write_frame(w->fd, FRAME_INPUT_REF, head, 12 + name_len,
+				NULL, 0);
+		}
+		else
+		{
+			remote_put_u32(head + 12, name_len);
+			memcpy(head + 16, name, name_len);
+			result = remote_write_frame(w->fd, FRAME_INPUT, head, 16 + name_len,
+				contents, info.st_size);
+		}
+	}
+
+	free(head);
+	if (contents != NULL)
+		munmap(contents, info.st_size);
+	close(fd);
+
+	return result;
+}
+
+/**
+ * Reads what has arrived from a worker, without blocking.
+ *
+ * @param w			The worker
+ * @param buf		The buffer to read into
+ * @param len		The most bytes to read
+ *
+ * @return			The amount of bytes read, 0 if nothing has
+ *					arrived, or -1 if the connection has ended.
+ */
+static ssize_t receive(worker *w, void *buf, size_t len)
+{
+	ssize_t n;
+
+	do
+		n = recv(w->fd, buf, len, MSG_DONTWAIT);
+	while (n == -1 && errno == EINTR);
+
+	if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+
+	return n > 0 ? n : -1;
+}
+
+/**
+ * Starts receiving a frame once its header is complete. The
+ * target file is received into a temporary file next to the
+ * target.
+ *
+ * @param w			The worker
+ *
+ * @return			0 on success, or 1 if the frame is invalid.
+ */
+static int begin_frame(worker *w)
+{
+	w->frame.type = remote_get_u32(w->head);
+	w->frame.len = remote_get_u32(w->head + 4);
+	w->got = 0;
+
+	if (w->frame.len > REMOTE_MAX_FRAME)
+		return 1;
+
+	switch (w->frame.type)
+	{
+		case FRAME_OUTPUT:
+		case FRAME_ERROR:
+			return 0;
+		case FRAME_STATUS:
+			return w->frame.len != sizeof(w->fixed);
+		case FRAME_FILE:
+		{
+			if (w->frame.len < sizeof(w->fixed) || w->target == NULL)
+				return 1;
+
+			const char *slash = strrchr(w->target, '/');
+			int dir_len = slash == NULL ? 0 : slash - w->target + 1;
+
+			if (asprintf(&w->temp, "%.*s%s", dir_len, w->target, TEMP_TARGET) == -1)
+				w->temp = NULL;
+			else if ((w->file_fd = mkostemp(w->temp, O_CLOEXEC)) == -1)
+			{
+				free(w->temp);
+				w->temp = NULL;
+			}
+
+			// The file is still read if it can't be written, to keep
+			//	the connection in step
+			w->file_failed = w->file_fd == -1;
+			return 0;
+		}
+		default:
+			return 1;
+	}
+}
+
+/**
+ * Handles part of the payload of the frame being received.
+ *
+ * @param w			The worker
+ * @param output	The capture of the job
+ * @param buf		The part of the payload
+ * @param len		The length of the part
+ */
+static void take_payload(worker *w, capture *output, const unsigned char *buf,
+	size_t len)
+{
+	// The mode of a target file and a status are kept whole
+	if ((w->frame.type == FRAME_FILE || w->frame.type == FRAME_STATUS)
+		&& w->got < sizeof(w->fixed))
+	{
+		size_t fixed_len = sizeof(w->fixed) - w->got < len
+			? sizeof(w->fixed) - w->got : len;
+
+		memcpy(w->fixed + w->got, buf, fixed_len);
+		buf += fixed_len;
+		len -= fixed_len;
+	}
+
+	if (w->frame.type == FRAME_OUTPUT || w->frame.type == FRAME_ERROR)
+	{
+		capture_append(output, w->frame.type == FRAME_OUTPUT ? STREAM_OUT : STREAM_ERR,
+			(const char *)buf, len);
+		stats_add(STAT_OUTPUT_BYTES, len);
+	}
+
+	while (w->frame.type == FRAME_FILE && !w->file_failed && len > 0)
+	{
+		ssize_t n = write(w->file_fd, buf, len);
+
+		if (n == -1 && errno != EINTR)
+			w->file_failed = 1;
+
+		if (n > 0)
+		{
+			buf += n;
+			len -= n;
+		}
+	}
+}
+
+/**
+ * Finishes a target file once it has been received, by
+ * replacing the target with it. A target that couldn't be
+ * written fails its job.
+ *
+ * @param w			The worker
+ */
+static void end_file(worker *w)
+{
+	if (!w->file_failed)
+		w->file_failed = fchmod(w->file_fd, remote_get_u32(w->fixed) & 07777) != 0;
+
+	if (w->file_fd != -1 && close(w->file_fd) != 0)
+		w->file_failed = 1;
+	w->file_fd = -1;
+
+	if (!w->file_failed && rename(w->temp, w->target) != 0)
+		w->file_failed = 1;
+
+	if (w->file_failed)
+	{
+		fprintf(stderr, "Couldn't write '%s' from worker '%s'\n", w->target,
+			w->address);
+		drop_file(w);
+		w->target = NULL;
+		return;
+	}
+
+	free(w->temp);
+	w->temp = NULL;
+}
+
+// * Visible functions
+
+worker **workers_connect(const char *list, size_t *n_workers)
+{
+	*n_workers = 0;
+
+	if (cwd == NULL)
+		cwd = getcwd(NULL, 0);
+
+	char *copy = strdup(list);
+	worker **workers = calloc(strlen(list) / 2 + 1, sizeof(*workers));
+
+	if (copy == NULL || workers == NULL || cwd == NULL)
+	{
+		perror("Allocation failed");
+		free(copy);
+		free(workers);
+		return NULL;
+	}
+
+	char *save = NULL;
+	for (char *address = strtok_r(copy, ",", &save); address != NULL;
+		address = strtok_r(NULL, ",", &save))
+	{
+		int fd = remote_connect(address);
+		if (fd == -1)
+		{
+			fprintf(stderr, "Couldn't connect to worker '%s': %s\n", address,
+				strerror(errno));
+			continue;
+		}
+
+		worker *w = calloc(1, sizeof(*w));
+		if (w == NULL || (w->address = strdup(address)) == NULL)
+		{
+			perror("Allocation failed");
+			free(w);
+			close(fd);
+			continue;
+		}
+
+		struct timeval timeout = { .tv_sec = SEND_TIMEOUT_SEC };
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		w->fd = fd;
+		w->file_fd = -1;
+		workers[(*n_workers)++] = w;
+	}
+
+	free(copy);
+
+	if (*n_workers == 0)
+	{
+		free(workers);
+		return NULL;
+	}
+
+	return workers;
+}
+
+const char *worker_address(worker *w)
+{
+	return w->address;
+}
+
+int worker_alive(worker *w)
+{
+	return w->fd != -1;
+}
+
+int worker_fd(worker *w)
+{
+	return w->fd;
+}
+
+int worker_send(worker *w, node *target)
+{
+	char **cmd = rule_cmd(target->ruleptr);
+	int result = 0;
+
+	for (int i = 0; result == 0 && cmd[i] != NULL; i++)
+		result = remote_write_frame(w->fd, FRAME_ARG, cmd[i], strlen(cmd[i]), NULL, 0);
+
+	if (result == 0)
+		result = remote_write_frame(w->fd, FRAME_CWD, cwd, strlen(cwd), NULL, 0);
+
+	for (size_t i = 0; result == 0 && i < target->n_prereqs; i++)
+		result = send_input(w, target->prereqs[i]->name);
+
+	if (result == 0 && is_sendable(target->name))
+		result = remote_write_frame(w->fd, FRAME_TARGET, target->name,
+			strlen(target->name), NULL, 0);
+
+	if (result == 0)
+		result = remote_write_frame(w->fd, FRAME_RUN, NULL, 0, NULL, 0);
+
+	if (result != 0)
+	{
+		disconnect(w);
+		return 1;
+	}
+
+	w->target = target->name;
+
+	return 0;
+}
+
+int worker_read(worker *w, capture *output, int *status)
+{
+	unsigned char buf[CHUNK_SIZE];
+	ssize_t n = w->fd == -1 ? -1 : 0;
+
+	while (n != -1)
+	{
+		if (w->head_got < HEADER_LEN)
+		{
+			n = receive(w, w->head + w->head_got, HEADER_LEN - w->head_got);
+			if (n <= 0)
+				break;
+
+			w->head_got += n;
+			if (w->head_got < HEADER_LEN)
+				continue;
+
+			if (begin_frame(w) != 0)
+			{
+				n = -1;
+				break;
+			}
+		}
+
+		size_t left = w->frame.len - w->got;
+		if (left > 0)
+		{
+			n = receive(w, buf, left < sizeof(buf) ? left : sizeof(buf));
+			if (n <= 0)
+				break;
+
+			take_payload(w, output, buf, n);
+			w->got += n;
+			if (w->got < w->frame.len)
+				continue;
+		}
+
+		// The frame is complete
+		w->head_got = 0;
+
+		if (w->frame.type == FRAME_FILE)
+			end_file(w);
+		else if (w->frame.type == FRAME_STATUS)
+		{
+			*status = remote_get_u32(w->fixed);
+			if (*status == 0 && w->target == NULL)
+				*status = 1 << 8;
+
+			w->target = NULL;
+			return 1;
+		}
+	}
+
+	// Nothing more has arrived yet
+	if (n == 0)
+		return 0;
+
+	disconnect(w);
+	return -1;
+}
+
+void workers_close(worker **workers, size_t n_workers)
+{
+	if (workers == NULL)
+		return;
+
+	for (size_t i = 0; i < n_workers; i++)
+	{
+		disconnect(workers[i]);
+		free(workers[i]->sent);
+		free(workers[i]->address);
+		free(workers[i]);
+	}
+
+	free(workers);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * Sends jobs of the 'mmake' program to workers, see remote.h
+ * and worker.c. Every worker connection runs one job at a
+ * time, so a worker is used like a job slot, next to the
+ * local ones. A worker listed several times gets a connection
+ * for each time it's listed.
+ *
+ * A job is sent with the files of its prerequisites, and its
+ * target file is written back when the worker replies. Only
+ * prerequisites that are regular files inside the working
+ * directory are sent, so a command that reads other files
+ * must find them on the worker.
+ *
+ * @file dispatch.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include "graph.h"
+#include "output.h"
+
+typedef struct worker worker;
+
+/**
+ * Connects to every worker in a list of addresses. Workers
+ * that can't be reached are reported and left out.
+ *
+ * @param list		The addresses, separated by commas
+ * @param n_workers	Set to the amount of connected workers
+ *
+ * @return			The connected workers, which must be closed
+ *					with workers_close, or NULL if none.
+ */
+worker **workers_connect(const char *list, size_t *n_workers);
+
+/**
+ * Gets the address of a worker.
+ *
+ * @param w			The worker
+ *
+ * @return			The address
+ */
+const char *worker_address(worker *w);
+
+/**
+ * Checks if a worker is still connected.
+ *
+ * @param w			The worker
+ *
+ * @return			1 if it's connected, else 0.
+ */
+int worker_alive(worker *w);
+
+/**
+ * Gets the connection to wait for a reply on.
+ *
+ * @param w			The worker
+ *
+ * @return			The descriptor, or -1 if not connected.
+ */
+int worker_fd(worker *w);
+
+/**
+ * Sends the job of a node to a worker. On error the worker is
+ * disconnected.
+ *
+ * @param w			The worker
+ * @param target	The node to build
+ *
+ * @return			0 on success, else 1.
+ */
+int worker_send(worker *w, node *target);
+
+/**
+ * Reads what has arrived of a worker's reply, without
+ * blocking. Output is added to the capture of the job, and
+ * the target file is replaced once it has been received. On
+ * error the worker is disconnected.
+ *
+ * @param w			The worker
+ * @param output	The capture of the job
+ * @param status	Set to the wait status of the command once
+ *					the reply has ended
+ *
+ * @return			1 once the reply has ended, 0 if more is to
+ *					come, or -1 if the connection failed.
+ */
+int worker_read(worker *w, capture *output, int *status);
+
+/**
+ * Closes all worker connections.
+ *
+ * @param workers	The workers, may be NULL
+ * @param n_workers	The amount of workers
+ */
+void workers_close(worker **workers, size_t n_workers);
@@ -2,36 +2,247 @@
  * Handles all neccessary file operations for the 
  * 'mmake' program.
  *
+ * File information is cached for the whole run, so every
+ * path costs at most one stat() call no matter how often it
+ * is asked for. The cache is keyed by an interned copy of
+ * the path and entries must be invalidated when a file is
+ * changed by the program, e.g. after building a target.
+ *
  * @file file_handler.c
  * @author c24nen
  * @date 25.10.01
  */
 
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "file_handler.h"
+#include "hash.h"
+#include "stats.h"
 
-int file_exists(const char *filename)
+#define MIN_CACHE_SIZE 64
+
+typedef struct fileinfo {
+	char *path;              // Interned path, NULL for an empty slot
+	int valid;               // Set if the information below is current
+	int exists;              // Set if the file exists
+	struct timespec mtime;   // Time of last modification
+	off_t size;              // Size of the file in bytes
+} fileinfo;
+
+static struct {
+	fileinfo *entries;       // Open-addressing hash table of paths
+	size_t size;             // Size of the table, a power of two
+	size_t used;             // Amount of occupied slots
+} cache;
+
+// * Internal functions
+
+/**
+ * Finds the cache slot for a path. The slot either holds the
+ * entry for that path or is empty.
+ *
+ * @param entries	The hash table to search
+ * @param size		The size of the table
+ * @param path		The path to look for
+ *
+ * @return		A pointer to the slot
+ */
+static fileinfo *find_slot(fileinfo *entries, size_t size, const char *path)
 {
-	FILE *fptr = fopen(filename, "r");
+	size_t i = hash_string(path) & (size - 1);
 
-	if (fptr == NULL)
-		return 0;
+	while (entries[i].path != NULL && strcmp(entries[i].path, path) != 0)
+		i = (i + 1) & (size - 1);
+
+	return &entries[i];
+}
+
+/**
+ * Doubles the size of the cache, or creates it if it does
+ * not exist yet.
+ *
+ * @return		0 on success, else 1.
+ */
+static int grow_cache(void)
+{
+	size_t new_size = cache.size == 0 ? MIN_CACHE_SIZE : cache.size * 2;
+	fileinfo *new_entries = calloc(new_size, sizeof(*new_entries));
+
+	if (new_entries == NULL)
+		return 1;
+
+	for (size_t i = 0; i < cache.size; i++)
+	{
+		if (cache.entries[i].path != NULL)
+			*find_slot(new_entries, new_size, cache.entries[i].path) = cache.entries[i];
+	}
 
-	fclose(fptr);
+	free(cache.entries);
+	cache.entries = new_entries;
+	cache.size = new_size;
 
-	return 1;
+	return 0;
 }
 
-struct timespec get_last_mod_time(const char *filename)
+/**
+ * Gets the cache entry for a path, creating an empty entry if
+ * the path has not been seen before. If the entry can not be
+ * created, 'fallback' is returned instead.
+ *
+ * @param filename	The name of the file
+ * @param fallback	Entry to use if caching fails
+ *
+ * @return		A pointer to the file information
+ */
+static fileinfo *get_entry(const char *filename, fileinfo *fallback)
 {
-	if (!file_exists(filename))
-		return (struct timespec){0, 0};
+	// Keep the table at most half full
+	if (2 * (cache.used + 1) > cache.size && grow_cache() != 0)
+		return fallback;
 
-	struct stat fileinfo;
-	if (stat(filename, &fileinfo) == -1)
+	fileinfo *info = find_slot(cache.entries, cache.size, filename);
+
+	if (info->path == NULL)
 	{
+		info->path = strdup(filename);
+		if (info->path == NULL)
+			return fallback;
+
+		cache.used++;
+	}
+
+	return info;
+}
+
+/**
+ * Fills in file information from the result of a stat call.
+ *
+ * @param info		The file information to fill in
+ * @param error		0 if the call succeeded, else the errno value
+ * @param mtime		The time of last modification of the file
+ * @param size		The size of the file
+ */
+static void fill_info(fileinfo *info, int error, struct timespec mtime, off_t size)
+{
+	info->exists = error == 0;
+	info->mtime = error == 0 ? mtime : (struct timespec){0, 0};
+	info->size = error == 0 ? size : 0;
+
+	if (error != 0 && error != ENOENT && error != ENOTDIR)
+	{
+		errno = error;
 		perror("Stat failed");
-		return (struct timespec){-1, -1};
+		info->mtime = (struct timespec){-1, -1};
+	}
+
+	info->valid = 1;
+}
+
+/**
+ * Gets the cached information about a file, calling stat()
+ * once if the file has not been looked at before. If the
+ * information can not be cached, 'fallback' is filled in
+ * and returned instead.
+ *
+ * @param filename	The name of the file
+ * @param fallback	Information to fill in if caching fails
+ * @param stat_calls	Set to the amount of stat() calls made
+ *
+ * @return		A pointer to the file information
+ */
+static fileinfo *lookup(const char *filename, fileinfo *fallback, int *stat_calls)
+{
+	fileinfo *info = get_entry(filename, fallback);
+
+	*stat_calls = 0;
+	if (info->valid)
+	{
+		stats_add(STAT_CACHE_HITS, 1);
+		return info;
 	}
-	return fileinfo.st_mtim;
+
+	struct stat fileinfo;
+	*stat_calls = 1;
+	stats_add(STAT_STAT_CALLS, 1);
+
+	if (stat(filename, &fileinfo) == -1)
+		fill_info(info, errno, (struct timespec){0, 0}, 0);
+	else
+		fill_info(info, 0, fileinfo.st_mtim, fileinfo.st_size);
+
+	return info;
+}
+
+// * Visible functions
+
+int file_exists(const char *filename)
+{
+	fileinfo fallback = { 0 };
+	int stat_calls = 0;
+	fileinfo *info = lookup(filename, &fallback, &stat_calls);
+
+	// An uncached check opens the file, and closes it if it exists
+	stats_add(STAT_SAVED_SYSCALLS, (info->exists ? 2 : 1) - stat_calls);
+
+	return info->exists;
+}
+
+struct timespec get_last_mod_time(const char *filename)
+{
+	fileinfo fallback = { 0 };
+	int stat_calls = 0;
+	fileinfo *info = lookup(filename, &fallback, &stat_calls);
+
+	// An uncached lookup checks if the file exists, then stats it
+	stats_add(STAT_SAVED_SYSCALLS, (info->exists ? 3 : 1) - stat_calls);
+
+	return info->mtime;
+}
+
+int is_file_info_cached(const char *filename)
+{
+	if (cache.size == 0)
+		return 0;
+
+	fileinfo *info = find_slot(cache.entries, cache.size, filename);
+
+	return info->path != NULL && info->valid;
+}
+
+off_t get_file_size(const char *filename)
+{
+	fileinfo fallback = { 0 };
+	int stat_calls = 0;
+
+	return lookup(filename, &fallback, &stat_calls)->size;
 }
 
+void store_file_info(const char *filename, int error, struct timespec mtime, off_t size)
+{
+	fileinfo fallback = { 0 };
+	fill_info(get_entry(filename, &fallback), error, mtime, size);
+}
+
+void invalidate_file_info(const char *filename)
+{
+	if (cache.size == 0)
+		return;
+
+	fileinfo *info = find_slot(cache.entries, cache.size, filename);
+
+	if (info->path != NULL)
+		info->valid = 0;
+}
+
+void free_file_cache(void)
+{
+	for (size_t i = 0; i < cache.size; i++)
+		free(cache.entries[i].path);
+
+	free(cache.entries);
+	cache.entries = NULL;
+	cache.size = 0;
+	cache.used = 0;
+}
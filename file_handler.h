@@ -4,6 +4,10 @@
  * Handles all neccessary file operations for the 
  * 'mmake' program.
  *
+ * File information is cached for the whole run, so every
+ * path costs at most one stat() call no matter how often it
+ * is asked for.
+ *
  * @file file_handler.h
  * @author c24nen
  * @date 25.10.01
@@ -23,6 +27,16 @@
  */
 struct timespec get_last_mod_time(const char *filename);
 
+/**
+ * Gets the size of a file.
+ *
+ * @param filename	The name of the file
+ *
+ * @returns		The size of the file in bytes, 0 if
+ *				the file isn't found.
+ */
+off_t get_file_size(const char *filename);
+
 /**
  * Checks if a file exists of not.
  *
@@ -32,3 +46,38 @@ struct timespec get_last_mod_time(const char *filename);
  */
 int file_exists(const char *filename);
 
+/**
+ * Checks if current information about a file is cached.
+ *
+ * @param filename The name of the file
+ *
+ * @return		1 if the information is cached, else 0.
+ */
+int is_file_info_cached(const char *filename);
+
+/**
+ * Stores information about a file that was stated elsewhere,
+ * e.g. by a batched prefetch, in the cache.
+ *
+ * @param filename	The name of the file
+ * @param error		0 if stating the file succeeded, else the
+ *					errno value of the failed call
+ * @param mtime		The time of last modification of the file
+ * @param size		The size of the file in bytes
+ */
+void store_file_info(const char *filename, int error, struct timespec mtime, off_t size);
+
+/**
+ * Drops the cached information about a file, so that it is
+ * read again on the next lookup. Must be called whenever a
+ * file may have been changed, e.g. after running the command
+ * that builds it.
+ *
+ * @param filename The name of the file
+ */
+void invalidate_file_info(const char *filename);
+
+/**
+ * Frees all memory used by the file information cache.
+ */
+void free_file_cache(void);
@@ -0,0 +1,215 @@
+/**
+ * The graph module links the rules of a parsed makefile
+ * into a dependency graph. Every target and every
+ * prerequisite becomes exactly one node, and the edges
+ * are stored as direct node pointers so that the graph
+ * can be traversed without any name lookups.
+ *
+ * @file graph.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include "graph.h"
+#include "hash.h"
+#include "stats.h"
+
+#define MIN_INDEX_SIZE 16
+
+typedef struct graph {
+	node *nodes;         // All nodes, rule targets first
+	size_t n_nodes;      // Amount of nodes in use
+	node **edges;        // Shared storage for all prerequisite lists
+	node **rev_edges;    // Shared storage for all dependent lists
+	node **index;        // Open-addressing hash index over node names
+	size_t index_size;   // Size of the index, a power of two
+} graph;
+
+// * Internal functions
+
+/**
+ * Finds the index slot for a name. The slot either holds
+ * the node with that name or is empty.
+ *
+ * @param dag	The dependency graph
+ * @param name	The name to look for
+ *
+ * @return		A pointer to the slot
+ */
+static node **find_slot(graph *dag, const char *name)
+{
+	size_t mask = dag->index_size - 1;
+	size_t i = hash_string(name) & mask;
+
+	while (dag->index[i] != NULL && strcmp(dag->index[i]->name, name) != 0)
+		i = (i + 1) & mask;
+
+	return &dag->index[i];
+}
+
+/**
+ * Gets the node for a name, creating a new node if the
+ * name has not been seen before.
+ *
+ * @param dag	The dependency graph
+ * @param name	The name of the node
+ *
+ * @return		A pointer to the node
+ */
+static node *intern_node(graph *dag, const char *name)
+{
+	node **slot = find_slot(dag, name);
+
+	if (*slot == NULL)
+	{
+		node *new_node = &dag->nodes[dag->n_nodes++];
+		*new_node = (node){ .name = name, .is_leaf = 1 };
+		*slot = new_node;
+	}
+
+	return *slot;
+}
+
+/**
+ * Fills in the dependents of every node by reversing the
+ * prerequisite edges of the target nodes.
+ *
+ * @param dag		The dependency graph
+ * @param n_targets	The amount of nodes with a rule, stored
+ *					first in the node array
+ */
+static void link_dependents(graph *dag, size_t n_targets)
+{
+	// Count the dependents of each node
+	for (size_t i = 0; i < n_targets; i++)
+	{
+		for (size_t j = 0; j < dag->nodes[i].n_prereqs; j++)
+			dag->nodes[i].prereqs[j]->n_dependents++;
+	}
+
+	// Give every node its slice of the shared storage
+	node **rev_edge = dag->rev_edges;
+	for (size_t i = 0; i < dag->n_nodes; i++)
+	{
+		dag->nodes[i].dependents = rev_edge;
+		rev_edge += dag->nodes[i].n_dependents;
+		dag->nodes[i].n_dependents = 0;
+	}
+
+	// Fill in the dependents
+	for (size_t i = 0; i < n_targets; i++)
+	{
+		node *target = &dag->nodes[i];
+		for (size_t j = 0; j < target->n_prereqs; j++)
+		{
+			node *prereq = target->prereqs[j];
+			prereq->dependents[prereq->n_dependents++] = target;
+		}
+	}
+}
+
+// * Visible functions
+
+graph *link_graph(makefile *mfile)
+{
+	uint64_t start = stats_clock();
+
+	// Count rules and edges to size all allocations up front
+	size_t n_rules = 0;
+	size_t n_edges = 0;
+
+	for (rule *r = makefile_first_rule(mfile); r != NULL; r = rule_next(r))
+	{
+		const char **prereqs = rule_prereq(r);
+		int i = -1;
+		while (prereqs[++i] != NULL)
+			n_edges++;
+		n_rules++;
+	}
+
+	size_t max_nodes = n_rules + n_edges;
+	size_t index_size = MIN_INDEX_SIZE;
+	while (index_size < 2 * max_nodes)
+		index_size *= 2;
+
+	graph *dag = calloc(1, sizeof(*dag));
+	if (dag == NULL)
+	{
+		perror("Allocation failed");
+		return NULL;
+	}
+
+	dag->nodes = malloc(max_nodes * sizeof(*dag->nodes));
+	dag->edges = malloc((n_edges + 1) * sizeof(*dag->edges));
+	dag->rev_edges = malloc((n_edges + 1) * sizeof(*dag->rev_edges));
+	dag->index = calloc(index_size, sizeof(*dag->index));
+	dag->index_size = index_size;
+
+	if (dag->nodes == NULL || dag->edges == NULL || dag->rev_edges == NULL
+		|| dag->index == NULL)
+	{
+		perror("Allocation failed");
+		graph_del(dag);
+		return NULL;
+	}
+
+	// Create a node for every rule target. If a target is defined
+	//	more than once, the first rule is used.
+	for (rule *r = makefile_first_rule(mfile); r != NULL; r = rule_next(r))
+	{
+		node *target = intern_node(dag, rule_target(r));
+		if (target->ruleptr == NULL)
+		{
+			target->ruleptr = r;
+			target->is_leaf = 0;
+		}
+	}
+
+	// Resolve the prerequisites of every rule into node pointers
+	size_t n_targets = dag->n_nodes;
+	node **edge = dag->edges;
+	for (size_t i = 0; i < n_targets; i++)
+	{
+		node *target = &dag->nodes[i];
+		const char **prereqs = rule_prereq(target->ruleptr);
+		target->prereqs = edge;
+
+		int j = -1;
+		while (prereqs[++j] != NULL)
+			*edge++ = intern_node(dag, prereqs[j]);
+
+		target->n_prereqs = edge - target->prereqs;
+	}
+
+	link_dependents(dag, n_targets);
+	stats_end_phase(PHASE_LINK, start);
+
+	return dag;
+}
+
+node *graph_node(graph *dag, const char *name)
+{
+	return *find_slot(dag, name);
+}
+
+size_t graph_size(graph *dag)
+{
+	return dag->n_nodes;
+}
+
+node *graph_node_at(graph *dag, size_t i)
+{
+	return &dag->nodes[i];
+}
+
+void graph_del(graph *dag)
+{
+	if (dag == NULL)
+		return;
+
+	free(dag->nodes);
+	free(dag->edges);
+	free(dag->rev_edges);
+	free(dag->index);
+	free(dag);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+/**
+ * The graph module links the rules of a parsed makefile
+ * into a dependency graph. Every target and every
+ * prerequisite becomes exactly one node, and the edges
+ * are stored as direct node pointers so that the graph
+ * can be traversed without any name lookups.
+ *
+ * @file graph.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "parser.h"
+
+typedef struct graph graph;
+
+typedef enum nodestate {
+	NODE_UNVISITED,    // Not yet checked during this run
+	NODE_IN_PROGRESS,  // Prerequisites are currently being checked
+	NODE_WAITING,      // Scheduled, waiting for its prerequisites
+	NODE_RUNNING,      // The node's command is currently running
+	NODE_UP_TO_DATE,   // Checked, no rebuild was needed
+	NODE_REBUILT,      // Checked and successfully rebuilt
+	NODE_FAILED        // Checking or building the node failed
+} nodestate;
+
+typedef struct node {
+	const char *name;      // Name of the target or file
+	rule *ruleptr;         // Rule building the node, NULL for leaves
+	struct node **prereqs; // The node's prerequisite nodes
+	size_t n_prereqs;      // Amount of prerequisite nodes
+	struct node **dependents; // Nodes that have this node as prerequisite
+	size_t n_dependents;   // Amount of dependent nodes
+	int is_leaf;           // Set if the node is a file without a rule
+	nodestate state;       // Progress of the node during the current run
+	size_t n_pending;      // Prerequisites not yet finished this run
+	int has_signature;     // Set if 'signature' was computed this run
+	uint64_t signature;    // Content signature of the prerequisites
+	size_t order;          // Position of the node in the schedule
+	uint64_t estimate_ns;  // Expected run time of the node's command
+	uint64_t priority_ns;  // Expected run time of the longest path
+	                       //	from the node to the end of the build
+	uint64_t elapsed_ns;   // Run time of the command this run, or 0
+} node;
+
+/**
+ * Links all rules of a makefile into a dependency graph.
+ * Each prerequisite name is resolved once, here, into a
+ * pointer to its node, and every edge is also recorded in
+ * reverse as a dependent of the prerequisite. Names without
+ * a rule become leaf nodes, and all nodes start out as
+ * NODE_UNVISITED. The graph refers to strings owned by the
+ * makefile, which must outlive it.
+ *
+ * @param mfile		The makefile to link
+ *
+ * @return			A pointer to the graph, or NULL on error.
+ */
+graph *link_graph(makefile *mfile);
+
+/**
+ * Gets the node for a given target or file name.
+ *
+ * @param dag		The dependency graph
+ * @param name		The name of the node
+ *
+ * @return			A pointer to the node, or NULL if the
+ *					name is not part of the graph.
+ */
+node *graph_node(graph *dag, const char *name);
+
+/**
+ * Gets the amount of nodes in a dependency graph.
+ *
+ * @param dag		The dependency graph
+ *
+ * @return			The amount of nodes
+ */
+size_t graph_size(graph *dag);
+
+/**
+ * Gets a node by its position in the graph, for visiting
+ * every node. Targets with a rule come first.
+ *
+ * @param dag		The dependency graph
+ * @param i			The position, less than graph_size(dag)
+ *
+ * @return			A pointer to the node
+ */
+node *graph_node_at(graph *dag, size_t i);
+
+/**
+ * Frees all memory used by a dependency graph.
+ *
+ * @param dag		The dependency graph
+ */
+void graph_del(graph *dag);
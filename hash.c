@@ -0,0 +1,216 @@
+/**
+ * Hash functions shared by the modules of the 'mmake'
+ * program. Besides a small string hash for in-memory
+ * tables, the module implements the 64-bit xxHash
+ * algorithm (XXH64) for hashing file contents.
+ *
+ * @file hash.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "stats.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+#define XXH_PRIME1 11400714785074694791ULL
+#define XXH_PRIME2 14029467366897019727ULL
+#define XXH_PRIME3 1609587929392839161ULL
+#define XXH_PRIME4 9650029242287828579ULL
+#define XXH_PRIME5 2870177450012600261ULL
+
+// * Internal functions
+
+/**
+ * Rotates a 64-bit value to the left.
+ *
+ * @param value	The value to rotate
+ * @param bits	The amount of bits to rotate by
+ *
+ * @return		The rotated value
+ */
+static uint64_t rotl64(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Reads an unaligned 64-bit little-endian value.
+ *
+ * @param ptr	Pointer to the value
+ *
+ * @return		The value
+ */
+static uint64_t read64(const unsigned char *ptr)
+{
+	uint64_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+/**
+ * Reads an unaligned 32-bit little-endian value.
+ *
+ * @param ptr	Pointer to the value
+ *
+ * @return		The value
+ */
+static uint32_t read32(const unsigned char *ptr)
+{
+	uint32_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+/**
+ * Mixes one 64-bit lane of input into an XXH64 accumulator.
+ *
+ * @param acc	The accumulator
+ * @param input	The input lane
+ *
+ * @return		The new accumulator
+ */
+static uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME2;
+	acc = rotl64(acc, 31);
+	return acc * XXH_PRIME1;
+}
+
+/**
+ * Merges one of the four XXH64 accumulators into the hash.
+ *
+ * @param hash	The hash
+ * @param acc	The accumulator to merge
+ *
+ * @return		The new hash
+ */
+static uint64_t xxh_merge(uint64_t hash, uint64_t acc)
+{
+	hash ^= xxh_round(0, acc);
+	return hash * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// * Visible functions
+
+size_t hash_string(const char *str)
+{
+	uint64_t hash = FNV_OFFSET_BASIS;
+	while (*str != '\0')
+	{
+		hash ^= (unsigned char)*str++;
+		hash *= FNV_PRIME;
+	}
+
+	return (size_t)hash;
+}
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed)
+{
+	const unsigned char *ptr = data;
+	const unsigned char *end = ptr + len;
+	uint64_t hash;
+
+	if (len >= 32)
+	{
+		uint64_t acc1 = seed + XXH_PRIME1 + XXH_PRIME2;
+		uint64_t acc2 = seed + XXH_PRIME2;
+		uint64_t acc3 = seed;
+		uint64_t acc4 = seed - XXH_PRIME1;
+
+		// Consume the input in stripes of four lanes
+		while (end - ptr >= 32)
+		{
+			acc1 = xxh_round(acc1, read64(ptr));
+			acc2 = xxh_round(acc2, read64(ptr + 8));
+			acc3 = xxh_round(acc3, read64(ptr + 16));
+			acc4 = xxh_round(acc4, read64(ptr + 24));
+			ptr += 32;
+		}
+
+		hash = rotl64(acc1, 1) + rotl64(acc2, 7) + rotl64(acc3, 12) + rotl64(acc4, 18);
+		hash = xxh_merge(hash, acc1);
+		hash = xxh_merge(hash, acc2);
+		hash = xxh_merge(hash, acc3);
+		hash = xxh_merge(hash, acc4);
+	}
+	else
+		hash = seed + XXH_PRIME5;
+
+	hash += len;
+
+	// Consume the remaining bytes
+	while (end - ptr >= 8)
+	{
+		hash ^= xxh_round(0, read64(ptr));
+		hash = rotl64(hash, 27) * XXH_PRIME1 + XXH_PRIME4;
+		ptr += 8;
+	}
+
+	if (end - ptr >= 4)
+	{
+		hash ^= (uint64_t)read32(ptr) * XXH_PRIME1;
+		hash = rotl64(hash, 23) * XXH_PRIME2 + XXH_PRIME3;
+		ptr += 4;
+	}
+
+	while (ptr < end)
+	{
+		hash ^= *ptr++ * XXH_PRIME5;
+		hash = rotl64(hash, 11) * XXH_PRIME1;
+	}
+
+	// Final avalanche
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
+
+int hash_file(const char *filename, uint64_t *hash)
+{
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	stats_add(STAT_OPEN_CALLS, 1);
+
+	if (fd == -1)
+		return 1;
+
+	struct stat fileinfo;
+	if (fstat(fd, &fileinfo) == -1 || !S_ISREG(fileinfo.st_mode))
+	{
+		close(fd);
+		return 1;
+	}
+
+	size_t len = fileinfo.st_size;
+
+	// Empty files can not be mapped
+	if (len == 0)
+	{
+		close(fd);
+		*hash = hash_bytes(NULL, 0, 0);
+		return 0;
+	}
+
+	void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return 1;
+
+	*hash = hash_bytes(data, len, 0);
+	munmap(data, len);
+
+	return 0;
+}
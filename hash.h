@@ -0,0 +1,48 @@
+#pragma once
+
+/**
+ * Hash functions shared by the modules of the 'mmake'
+ * program. Besides a small string hash for in-memory
+ * tables, the module implements the 64-bit xxHash
+ * algorithm (XXH64) for hashing file contents.
+ *
+ * @file hash.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Hashes a NULL-terminated string using 64-bit FNV-1a.
+ * Meant for in-memory hash tables keyed by names.
+ *
+ * @param str	The string to hash
+ *
+ * @return		The hash value
+ */
+size_t hash_string(const char *str);
+
+/**
+ * Hashes a block of memory using 64-bit xxHash (XXH64). The
+ * seed can be used to chain several blocks into one hash.
+ *
+ * @param data	The data to hash
+ * @param len	The length of the data in bytes
+ * @param seed	The seed of the hash
+ *
+ * @return		The hash value
+ */
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+
+/**
+ * Hashes the contents of a file using hash_bytes with a seed
+ * of 0.
+ *
+ * @param filename	The name of the file
+ * @param hash		Set to the hash of the file's contents
+ *
+ * @return		0 on success, else 1.
+ */
+int hash_file(const char *filename, uint64_t *hash);
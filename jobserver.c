@@ -0,0 +1,303 @@
+/**
+ * Implements the GNU make jobserver protocol. The jobserver
+ * is a pipe or named fifo holding one byte per job token. A
+ * process may always run one job without a token, and must
+ * read a token from the jobserver before starting any more
+ * jobs in parallel. Tokens are written back once the jobs
+ * exit, which keeps the total amount of jobs across nested
+ * make and mmake processes within one global limit.
+ *
+ * @file jobserver.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "jobserver.h"
+
+// The token count as a client is limited by the server, so the
+//	amount of job slots only needs to be an upper bound.
+#define MAX_CLIENT_SLOTS 256
+#define MAX_PATH_LEN 4096
+#define PROC_FD_FMT "/proc/self/fd/%d"
+// Room for the flags added to MAKEFLAGS by a server
+#define MAX_FLAGS_LEN 64
+
+static struct {
+	int read_fd;      // Non-blocking descriptor to take tokens from
+	int write_fd;     // Descriptor to return tokens to
+	int pipe_fd;      // Read end of the pipe if read_fd was reopened
+	                  //	from it, else -1
+	int is_server;    // Set if this process created the jobserver
+	int in_use;       // Set if a jobserver is in use
+	char *makeflags;  // MAKEFLAGS before the server was exported,
+	                  //	or NULL if it wasn't set
+} jobserver = { -1, -1, -1, 0, 0, NULL };
+
+// * Internal functions
+
+/**
+ * Checks if a file descriptor is open.
+ *
+ * @param fd	The file descriptor
+ *
+ * @return		1 if the descriptor is open, else 0.
+ */
+static int fd_is_open(int fd)
+{
+	return fd >= 0 && fcntl(fd, F_GETFD) != -1;
+}
+
+/**
+ * Joins a jobserver given as a named fifo.
+ *
+ * @param path	The path of the fifo
+ *
+ * @return		0 on success, else 1.
+ */
+static int join_fifo(const char *path)
+{
+	jobserver.read_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	jobserver.write_fd = open(path, O_WRONLY | O_CLOEXEC);
+
+	if (jobserver.read_fd == -1 || jobserver.write_fd == -1)
+	{
+		if (jobserver.read_fd != -1)
+			close(jobserver.read_fd);
+		if (jobserver.write_fd != -1)
+			close(jobserver.write_fd);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Joins a jobserver given as an inherited pipe. The read end
+ * is reopened through /proc to get a private non-blocking
+ * descriptor, since setting O_NONBLOCK on the inherited one
+ * would affect every process sharing it.
+ *
+ * @param read_fd	The inherited read end of the pipe
+ * @param write_fd	The inherited write end of the pipe
+ *
+ * @return			0 on success, else 1.
+ */
+static int join_pipe(int read_fd, int write_fd)
+{
+	// The parent may not have passed the pipe on to us
+	if (!fd_is_open(read_fd) || !fd_is_open(write_fd))
+		return 1;
+
+	char path[MAX_PATH_LEN];
+	snprintf(path, sizeof(path), PROC_FD_FMT, read_fd);
+
+	jobserver.read_fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+
+	// Fall back to polling the shared descriptor
+	if (jobserver.read_fd == -1)
+		jobserver.read_fd = read_fd;
+	else
+		jobserver.pipe_fd = read_fd;
+
+	jobserver.write_fd = write_fd;
+
+	return 0;
+}
+
+/**
+ * Joins the jobserver described by the MAKEFLAGS environment
+ * variable, if any. Both the pipe form 'R,W' and the fifo form
+ * 'fifo:PATH' of --jobserver-auth are understood, as well as
+ * the older --jobserver-fds option.
+ *
+ * @return		0 if a jobserver was joined, else 1.
+ */
+static int join_from_env(void)
+{
+	const char *makeflags = getenv("MAKEFLAGS");
+	if (makeflags == NULL)
+		return 1;
+
+	const char *options[] = { "--jobserver-auth=", "--jobserver-fds=" };
+	const char *auth = NULL;
+
+	// The last occurrence takes precedence
+	for (size_t i = 0; i < sizeof(options) / sizeof(*options); i++)
+	{
+		const char *found = makeflags;
+		while ((found = strstr(found, options[i])) != NULL)
+		{
+			found += strlen(options[i]);
+			if (auth == NULL || found > auth)
+				auth = found;
+		}
+	}
+
+	if (auth == NULL)
+		return 1;
+
+	if (strncmp(auth, "fifo:", 5) == 0)
+	{
+		char path[MAX_PATH_LEN];
+		size_t len = strcspn(auth + 5, " ");
+		if (len >= sizeof(path))
+			return 1;
+
+		memcpy(path, auth + 5, len);
+		path[len] = '\0';
+
+		return join_fifo(path);
+	}
+
+	int read_fd = -1;
+	int write_fd = -1;
+	if (sscanf(auth, "%d,%d", &read_fd, &write_fd) != 2)
+		return 1;
+
+	return join_pipe(read_fd, write_fd);
+}
+
+/**
+ * Creates a new jobserver holding 'jobs' - 1 tokens and
+ * exports it to child processes through MAKEFLAGS. The flags
+ * are added to any MAKEFLAGS already set, and since the last
+ * --jobserver-auth is the one used, they replace an inherited
+ * jobserver.
+ *
+ * @param jobs	The total amount of parallel jobs
+ *
+ * @return		0 on success, else 1.
+ */
+static int create_server(int jobs)
+{
+	int fds[2];
+	if (pipe(fds) == -1)
+	{
+		perror("Pipe failed");
+		return 1;
+	}
+
+	for (int i = 0; i < jobs - 1; i++)
+	{
+		if (write(fds[1], "+", 1) != 1)
+		{
+			perror("Jobserver setup failed");
+			close(fds[0]);
+			close(fds[1]);
+			return 1;
+		}
+	}
+
+	const char *old_flags = getenv("MAKEFLAGS");
+
+	if (old_flags != NULL && (jobserver.makeflags = strdup(old_flags)) == NULL)
+		perror("Allocation failed");
+
+	if (old_flags == NULL)
+		old_flags = "";
+
+	size_t flags_len = strlen(old_flags) + MAX_FLAGS_LEN;
+	char *makeflags = malloc(flags_len);
+
+	if (makeflags == NULL)
+	{
+		perror("Jobserver setup failed");
+		free(jobserver.makeflags);
+		jobserver.makeflags = NULL;
+		close(fds[0]);
+		close(fds[1]);
+		return 1;
+	}
+
+	// Variables defined on the command line come last, after "--"
+	const char *variables = strncmp(old_flags, "-- ", 3) == 0
+		? old_flags : strstr(old_flags, " -- ");
+	if (variables == NULL)
+		variables = old_flags + strlen(old_flags);
+
+	snprintf(makeflags, flags_len, "%.*s -j%d --jobserver-auth=%d,%d%s%s",
+		(int)(variables - old_flags), old_flags, jobs, fds[0], fds[1],
+		variables == old_flags && *variables != '\0' ? " " : "", variables);
+	setenv("MAKEFLAGS", makeflags, 1);
+	free(makeflags);
+
+	jobserver.is_server = 1;
+
+	return join_pipe(fds[0], fds[1]);
+}
+
+// * Visible functions
+
+int jobserver_init(int jobs)
+{
+	if (jobs == 0)
+	{
+		if (join_from_env() != 0)
+			return 1;
+
+		jobserver.in_use = 1;
+		return MAX_CLIENT_SLOTS;
+	}
+
+	if (jobs > 1 && create_server(jobs) == 0)
+		jobserver.in_use = 1;
+
+	return jobs;
+}
+
+int jobserver_acquire(char *token)
+{
+	if (!jobserver.in_use)
+		return 0;
+
+	struct pollfd pfd = { .fd = jobserver.read_fd, .events = POLLIN };
+	if (poll(&pfd, 1, 0) != 1)
+		return 0;
+
+	return read(jobserver.read_fd, token, 1) == 1;
+}
+
+void jobserver_release(char token)
+{
+	if (!jobserver.in_use)
+		return;
+
+	while (write(jobserver.write_fd, &token, 1) == -1 && errno == EINTR)
+		continue;
+}
+
+int jobserver_is_client(void)
+{
+	return jobserver.in_use && !jobserver.is_server;
+}
+
+void jobserver_close(void)
+{
+	if (!jobserver.in_use)
+		return;
+
+	if (jobserver.is_server)
+	{
+		if (jobserver.makeflags != NULL)
+			setenv("MAKEFLAGS", jobserver.makeflags, 1);
+		else
+			unsetenv("MAKEFLAGS");
+	}
+
+	close(jobserver.read_fd);
+	close(jobserver.write_fd);
+	if (jobserver.pipe_fd != -1)
+		close(jobserver.pipe_fd);
+
+	free(jobserver.makeflags);
+	jobserver.makeflags = NULL;
+	jobserver.read_fd = -1;
+	jobserver.write_fd = -1;
+	jobserver.pipe_fd = -1;
+	jobserver.is_server = 0;
+	jobserver.in_use = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/**
+ * Implements the GNU make jobserver protocol. The jobserver
+ * is a pipe or named fifo holding one byte per job token. A
+ * process may always run one job without a token, and must
+ * read a token from the jobserver before starting any more
+ * jobs in parallel. Tokens are written back once the jobs
+ * exit, which keeps the total amount of jobs across nested
+ * make and mmake processes within one global limit.
+ *
+ * @file jobserver.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Sets up the jobserver for this process. If 'jobs' is 0, no
+ * job count was given, and the jobserver from the MAKEFLAGS
+ * environment variable is joined as a client if there is one.
+ * If 'jobs' is larger than 1, this process becomes the server:
+ * it creates a new jobserver holding 'jobs' - 1 tokens and
+ * exports it through MAKEFLAGS to all child processes.
+ *
+ * @param jobs		The job count given with -j, or 0 if none
+ *
+ * @return			The amount of job slots the scheduler
+ *					should use.
+ */
+int jobserver_init(int jobs);
+
+/**
+ * Tries to take a token from the jobserver without blocking.
+ * Always fails if no jobserver is in use.
+ *
+ * @param token		Set to the token that was taken
+ *
+ * @return			1 if a token was taken, else 0.
+ */
+int jobserver_acquire(char *token);
+
+/**
+ * Returns a token previously taken with jobserver_acquire.
+ *
+ * @param token		The token to return
+ */
+void jobserver_release(char token);
+
+/**
+ * Checks if this process joined the jobserver of another
+ * process, rather than creating one or using none.
+ *
+ * @return			1 if this process is a client, else 0.
+ */
+int jobserver_is_client(void);
+
+/**
+ * Closes the jobserver's descriptors. As the server, this
+ * also restores MAKEFLAGS to what it was before.
+ */
+void jobserver_close(void);
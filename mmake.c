@@ -5,14 +5,56 @@
  * The program supports the use of the optional flags
  *  -s			: Runs the program but does not print the commands ran to stdout,
  *  -B			: Force rebuiling all targets and their prerequisites,
+ *  -k			: Keep building targets that don't depend on a failed
+ *				  one, then list all failures
+ *  -n			: Prints the commands that would be run, in order,
+ *				  without running anything
+ *  -q			: Runs nothing, exits with 0 if all targets are up to
+ *				  date and 1 otherwise
  *  -f FILENAME	: Parses and builds using [FILENAME], defaults to "mmakefile"
+ *  -j JOBS		: Runs up to [JOBS] commands in parallel, defaults to 1
+ *  --hash		: Rebuilds targets only when the contents of a prerequisite
+ *				  changed, using a signature database next to the makefile
+ *  --spawn-helper	: Starts commands through a helper process forked
+ *				  before the makefile is loaded
+ *  --report		: Prints how long the build took compared with the
+ *				  critical-path lower bound
+ *  --watch		: Keeps running after the build and rebuilds the
+ *				  targets depending on any file that changes
+ *  --trace FILE	: Writes a Chrome trace-event file showing the time
+ *				  spent parsing, checking targets and running jobs
+ *  --stats		: Prints counters of the work done, e.g. files
+ *				  stated and commands run, and phase times at exit
+ *  --output-sync MODE	: Keeps the output of parallel jobs apart. With
+ *				  'completion', the default when more than one job
+ *				  may run, each job's command and output are shown
+ *				  together when it finishes. With 'makefile', they
+ *				  are shown in the order of a serial build, and
+ *				  with 'none' jobs write directly
+ *  --cache-dir DIR	: Keeps built targets in DIR, keyed by their command
+ *				  and the contents of their prerequisites, and
+ *				  restores them from there instead of rebuilding
+ *  --cache-size MB	: Size the cache directory is trimmed to, by
+ *				  removing the least recently used targets
+ *  --workers LIST	: Also sends ready jobs to the mmake-worker daemons
+ *				  at the comma-separated addresses in LIST, each
+ *				  either unix:PATH or HOST:PORT, with one job
+ *				  running on each at a time
+ *
+ * Ready targets are started in order of the longest expected time from
+ * them to the end of the build, using the run times of earlier builds.
  *
  * When running the program it is also possible to specify which targets
  * to build, if none are specified the first target found in the make file 
  * will be used.
  *
  * Usage:
- *  ./mmake [-f FILENAME] [-s] [-B] [TARGETS ...]
+ *  ./mmake [-f FILENAME] [-j JOBS] [-s] [-B] [-k] [-n] [-q] [--hash]
+ *          [--spawn-helper]
+ *          [--report] [--watch] [--trace FILE] [--stats]
+ *          [--output-sync MODE] [--cache-dir DIR] [--cache-size MB]
+ *          [--workers LIST]
+ *          [TARGETS ...]
  *
  * @file mmake.c
  * @author c24nen
@@ -22,6 +64,30 @@
 #include "program_handler.h"
 #include "builder.h"
 #include "parser.h"
+#include "graph.h"
+#include "file_handler.h"
+#include "watch.h"
+#include "spawn.h"
+#include "jobserver.h"
+#include "trace.h"
+#include "stats.h"
+
+/**
+ * Stops the spawn helper, leaves the jobserver and finishes
+ * the trace file, then prints the counters if --stats was
+ * given.
+ *
+ * @param options	Information about the program's flags
+ */
+static void close_program(optioninfo *options)
+{
+	spawn_helper_stop();
+	jobserver_close();
+	trace_close();
+
+	if (uses_flag(options, PRINT_STATS))
+		stats_print(stderr);
+}
 
 /**
  * Frees all dynamically allocated memory from relevant instances
@@ -29,11 +95,16 @@
  *
  * @param options	A pointer to information about the program's flags
  * @param mfile		A pointer to the type makefile
+ * @param dag		A pointer to the makefile's dependency graph
  * @param code		The exit code
  */
-static void free_and_exit(optioninfo **options_ptr, makefile *mfile, int code)
+static void free_and_exit(optioninfo **options_ptr, makefile *mfile, graph *dag, int code)
 {
+	close_build_records();
+	close_program(*options_ptr);
 	free_option_info(options_ptr);
+	free_file_cache();
+	graph_del(dag);
 	makefile_del(mfile);
 	exit(code);
 }
@@ -43,41 +114,59 @@ int main(int argc, char **argv)
 	// Get info about flags
 	optioninfo *options = get_option_info(argc, argv);
 	if (options == NULL)
+	{
+		// The trace file may be open before an invalid flag
+		trace_close();
 		exit(EXIT_FAILURE);
+	}
 
 	// Parse the make file
 	makefile *mfile = get_makefile(options);
 
 	if (mfile == NULL)
 	{
+		close_program(options);
 		free_option_info(&options);
 		exit(EXIT_FAILURE);
 	}
 
+	// Link the rules into a dependency graph
+	graph *dag = link_graph(mfile);
+
+	if (dag == NULL)
+		free_and_exit(&options, mfile, NULL, EXIT_FAILURE);
+
 	// Check if specific targest were specified
+	const char *default_targets[] = { makefile_default_target(mfile), NULL };
+	const char **targets = default_targets;
+
 	if (uses_flag(options, CUSTOM_TARGETS))
 	{
 		char **custom_targets = &argv[optind];
 		
 		// Validate that all targets exist in the make file
 		if (validate_targets(mfile, custom_targets) == 1)
-				free_and_exit(&options, mfile, EXIT_FAILURE);
-
-		// Check the build of all specified targets
-		int rule_index = -1;
-		while(custom_targets[++rule_index])
-		{
-			if (check_target_build(options, mfile, custom_targets[rule_index]) == 1)
-				free_and_exit(&options, mfile, EXIT_FAILURE);
-		}
+				free_and_exit(&options, mfile, dag, EXIT_FAILURE);
+
+		targets = (const char **)custom_targets;
 	}
-	else // Build default target only
+
+	// Keep rebuilding whenever a file changes
+	if (uses_flag(options, WATCH))
 	{
-		if (check_target_build(options, mfile, makefile_default_target(mfile)) == 1)
-			free_and_exit(&options, mfile, EXIT_FAILURE);
+		char **custom_targets = uses_flag(options, CUSTOM_TARGETS) ? &argv[optind] : NULL;
+
+		if (watch_targets(options, &mfile, &dag, custom_targets) == 1)
+			free_and_exit(&options, mfile, dag, EXIT_FAILURE);
+
+		free_and_exit(&options, mfile, dag, EXIT_SUCCESS);
 	}
 
+	// Check and build all targets together
+	if (build_targets(options, dag, targets) == 1)
+		free_and_exit(&options, mfile, dag, EXIT_FAILURE);
+
 	// Clean up dynamically allocated memory
-	free_and_exit(&options, mfile, EXIT_SUCCESS);
+	free_and_exit(&options, mfile, dag, EXIT_SUCCESS);
 }
 
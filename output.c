@@ -0,0 +1,375 @@
+/**
+ * Captures the output of the commands run by the 'mmake'
+ * program, so that the output of parallel jobs isn't mixed.
+ * Every job writes its standard output and error to pipes of
+ * its own, which are moved into buffers as they fill and
+ * written out in one piece once the job is done, each to the
+ * stream it was written to.
+ *
+ * A buffer is a memory file. Output is spliced from the pipe
+ * into it and sent from it with sendfile, so the kernel moves
+ * the pages and a job printing megabytes costs 'mmake' a few
+ * system calls instead of copies. Where either isn't
+ * supported, e.g. when the output is appended to a file, the
+ * output is copied instead. Buffers are truncated and kept in
+ * a pool when their job is done.
+ *
+ * @file output.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+
+#include "output.h"
+#include "stats.h"
+
+// Larger pipes wake 'mmake' less often for jobs with much output
+#define PIPE_SIZE (1 << 20)
+#define SPLICE_CHUNK (1 << 20)
+#define COPY_CHUNK (1 << 16)
+
+typedef struct stream {
+	int buf_fd;              // Memory file holding the output
+	loff_t len;              // Amount of output in the buffer
+	int pipe_fd;             // Read end of the job's pipe, or -1
+	int child_fd;            // Write end of the job's pipe, or -1
+} stream;
+
+typedef struct capture {
+	stream streams[N_STREAMS]; // Standard output and error of the job
+	struct capture *next;    // Next free buffers in the pool
+} capture;
+
+static capture *pool = NULL;
+static int splice_failed = 0;
+static char copy_buf[COPY_CHUNK];
+
+// * Internal functions
+
+/**
+ * Writes exactly the given amount of bytes to a descriptor.
+ *
+ * @param fd		The descriptor
+ * @param buf		The bytes to write
+ * @param len		The amount of bytes to write
+ *
+ * @return			0 on success, else 1.
+ */
+static int write_full(int fd, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, buf, len);
+
+		if (n == -1 && errno != EINTR)
+			return 1;
+
+		if (n > 0)
+		{
+			buf += n;
+			len -= n;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Writes bytes at the end of the buffer.
+ *
+ * @param cap		The stream
+ * @param buf		The bytes to write
+ * @param len		The amount of bytes to write
+ *
+ * @return			0 on success, else 1.
+ */
+static int buffer_write(stream *cap, const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = pwrite(cap->buf_fd, buf, len, cap->len);
+
+		if (n == -1 && errno != EINTR)
+			return 1;
+
+		if (n > 0)
+		{
+			buf += n;
+			len -= n;
+			cap->len += n;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Moves one chunk of output from the pipe into the buffer by
+ * copying it, for when splice isn't supported.
+ *
+ * @param cap		The stream
+ *
+ * @return			As read, the amount of bytes moved, 0 at the
+ *					end of the pipe or -1 on error.
+ */
+static ssize_t copy_chunk(stream *cap)
+{
+	ssize_t n = read(cap->pipe_fd, copy_buf, sizeof(copy_buf));
+
+	if (n > 0 && buffer_write(cap, copy_buf, n) != 0)
+		return -1;
+
+	return n;
+}
+
+/**
+ * Writes the buffer from an offset to a descriptor by copying
+ * it, for when sendfile isn't supported.
+ *
+ * @param cap		The stream
+ * @param out_fd	The descriptor to write to
+ * @param off		The offset to start from
+ */
+static void copy_out(stream *cap, int out_fd, off_t off)
+{
+	while (off < cap->len)
+	{
+		size_t len = cap->len - off < COPY_CHUNK ? cap->len - off : COPY_CHUNK;
+		ssize_t n = pread(cap->buf_fd, copy_buf, len, off);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n <= 0 || write_full(out_fd, copy_buf, n) != 0)
+			return;
+
+		off += n;
+	}
+}
+
+/**
+ * Moves all output available in the pipe of a stream into its
+ * buffer without blocking.
+ *
+ * @param cap		The stream
+ *
+ * @return			1 once the pipe has ended, else 0.
+ */
+static int drain_stream(stream *cap)
+{
+	while (cap->pipe_fd != -1)
+	{
+		ssize_t n = -1;
+
+		if (!splice_failed)
+		{
+			n = splice(cap->pipe_fd, NULL, cap->buf_fd, &cap->len, SPLICE_CHUNK,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+			if (n == -1 && errno == EINVAL)
+				splice_failed = 1;
+		}
+
+		if (splice_failed)
+			n = copy_chunk(cap);
+
+		if (n > 0)
+		{
+			stats_add(STAT_OUTPUT_BYTES, n);
+			continue;
+		}
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		if (n == -1 && errno == EAGAIN)
+			return 0;
+
+		// The pipe has ended, or can't be read, which ends the
+		//	capture the same way
+		close(cap->pipe_fd);
+		cap->pipe_fd = -1;
+	}
+
+	return 1;
+}
+
+/**
+ * Writes the buffer of a stream to a descriptor.
+ *
+ * @param cap		The stream
+ * @param out_fd	The descriptor to write to
+ */
+static void flush_stream(stream *cap, int out_fd)
+{
+	off_t off = 0;
+
+	while (off < cap->len)
+	{
+		ssize_t n = sendfile(out_fd, cap->buf_fd, &off, cap->len - off);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		// Fall back to copying, e.g. if the output is appended to
+		//	a file, but give up if it's gone
+		if (n == -1 && (errno == EINVAL || errno == ENOSYS))
+			copy_out(cap, out_fd, off);
+
+		if (n <= 0)
+			return;
+	}
+}
+
+// * Visible functions
+
+capture *capture_open(void)
+{
+	capture *cap = pool;
+
+	if (cap != NULL)
+		pool = cap->next;
+	else
+	{
+		cap = malloc(sizeof(*cap));
+		if (cap == NULL)
+			return NULL;
+
+		cap->streams[STREAM_OUT].buf_fd = memfd_create("mmake-output", MFD_CLOEXEC);
+		cap->streams[STREAM_ERR].buf_fd = memfd_create("mmake-error", MFD_CLOEXEC);
+
+		if (cap->streams[STREAM_OUT].buf_fd == -1 || cap->streams[STREAM_ERR].buf_fd == -1)
+		{
+			if (cap->streams[STREAM_OUT].buf_fd != -1)
+				close(cap->streams[STREAM_OUT].buf_fd);
+			if (cap->streams[STREAM_ERR].buf_fd != -1)
+				close(cap->streams[STREAM_ERR].buf_fd);
+			free(cap);
+			return NULL;
+		}
+	}
+
+	for (int i = 0; i < N_STREAMS; i++)
+	{
+		cap->streams[i].len = 0;
+		cap->streams[i].pipe_fd = -1;
+		cap->streams[i].child_fd = -1;
+	}
+	cap->next = NULL;
+
+	return cap;
+}
+
+capture *capture_start(void)
+{
+	capture *cap = capture_open();
+	if (cap == NULL)
+		return NULL;
+
+	// Both ends are closed on exec, the job gets its ends as
+	//	copies on its standard output and error
+	for (int i = 0; i < N_STREAMS; i++)
+	{
+		int fds[2];
+		if (pipe2(fds, O_CLOEXEC) == -1)
+		{
+			capture_release(cap);
+			return NULL;
+		}
+
+		cap->streams[i].pipe_fd = fds[0];
+		cap->streams[i].child_fd = fds[1];
+
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+		fcntl(fds[0], F_SETPIPE_SZ, PIPE_SIZE);
+	}
+
+	return cap;
+}
+
+int capture_child_fd(capture *cap, outstream which)
+{
+	return cap->streams[which].child_fd;
+}
+
+void capture_close_child_fd(capture *cap)
+{
+	for (int i = 0; i < N_STREAMS; i++)
+	{
+		if (cap->streams[i].child_fd != -1)
+			close(cap->streams[i].child_fd);
+		cap->streams[i].child_fd = -1;
+	}
+}
+
+int capture_poll_fd(capture *cap, outstream which)
+{
+	return cap->streams[which].pipe_fd;
+}
+
+int capture_drain(capture *cap)
+{
+	int ended = 1;
+
+	for (int i = 0; i < N_STREAMS; i++)
+		ended &= drain_stream(&cap->streams[i]);
+
+	return ended;
+}
+
+int capture_append(capture *cap, outstream which, const char *text, size_t len)
+{
+	return buffer_write(&cap->streams[which], text, len);
+}
+
+void capture_flush(capture *cap, int out_fd, int err_fd)
+{
+	flush_stream(&cap->streams[STREAM_OUT], out_fd);
+	flush_stream(&cap->streams[STREAM_ERR], err_fd);
+}
+
+void capture_release(capture *cap)
+{
+	if (cap == NULL)
+		return;
+
+	capture_close_child_fd(cap);
+
+	for (int i = 0; i < N_STREAMS; i++)
+	{
+		stream *part = &cap->streams[i];
+
+		if (part->pipe_fd != -1)
+			close(part->pipe_fd);
+
+		// Give the pages of a large output back right away
+		if (part->len > 0)
+			ftruncate(part->buf_fd, 0);
+
+		part->pipe_fd = -1;
+		part->len = 0;
+	}
+
+	cap->next = pool;
+	pool = cap;
+}
+
+void capture_pool_free(void)
+{
+	while (pool != NULL)
+	{
+		capture *next = pool->next;
+		close(pool->streams[STREAM_OUT].buf_fd);
+		close(pool->streams[STREAM_ERR].buf_fd);
+		free(pool);
+		pool = next;
+	}
+}
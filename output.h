@@ -0,0 +1,117 @@
+#pragma once
+
+/**
+ * Captures the output of the commands run by the 'mmake'
+ * program, so that the output of parallel jobs isn't mixed.
+ * Every job writes its standard output and error to pipes of
+ * its own, which are moved into buffers as they fill and
+ * written out in one piece once the job is done, each to the
+ * stream it was written to.
+ *
+ * Buffers are memory files kept in a pool, and output is
+ * moved into them with splice, so it is never copied
+ * through the 'mmake' process itself.
+ *
+ * @file output.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stddef.h>
+
+typedef struct capture capture;
+
+typedef enum outstream {
+	STREAM_OUT,        // Standard output of the job
+	STREAM_ERR,        // Standard error of the job
+	N_STREAMS
+} outstream;
+
+/**
+ * Takes a buffer from the pool, for output that is added with
+ * capture_append, e.g. output received from a worker.
+ *
+ * @return			The capture, or NULL on error.
+ */
+capture *capture_open(void);
+
+/**
+ * Takes buffers from the pool and creates the pipes a job
+ * writes its output and errors to.
+ *
+ * @return			The capture, or NULL on error.
+ */
+capture *capture_start(void);
+
+/**
+ * Gets the end of a pipe to use as the standard output or
+ * error of the job.
+ *
+ * @param cap		The capture
+ * @param which		The stream the pipe is for
+ *
+ * @return			The descriptor.
+ */
+int capture_child_fd(capture *cap, outstream which);
+
+/**
+ * Closes the job's ends of the pipes in 'mmake', once the job
+ * has been started, so the pipes end when the job exits.
+ *
+ * @param cap		The capture
+ */
+void capture_close_child_fd(capture *cap);
+
+/**
+ * Gets the end of a pipe to wait for output on.
+ *
+ * @param cap		The capture
+ * @param which		The stream the pipe is for
+ *
+ * @return			The descriptor, or -1 once the pipe has ended.
+ */
+int capture_poll_fd(capture *cap, outstream which);
+
+/**
+ * Moves all output available in the pipes into the buffers
+ * without blocking.
+ *
+ * @param cap		The capture
+ *
+ * @return			1 once both pipes have ended, else 0.
+ */
+int capture_drain(capture *cap);
+
+/**
+ * Adds text to the end of a buffer, e.g. the command of the
+ * job before its output.
+ *
+ * @param cap		The capture
+ * @param which		The stream the text belongs to
+ * @param text		The text to add
+ * @param len		The length of the text
+ *
+ * @return			0 on success, else 1.
+ */
+int capture_append(capture *cap, outstream which, const char *text, size_t len);
+
+/**
+ * Writes all buffered output, the standard output first.
+ *
+ * @param cap		The capture
+ * @param out_fd	The descriptor to write the standard output to
+ * @param err_fd	The descriptor to write the standard error to
+ */
+void capture_flush(capture *cap, int out_fd, int err_fd);
+
+/**
+ * Closes the pipes and returns the buffers to the pool.
+ *
+ * @param cap		The capture, may be NULL
+ */
+void capture_release(capture *cap);
+
+/**
+ * Frees all buffers in the pool.
+ */
+void capture_pool_free(void);
@@ -13,67 +13,100 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "parser.h"
+#include "parser_internal.h"
+#include "scan.h"
+#include "stats.h"
 
 
 /* ------------------------------- Constants ------------------------------- */
 
-#define MAX_RULES 256
-#define MAX_LINE 1024
-#define MAX_PREREQ 32
-#define MAX_CMD 32
+#define MIN_INDEX_SIZE 16
+#define READ_CHUNK 65536
 
 /* ------------------------------ Structures ------------------------------- */
 
-struct makefile {
-	struct rule *rules;
-};
-
-struct rule {
-	char *target;
-	char **prereq;
-	char **cmd;
-	rule *next;
+/* The makefile being parsed, scanned in place one line at a time. */
+struct source {
+	const char *pos;    /* Start of the next line. */
+	const char *end;    /* End of the makefile. */
+	const char *eol;    /* End of the current line, excluding '\n'. */
 };
 
 
 /* ------------------ Declarations of internal functions ------------------ */
 
-static rule *parse_rule(FILE *fp, bool *err);
-static char *extract_target(char **p, char *buf, FILE *fp, bool *err);
-static char *parse_prereqs(char **p, char **prereq, size_t *n_prereq);
-static char *advance_until_cmd(char *buf, FILE *fp);
-static size_t parse_cmd(char **cmd, char **p);
-static rule *create_rule(char *target, char **prereq, char **cmd);
-static char **dupe_str_array(size_t n, char **a);
-static char *next_line(char buf[MAX_LINE], FILE *fp);
-static char *parse_word(char **p, char *delim);
-static void skipwhite(char **p);
-static bool expect(char **p, char c);
-static bool is_blank_line(const char *s);
-static void free_arr(char **arr);
-static void del_rules(struct rule *rules);
-static void err0(bool *err);
-static void err1(char *target, bool *err);
-static void err2(char *prereq[], size_t n_prereq, char *target, bool *err);
+static const char *map_source(FILE *fp, size_t *len, bool *mapped);
+static const char *read_source(FILE *fp, size_t *len);
+static void unmap_source(const char *text, size_t len, bool mapped);
+static rule *parse_rule(struct source *src, arena *a, arena_vec *prereq,
+                        arena_vec *cmd, bool *err);
+static char *extract_target(const char **p, struct source *src, arena *a,
+                            bool *err);
+static bool parse_prereqs(const char **p, const char *eol, arena *a,
+                          arena_vec *prereq);
+static const char *advance_until_cmd(struct source *src);
+static bool parse_cmd(arena_vec *cmd, const char **p, const char *eol,
+                      arena *a);
+static rule *create_rule(arena *a, char *target, char **prereq, char **cmd);
+static char **dupe_str_array(arena *a, const arena_vec *vec);
+static const char *next_line(struct source *src);
+static char *parse_word(const char **p, const char *eol, char delim, arena *a);
+static void skipwhite(const char **p, const char *eol);
+static bool expect(const char **p, const char *eol, char c);
+static bool is_blank_line(const char *s, const char *eol);
+static bool build_index(makefile *m, arena *a);
 
 
 /* -------------------------- External functions -------------------------- */
 
 makefile *parse_makefile(FILE *fp)
 {
-	makefile *m = malloc(sizeof *m);
+	size_t len;
+	bool mapped;
+	const char *text = map_source(fp, &len, &mapped);
+	if (text == NULL) {
+		return NULL;
+	}
+	stats_add(STAT_BYTES_PARSED, len);
+
+	/* Every string of the makefile is copied into the arena once, so
+	 * the size of the file is a good first guess of the memory used. */
+	arena *a = arena_new(2 * len);
+	makefile *m = a == NULL ? NULL : arena_alloc(a, sizeof *m);
+	if (m == NULL) {
+		arena_del(a);
+		unmap_source(text, len, mapped);
+		return NULL;
+	}
+
+	m->arena = a;
+	m->index = NULL;
+	m->index_size = 0;
+	m->image = NULL;
+	m->image_len = 0;
 	rule **tailp = &m->rules;
 
+	/* The words of each rule are collected in two vectors that are
+	 * reused for every rule, so they only grow to the longest line. */
+	struct source src = { text, text + len, text };
+	arena_vec prereq = { NULL, 0, 0 };
+	arena_vec cmd = { NULL, 0, 0 };
 	bool err = false;
-	while ((*tailp = parse_rule(fp, &err)) != NULL) {
+	while ((*tailp = parse_rule(&src, a, &prereq, &cmd, &err)) != NULL) {
 		tailp = &(*tailp)->next;
+		stats_add(STAT_RULES_PARSED, 1);
 	}
 	*tailp = NULL;
 
-	if (m->rules == NULL || err) {
+	unmap_source(text, len, mapped);
+
+	if (m->rules == NULL || err || arena_failed(a) || !build_index(m, a)) {
 		makefile_del(m);
 		return NULL;
 	}
@@ -90,18 +123,40 @@ const char *makefile_default_target(makefile *m)
 
 rule *makefile_rule(makefile *m, const char *target)
 {
-	rule *i = m->rules;
-	while (i != NULL){
-		if (strcmp(i->target, target) == 0) {
-			return i;
+	stats_add(STAT_RULE_LOOKUPS, 1);
+
+	size_t mask = m->index_size - 1;
+	size_t i = hash_str(target) & mask;
+
+	while (m->index[i] != NULL) {
+		if (strcmp(m->index[i]->target, target) == 0) {
+			return m->index[i];
 		}
-		i = i->next;
+		i = (i + 1) & mask;
 	}
 
 	return NULL;
 }
 
 
+rule *makefile_first_rule(makefile *m)
+{
+	return m->rules;
+}
+
+
+rule *rule_next(rule *rule)
+{
+	return rule->next;
+}
+
+
+const char *rule_target(rule *rule)
+{
+	return rule->target;
+}
+
+
 const char **rule_prereq(rule *rule)
 {
 	return (const char **)rule->prereq;
@@ -116,94 +171,188 @@ char **rule_cmd(rule *rule)
 
 void makefile_del(makefile *make)
 {
-	del_rules(make->rules);
-	free(make);
+	if (make->image != NULL) {
+		munmap(make->image, make->image_len);
+		free(make);
+	} else {
+		/* The makefile itself lives in the arena. */
+		arena_del(make->arena);
+	}
 }
 
 
 /* -------------------------- Internal functions -------------------------- */
 
+/**
+ * Get the contents of a makefile without copying it. A regular file is
+ * mapped into memory, anything else, e.g. a pipe, is read into a buffer.
+ *
+ * @param fp        The file to read, positioned at its start.
+ * @param len       Pointer that is set to the length of the contents.
+ * @param mapped    Pointer that is set to true if the file was mapped.
+ * @return          The contents, or NULL if the file is empty or can not be
+ *                  read.
+ */
+static const char *map_source(FILE *fp, size_t *len, bool *mapped)
+{
+	struct stat st;
+	*mapped = false;
+
+	if (fstat(fileno(fp), &st) == -1 || !S_ISREG(st.st_mode)) {
+		return read_source(fp, len);
+	}
+
+	if (st.st_size == 0) {
+		return NULL;
+	}
+
+	const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+	                        fileno(fp), 0);
+	if (text == MAP_FAILED) {
+		return read_source(fp, len);
+	}
+
+	madvise((void *)text, st.st_size, MADV_SEQUENTIAL);
+	*len = st.st_size;
+	*mapped = true;
+
+	return text;
+}
+
+
+/**
+ * Read the rest of a file into a buffer.
+ *
+ * @param fp    The file to read.
+ * @param len   Pointer that is set to the length of the contents.
+ * @return      A buffer which should be freed using free, or NULL if nothing
+ *              could be read.
+ */
+static const char *read_source(FILE *fp, size_t *len)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	*len = 0;
+
+	for (;;) {
+		if (*len == size) {
+			char *new_buf = realloc(buf, size + READ_CHUNK);
+			if (new_buf == NULL) {
+				break;
+			}
+			buf = new_buf;
+			size += READ_CHUNK;
+		}
+
+		size_t n = fread(buf + *len, 1, size - *len, fp);
+		if (n == 0) {
+			break;
+		}
+		*len += n;
+	}
+
+	if (*len == 0 || ferror(fp)) {
+		free(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
+
+/**
+ * Release the contents of a makefile returned by map_source.
+ *
+ * @param text      The contents.
+ * @param len       The length of the contents.
+ * @param mapped    True if the contents were mapped.
+ */
+static void unmap_source(const char *text, size_t len, bool mapped)
+{
+	if (mapped) {
+		munmap((void *)text, len);
+	} else {
+		free((void *)text);
+	}
+}
+
+
 /**
  * Parse a rule.
  *
- * @param fp    File to read from.
- * @param err   Pointer to flag which gets set to true on error.
- * @return      A parsed rule or NULL.
+ * @param src   The makefile to read from.
+ * @param a       The arena to allocate the rule in.
+ * @param prereq  Scratch vector for the prerequisites.
+ * @param cmd     Scratch vector for the words of the command.
+ * @param err     Pointer to flag which gets set to true on error.
+ * @return        A parsed rule or NULL.
  */
-static rule *parse_rule(FILE *fp, bool *err)
+static rule *parse_rule(struct source *src, arena *a, arena_vec *prereq,
+                        arena_vec *cmd, bool *err)
 {
-	// Buffer variables
-	char buf[MAX_LINE];
-	char *p;
-
-	// Variables to fill
-	char *prereq[MAX_PREREQ];
-	size_t n_prereq;
-	char *cmd[MAX_CMD];
-	
-	char *target = extract_target(&p, buf, fp, err);
+	const char *p;
+
+	char *target = extract_target(&p, src, a, err);
 	if (target == NULL) {
 		return NULL;
 	}
 
-	p = parse_prereqs(&p, prereq, &n_prereq);
-	if(p == NULL)
-	{
-		err2(prereq, n_prereq, target, err);
+	if (!parse_prereqs(&p, src->eol, a, prereq)) {
+		*err = true;
 		return NULL;
 	}
 
-	p = advance_until_cmd(buf, fp);
-	if(p == NULL)
-	{
-		err2(prereq, n_prereq, target, err);
+	p = advance_until_cmd(src);
+	if (p == NULL) {
+		*err = true;
 		return NULL;
 	}
 
-	size_t n_words = parse_cmd(cmd, &p);
-
-	rule *r = create_rule(target, dupe_str_array(n_prereq, prereq), 
-	                      dupe_str_array(n_words, cmd));
+	if (!parse_cmd(cmd, &p, src->eol, a)) {
+		return NULL;
+	}
 
-	return r;
+	return create_rule(a, target, dupe_str_array(a, prereq),
+	                   dupe_str_array(a, cmd));
 }
 
 
 /**
- * Extract target from next line in fp, updates p to point to the first 
- * non-blank character after ':' in buf. Also reads in a full line to buf from fp.
+ * Extract target from the next line of the makefile, updates p to point to
+ * the first non-blank character after ':' on that line.
  * 
  * @param p   Pointer that keeps info about the current place in line.
- * @param buf Buffer that should be filled with one line from fp.
- * @param fp  File pointer from where the next line should be red.
+ * @param src The makefile to read the next line from.
+ * @param a   The arena to allocate the target in.
  * @param err Pointer to bool that keeps track if error occured.
- * @return    Target if line is as expected, NULL if error.
+ * @return    Target if line is as expected, NULL if error or end of file.
 */
-static char *extract_target(char **p, char *buf, FILE *fp, bool *err)
+static char *extract_target(const char **p, struct source *src, arena *a,
+                            bool *err)
 {
 	// read line with target and prerequisites
-	if ((*p = next_line(buf, fp)) == NULL) {
+	if ((*p = next_line(src)) == NULL) {
 		return NULL;
 	}
 	
 	// line cannot begin with whitespace
-	if (isspace(**p))
+	if (isspace((unsigned char)**p))
 	{
-		err0(err);
+		*err = true;
 		return NULL;
 	}
 
-	char *target = parse_word(p, ":");
+	char *target = parse_word(p, src->eol, ':', a);
 
-	skipwhite(p);
+	skipwhite(p, src->eol);
 
-	if (!expect(p, ':'))
+	if (target == NULL || !expect(p, src->eol, ':'))
 	{
-		err1(target, err);
+		*err = true;
 		return NULL;
 	}
 
-	skipwhite(p);
+	skipwhite(p, src->eol);
 
 	return target;
 }
@@ -212,53 +361,49 @@ static char *extract_target(char **p, char *buf, FILE *fp, bool *err)
 /**
  * Parse prerequisites and andvance p to end of line
  * 
- * @param prereq    Array to fill with prerequisites, should be previously 
- *                  allocated.
- * @param n_prereq  Pointer to number of prerequisites that is filled with 
- *                  number of prerequisites.
- * @param p         Pointer to place in string that is updated to end of line.
- * @return          Pointer to end of line in buffer, NULL if error. 
+ * @param p         Pointer to place in line that is updated to end of line.
+ * @param eol       End of the line.
+ * @param a         The arena to allocate the prerequisites in.
+ * @param prereq    Vector that is filled with the prerequisites.
+ * @return          True if the whole line was parsed, false if error. 
 */
-static char *parse_prereqs(char **p, char **prereq, size_t *n_prereq)
+static bool parse_prereqs(const char **p, const char *eol, arena *a,
+                          arena_vec *prereq)
 {
-	*n_prereq = 0; 
-	while (*n_prereq < MAX_PREREQ
-			&& (prereq[*n_prereq] = parse_word(p, "")) != NULL) {
-		(*n_prereq)++;
-		skipwhite(p);
-	}
-
-	if (!expect(p, '\n'))
-	{
-		return NULL;
+	char *word;
+	prereq->len = 0;
+	while ((word = parse_word(p, eol, '\0', a)) != NULL) {
+		if (arena_vec_push(a, prereq, word) != 0) {
+			return false;
+		}
+		skipwhite(p, eol);
 	}
 
-	return *p; 
+	return *p == eol;
 }
 
 
 /**
- * Advance until start of a command by reaing next row in fp.
+ * Advance until start of a command by reading the next line.
  * 
- * @param buf   Pointer to the buffer to fill, must be allocated before.
- * @param fp    File pointer to the file that should be red .
- * @return      Pointer to place in buf where command starts, NULL if error.
+ * @param src   The makefile to read the next line from.
+ * @return      Pointer to place in line where command starts, NULL if error.
 */
-static char *advance_until_cmd(char *buf, FILE *fp)
+static const char *advance_until_cmd(struct source *src)
 {
-	char *p;
-	if ((p = next_line(buf, fp)) == NULL)
+	const char *p;
+	if ((p = next_line(src)) == NULL)
 	{
 		return NULL;
 	}
 
 	// command has to begin with tab
-	if (!expect(&p, '\t'))
+	if (!expect(&p, src->eol, '\t'))
 	{
 		return NULL;
 	}
 
-	skipwhite(&p);
+	skipwhite(&p, src->eol);
 
 	return p;
 }
@@ -267,34 +412,44 @@ static char *advance_until_cmd(char *buf, FILE *fp)
 /**
  * Parse a command and insert words into **cmd.
  * 
- * @param cmd     Array of words in a command that is previous allocated.
+ * @param cmd     Vector that is filled with the words of the command.
  * @param p       Pointer to current adress in the line to parse.
- * @return        Number of words that is parsed in command, ie the length of the array cmd. 
+ * @param eol     End of the line.
+ * @param a       The arena to allocate the words in.
+ * @return        True on success, false if memory could not be allocated.
 */
-static size_t parse_cmd(char **cmd, char **p)
+static bool parse_cmd(arena_vec *cmd, const char **p, const char *eol,
+                      arena *a)
 {
-	size_t n_words = 0;
-	while (n_words < MAX_CMD && (cmd[n_words] = parse_word(p, "")) != NULL) {
-		n_words++;
-		skipwhite(p);
+	char *word;
+	cmd->len = 0;
+	while ((word = parse_word(p, eol, '\0', a)) != NULL) {
+		if (arena_vec_push(a, cmd, word) != 0) {
+			return false;
+		}
+		skipwhite(p, eol);
 	}
 
-	return n_words;
+	return true;
 }
 
 
 /**
  * Creates a rule given a target, a prereq string and a cmd_str.
  * 
+ * @param a         The arena to allocate the rule in.
  * @param target	Target in makefile.
  * @param prereq	Pointer to array with prerequisites.
  * @param cmd		Pointer to commands to run.
- * @return 			A rule that is allocated.
- * @note 			Rule must be freed when not needed anymore.
+ * @return 			A rule, or NULL if memory could not be allocated.
 */
-static rule *create_rule(char *target, char **prereq, char **cmd)
+static rule *create_rule(arena *a, char *target, char **prereq, char **cmd)
 {
-	rule *r = malloc(sizeof *r);
+	rule *r = arena_alloc(a, sizeof *r);
+	if (r == NULL || prereq == NULL || cmd == NULL) {
+		return NULL;
+	}
+
 	r->target = target;
 	r->prereq = prereq;
 	r->cmd = cmd;
@@ -304,66 +459,78 @@ static rule *create_rule(char *target, char **prereq, char **cmd)
 
 
 /**
- * Duplicate an array of strings.
+ * Duplicate a vector of strings into an exactly sized array in an arena.
  *
- * @param n     Size of array to duplicate.
- * @param a     Array to duplicate.
- * @return      NULL-terminated array which should be freed using free.
+ * @param a     The arena to allocate the copy in.
+ * @param vec   Vector to duplicate.
+ * @return      NULL-terminated array, or NULL if memory could not be
+ *              allocated.
  */
-static char **dupe_str_array(size_t n, char **a)
+static char **dupe_str_array(arena *a, const arena_vec *vec)
 {
-	char **ret = malloc((n + 1) * sizeof *ret);
+	char **ret = arena_alloc(a, (vec->len + 1) * sizeof *ret);
+	if (ret == NULL) {
+		return NULL;
+	}
 
-	for (size_t i = 0; i < n; i++) {
-		ret[i] = a[i];
+	if (vec->len > 0) {
+		memcpy(ret, vec->items, vec->len * sizeof *ret);
 	}
-	ret[n] = NULL;
+	ret[vec->len] = NULL;
 
 	return ret;
 }
 
 
 /**
- * Fills buf with the next line from fp. Returns buf if a line was read and
- * NULL otherwise.
+ * Advances to the next line in the makefile which is not blank, and sets
+ * src->eol to its end.
  * 
- * @param buf   The buffer with the contents of the next line.
- * @param fp    The file to read.
- * @return      The buffer.
+ * @param src   The makefile.
+ * @return      The start of the line, or NULL at end of file.
  */
-static char *next_line(char buf[MAX_LINE], FILE *fp)
+static const char *next_line(struct source *src)
 {
+	const char *line;
 	do {
-		if (fgets(buf, MAX_LINE, fp) == NULL) {
+		if (src->pos >= src->end) {
 			return NULL;
 		}
-	} while (is_blank_line(buf));
 
-	return buf;
+		line = src->pos;
+		src->eol = memchr(line, '\n', src->end - line);
+		if (src->eol == NULL) {
+			src->eol = src->end;
+			src->pos = src->end;
+		} else {
+			src->pos = src->eol + 1;
+		}
+	} while (is_blank_line(line, src->eol));
+
+	return line;
 }
 
 
 /**
  * Parse a word and update p to point to the first character after the word.
- * The word is delimited by whitespace and any character in delim. The
- * returned string should be freed using free.
+ * The word is delimited by whitespace, the end of the line and delim. The
+ * word is copied into the arena.
  * 
  * @param p     A pointer to the first character after the word.
- * @param delim A string of delimeters.
- * @return      A string with the word.
+ * @param eol   End of the line.
+ * @param delim An extra delimeter, or '\0' for none.
+ * @param a     The arena to allocate the word in.
+ * @return      A string with the word, or NULL if there is no word.
  */
-static char *parse_word(char **p, char *delim)
+static char *parse_word(const char **p, const char *eol, char delim, arena *a)
 {
-	size_t n = 0;
-	while (!isspace((*p)[n]) && strchr(delim, (*p)[n]) == NULL) {
-		n++;
-	}
+	size_t n = scan_word_end(*p, eol, delim) - *p;
 
 	if (n == 0) {
 		return NULL;
 	}
 
-	char *word = strndup(*p, n);
+	char *word = arena_strndup(a, *p, n);
 	*p += n;
 
 	return word;
@@ -372,15 +539,14 @@ static char *parse_word(char **p, char *delim)
 
 /**
  * Advance pointer to the next character which is not a space, stops at
- * newline.
+ * the end of the line.
  * 
  * @param p     The pointer to a character.
+ * @param eol   End of the line.
  */
-static void skipwhite(char **p)
+static void skipwhite(const char **p, const char *eol)
 {
-	while (isspace(**p) && **p != '\n') {
-		(*p)++;
-	}
+	*p = scan_skip_space(*p, eol);
 }
 
 
@@ -388,12 +554,13 @@ static void skipwhite(char **p)
  * Check that the character pointed to by p is c, and increment p if it is.
  * 
  * @param p    The pointer to a character.
+ * @param eol  End of the line.
  * @param c    The character to compare with.
  * @return     True if equal, false otherwise.
  */
-static bool expect(char **p, char c)
+static bool expect(const char **p, const char *eol, char c)
 {
-	if (**p != c) {
+	if (*p >= eol || **p != c) {
 		return false;
 	}
 
@@ -406,109 +573,54 @@ static bool expect(char **p, char c)
 /**
  * Check if line is blank.
  * 
- * @param s    The string (line) to check.
+ * @param s    The start of the line to check.
+ * @param eol  End of the line.
  * @return     True if line is blank, false otherwise.
  */
-static bool is_blank_line(const char *s) 
+static bool is_blank_line(const char *s, const char *eol)
 {
-	size_t i = 0;
-	while (s[i] != '\0'){
-		if (!isspace(s[i])) {
-			return false;
-		}
-		i++;
-	}
-
-	return true;
+	return scan_skip_space(s, eol) == eol;
 }
 
-/**
- * Free an array until NULL found
- * @param arr   Array to free
-*/
-static void free_arr(char **arr)
-{
-	size_t i = 0;
-	while (arr[i] != NULL){
-		free(arr[i]);
-		i++;
-	}
-}
 
 /**
- * Recursively delete a list of rules.
- * 
- * @param rules   The rules to delete.
+ * Build an open-addressing (linear probing) hash index over the targets of
+ * all rules. The table size is a power of two kept at most half full, so a
+ * lookup probes O(1) slots on average. If a target is defined more than once
+ * the first rule wins, as with the previous linear search.
+ *
+ * @param m     The makefile to index.
+ * @param a     The arena to allocate the index in.
+ * @return      True on success, false if memory could not be allocated.
  */
-static void del_rules(struct rule *rules) 
+static bool build_index(makefile *m, arena *a)
 {
-	if (rules == NULL) {
-		return;
+	size_t n_rules = 0;
+	for (rule *r = m->rules; r != NULL; r = r->next) {
+		n_rules++;
 	}
 
-	free(rules->target);
-
-	free_arr(rules->prereq);	
-	free(rules->prereq);
-
-	free_arr(rules->cmd);
-	free(rules->cmd);
-
-	del_rules(rules->next);
-
-	free(rules);
-}
-
-
-/* ------------------------ Internal error handling ------------------------ */
-
-/**
- * Sets err to true, lowest order of error cleanup
- * 
- * @note There exists 3 levels of error cleanup, err0, err1, and err2. 
- * When err2 is called, it means that err2 is performed, then err1, and lastly err0.
- * If err0 is called, only err0 is executed.
- * @param err Pointer to bool with error
- * @return
-*/
-static void err0(bool *err)
-{
-	*err = true;
-}
+	size_t size = MIN_INDEX_SIZE;
+	while (size < 2 * n_rules) {
+		size *= 2;
+	}
 
-/**
- * Middle order of cleanup, frees target and calls err0()
- * 
- * @note There exists 3 levels of error cleanup, err0, err1, and err2. 
- * When err2 is called, it means that err2 is performed, then err1, and lastly err0.
- * If err0 is called, only err0 is executed.
- * @param target    Allocated target to free
- * @param err       Pointer to bool that tells if error occured
- * @return
-*/
-static void err1(char *target, bool *err)
-{
-	free(target);
-	err0(err);
-}
+	m->index = arena_alloc(a, size * sizeof *m->index);
+	if (m->index == NULL) {
+		return false;
+	}
+	memset(m->index, 0, size * sizeof *m->index);
+	m->index_size = size;
 
-/**
- * Highest order of cleanup, frees prereqs and calls err1()
- * 
- * @note There exists 3 levels of error cleanup, err0, err1, and err2. 
- * When err2 is called, it means that err2 is performed, then err1, and lastly err0.
- * If err0 is called, only err0 is executed.
- * @param prereq    Allocated array of prereqs to free
- * @param n_prereq  Number of elements in prereq to free
- * @param target    Allocated target to free
- * @param err       Pointer to bool that tells if error occured
- * @return
-*/
-static void err2(char *prereq[], size_t n_prereq, char *target, bool *err)
-{
-	for (size_t i = 0; i < n_prereq; i++) {
-		free(prereq[i]);
+	for (rule *r = m->rules; r != NULL; r = r->next) {
+		size_t i = hash_str(r->target) & (size - 1);
+		while (m->index[i] != NULL && strcmp(m->index[i]->target, r->target) != 0) {
+			i = (i + 1) & (size - 1);
+		}
+		if (m->index[i] == NULL) {
+			m->index[i] = r;
+		}
 	}
-	err1(target, err);
-}
 
+	return true;
+}
@@ -14,6 +14,7 @@
 #define PARSER_H
 
 #include <stdio.h>
+#include <sys/stat.h>
 
 typedef struct makefile makefile;
 typedef struct rule rule;
@@ -32,6 +33,36 @@ typedef struct rule rule;
 makefile *parse_makefile(FILE *fp);
 
 
+/**
+ * Load a makefile from a binary image saved by makefile_save_image. The image
+ * is only used if it was made from the same makefile, i.e. if the path, size,
+ * time of last modification and inode recorded in it all match. The returned
+ * makefile is used like one returned by parse_makefile.
+ *
+ * @param image_path    The path of the image.
+ * @param makefile_path The path of the makefile the image was made from.
+ * @param key           The result of stat on the makefile.
+ * @return              A pointer to the makefile, or NULL if there is no
+ *                      usable image.
+ */
+makefile *makefile_load_image(const char *image_path, const char *makefile_path,
+                              const struct stat *key);
+
+
+/**
+ * Save a parsed makefile as a binary image, so that later runs can load it
+ * with makefile_load_image instead of parsing the makefile again.
+ *
+ * @param make          A pointer to a structue of type makefile.
+ * @param image_path    The path of the image.
+ * @param makefile_path The path of the makefile that was parsed.
+ * @param key           The result of stat on the makefile.
+ * @return              0 on success, 1 if the image could not be written.
+ */
+int makefile_save_image(makefile *make, const char *image_path,
+                        const char *makefile_path, const struct stat *key);
+
+
 /**
  * Returns a pointer to the name of the default target for a makefile. (The 
  * default target is the target for the first rule.)
@@ -53,6 +84,36 @@ const char *makefile_default_target(makefile *make);
 rule *makefile_rule(makefile *make, const char *target);
 
 
+/**
+ * Returns a pointer to the first rule of a makefile. Together with rule_next
+ * this can be used to iterate over all rules in the order they appear in the
+ * makefile.
+ *
+ * @param make  A pointer to a structue of type makefile.
+ * @return      A pointer to the first rule.
+ */
+rule *makefile_first_rule(makefile *make);
+
+
+/**
+ * Returns a pointer to the rule following a rule in the makefile, or NULL if
+ * it is the last rule.
+ *
+ * @param rule  A pointer to the rule.
+ * @return      A pointer to the next rule, or NULL.
+ */
+rule *rule_next(rule *rule);
+
+
+/**
+ * Returns a pointer to the name of the target that a rule builds.
+ *
+ * @param rule  A pointer to the rule.
+ * @return      A pointer to the name of the target.
+ */
+const char *rule_target(rule *rule);
+
+
 /**
  * Returns a pointer to an array containing the prerequisites for the rule. The 
  * array is terminated with NULL.
@@ -0,0 +1,486 @@
+/**
+ * Stores parsed makefiles as binary images, so that a makefile which has not
+ * changed since the last run can be loaded without parsing it. The image is
+ * relocatable: every pointer in it is stored as an offset from the start of
+ * the image. Loading maps the image privately and turns the offsets back into
+ * pointers in place, so pages holding only strings are never copied.
+ *
+ * An image holds the rules, the prerequisite and command arrays, the hash
+ * index over the targets and an interned string table where every distinct
+ * string is stored once. It is keyed by the path, size, modification time and
+ * inode of the makefile it was created from.
+ *
+ * @file parser_image.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "parser.h"
+#include "parser_internal.h"
+
+
+/* ------------------------------- Constants ------------------------------- */
+
+#define IMAGE_MAGIC "MMIMG001"
+#define IMAGE_MAGIC_LEN 8
+#define IMAGE_VERSION 1
+#define MIN_INTERN_SIZE 64
+
+/* ------------------------------ Structures ------------------------------- */
+
+struct image_header {
+	char magic[IMAGE_MAGIC_LEN];
+	uint32_t version;
+	uint32_t ptr_size;
+	uint32_t rule_size;
+	uint32_t reserved;
+	uint64_t image_size;
+
+	/* Key of the makefile the image was created from. */
+	uint64_t key_size;
+	uint64_t key_ino;
+	uint64_t key_dev;
+	int64_t key_mtime_sec;
+	int64_t key_mtime_nsec;
+
+	/* Sections, as offsets from the start of the image. */
+	uint64_t n_rules;
+	uint64_t rules_off;
+	uint64_t n_slots;
+	uint64_t slots_off;
+	uint64_t index_size;
+	uint64_t index_off;
+	uint64_t strings_off;
+	uint64_t path_off;
+};
+
+struct interned {
+	const char *str;
+	uint64_t off;
+};
+
+struct intern_table {
+	struct interned *slots;
+	size_t size;
+	size_t used;
+	uint64_t n_bytes;
+};
+
+
+/* ------------------ Declarations of internal functions ------------------ */
+
+static bool intern(struct intern_table *t, const char *s);
+static uint64_t interned_offset(struct intern_table *t, const char *s);
+static struct interned *intern_slot(struct interned *slots, size_t size,
+                                    const char *s);
+static bool key_matches(const struct image_header *h, const char *image,
+                        const char *makefile_path, const struct stat *key);
+static bool relocate(char *image, const struct image_header *h);
+static bool relocate_ptr(void **p, char *image, uint64_t lo, uint64_t hi);
+static bool relocate_array(char **arr, char *image, const struct image_header *h);
+static uint64_t align8(uint64_t n);
+
+
+/* -------------------------- External functions -------------------------- */
+
+makefile *makefile_load_image(const char *image_path, const char *makefile_path,
+                              const struct stat *key)
+{
+	int fd = open(image_path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1
+			|| (size_t)st.st_size < sizeof(struct image_header)) {
+		close(fd);
+		return NULL;
+	}
+
+	size_t len = st.st_size;
+	char *image = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (image == MAP_FAILED) {
+		return NULL;
+	}
+
+	struct image_header h;
+	memcpy(&h, image, sizeof h);
+
+	makefile *m = NULL;
+	if (h.image_size == len && key_matches(&h, image, makefile_path, key)
+			&& relocate(image, &h)) {
+		m = malloc(sizeof *m);
+	}
+
+	if (m == NULL) {
+		munmap(image, len);
+		return NULL;
+	}
+
+	m->rules = (rule *)(image + h.rules_off);
+	m->index = (rule **)(image + h.index_off);
+	m->index_size = h.index_size;
+	m->arena = NULL;
+	m->image = image;
+	m->image_len = len;
+
+	return m;
+}
+
+
+int makefile_save_image(makefile *make, const char *image_path,
+                        const char *makefile_path, const struct stat *key)
+{
+	struct intern_table strings = { NULL, 0, 0, 0 };
+	uint64_t n_rules = 0;
+	uint64_t n_slots = 0;
+	bool ok = intern(&strings, makefile_path);
+
+	/* Count everything and lay out the string table. */
+	for (rule *r = make->rules; r != NULL && ok; r = r->next) {
+		n_rules++;
+		ok = intern(&strings, r->target);
+		for (size_t i = 0; ok && r->prereq[i] != NULL; i++, n_slots++) {
+			ok = intern(&strings, r->prereq[i]);
+		}
+		for (size_t i = 0; ok && r->cmd[i] != NULL; i++, n_slots++) {
+			ok = intern(&strings, r->cmd[i]);
+		}
+		n_slots += 2;
+	}
+
+	struct image_header h;
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN);
+	h.version = IMAGE_VERSION;
+	h.ptr_size = sizeof(void *);
+	h.rule_size = sizeof(struct rule);
+	h.key_size = key->st_size;
+	h.key_ino = key->st_ino;
+	h.key_dev = key->st_dev;
+	h.key_mtime_sec = key->st_mtim.tv_sec;
+	h.key_mtime_nsec = key->st_mtim.tv_nsec;
+	h.n_rules = n_rules;
+	h.rules_off = align8(sizeof h);
+	h.n_slots = n_slots;
+	h.slots_off = h.rules_off + n_rules * sizeof(struct rule);
+	h.index_size = make->index_size;
+	h.index_off = h.slots_off + n_slots * sizeof(char *);
+	h.strings_off = h.index_off + make->index_size * sizeof(rule *);
+	h.image_size = h.strings_off + strings.n_bytes;
+
+	char *image = ok ? calloc(1, h.image_size) : NULL;
+	if (image == NULL) {
+		free(strings.slots);
+		return 1;
+	}
+
+	/* Copy every interned string into place. */
+	for (size_t i = 0; i < strings.size; i++) {
+		struct interned *s = &strings.slots[i];
+		if (s->str != NULL) {
+			strcpy(image + h.strings_off + s->off, s->str);
+		}
+	}
+	h.path_off = h.strings_off + interned_offset(&strings, makefile_path);
+
+	/* Store the rules with every pointer replaced by an offset. */
+	struct rule *rules = (struct rule *)(image + h.rules_off);
+	char **slot = (char **)(image + h.slots_off);
+	size_t n = 0;
+
+	for (rule *r = make->rules; r != NULL; r = r->next, n++) {
+		rules[n].target = (char *)(uintptr_t)(h.strings_off
+		                  + interned_offset(&strings, r->target));
+		rules[n].next = r->next == NULL ? NULL : (rule *)(uintptr_t)(h.rules_off
+		                + (n + 1) * sizeof(struct rule));
+
+		char **arrays[] = { r->prereq, r->cmd };
+		for (size_t a = 0; a < 2; a++) {
+			char **dst = slot;
+			for (size_t i = 0; arrays[a][i] != NULL; i++) {
+				*slot++ = (char *)(uintptr_t)(h.strings_off
+				          + interned_offset(&strings, arrays[a][i]));
+			}
+			*slot++ = NULL;
+
+			uintptr_t off = (char *)dst - image;
+			if (a == 0) {
+				rules[n].prereq = (char **)off;
+			} else {
+				rules[n].cmd = (char **)off;
+			}
+		}
+	}
+
+	/* Store the hash index as rule offsets. Every indexed rule is found
+	 * by probing from the slot of its target, like a lookup does. */
+	rule **index = (rule **)(image + h.index_off);
+	size_t mask = make->index_size - 1;
+	n = 0;
+	for (rule *r = make->rules; r != NULL && make->index_size > 0;
+	     r = r->next, n++) {
+		size_t i = hash_str(r->target) & mask;
+		while (make->index[i] != NULL && make->index[i] != r) {
+			i = (i + 1) & mask;
+		}
+		if (make->index[i] == r) {
+			index[i] = (rule *)(uintptr_t)(h.rules_off
+			           + n * sizeof(struct rule));
+		}
+	}
+
+	memcpy(image, &h, sizeof h);
+	free(strings.slots);
+
+	/* Write to a temporary file and move it into place, so that a
+	 * concurrent run never maps a half-written image. */
+	size_t tmp_len = strlen(image_path) + sizeof ".tmp";
+	char *tmp_path = malloc(tmp_len);
+	int result = 1;
+
+	if (tmp_path != NULL) {
+		snprintf(tmp_path, tmp_len, "%s.tmp", image_path);
+		FILE *fp = fopen(tmp_path, "wb");
+		if (fp != NULL) {
+			bool written = fwrite(image, 1, h.image_size, fp) == h.image_size;
+			if (fclose(fp) == 0 && written && rename(tmp_path, image_path) == 0) {
+				result = 0;
+			} else {
+				unlink(tmp_path);
+			}
+		}
+		free(tmp_path);
+	}
+
+	free(image);
+
+	return result;
+}
+
+
+/* -------------------------- Internal functions -------------------------- */
+
+/**
+ * Add a string to the intern table unless it is already there. Every
+ * distinct string is given an offset in the string table.
+ *
+ * @param t     The intern table.
+ * @param s     The string to add.
+ * @return      True on success, false if memory could not be allocated.
+ */
+static bool intern(struct intern_table *t, const char *s)
+{
+	/* Keep the table at most half full. */
+	if (2 * (t->used + 1) > t->size) {
+		size_t size = t->size == 0 ? MIN_INTERN_SIZE : 2 * t->size;
+		struct interned *slots = calloc(size, sizeof *slots);
+		if (slots == NULL) {
+			return false;
+		}
+		for (size_t i = 0; i < t->size; i++) {
+			if (t->slots[i].str != NULL) {
+				*intern_slot(slots, size, t->slots[i].str) = t->slots[i];
+			}
+		}
+		free(t->slots);
+		t->slots = slots;
+		t->size = size;
+	}
+
+	struct interned *slot = intern_slot(t->slots, t->size, s);
+	if (slot->str == NULL) {
+		slot->str = s;
+		slot->off = t->n_bytes;
+		t->n_bytes += strlen(s) + 1;
+		t->used++;
+	}
+
+	return true;
+}
+
+
+/**
+ * Get the offset of an interned string within the string table.
+ *
+ * @param t     The intern table.
+ * @param s     A string previously added with intern.
+ * @return      The offset of the string.
+ */
+static uint64_t interned_offset(struct intern_table *t, const char *s)
+{
+	return intern_slot(t->slots, t->size, s)->off;
+}
+
+
+/**
+ * Find the slot of a string in an intern table. The slot either holds the
+ * string or is empty.
+ *
+ * @param slots The slots of the table.
+ * @param size  The size of the table, a power of two.
+ * @param s     The string to look for.
+ * @return      A pointer to the slot.
+ */
+static struct interned *intern_slot(struct interned *slots, size_t size,
+                                    const char *s)
+{
+	size_t i = hash_str(s) & (size - 1);
+	while (slots[i].str != NULL && strcmp(slots[i].str, s) != 0) {
+		i = (i + 1) & (size - 1);
+	}
+
+	return &slots[i];
+}
+
+
+/**
+ * Check that an image was made by this version of the program from the
+ * makefile it is about to be used for.
+ *
+ * @param h             The header of the image.
+ * @param image         The mapped image.
+ * @param makefile_path The path of the makefile.
+ * @param key           The result of stat on the makefile.
+ * @return              True if the image can be used.
+ */
+static bool key_matches(const struct image_header *h, const char *image,
+                        const char *makefile_path, const struct stat *key)
+{
+	if (memcmp(h->magic, IMAGE_MAGIC, IMAGE_MAGIC_LEN) != 0
+			|| h->version != IMAGE_VERSION
+			|| h->ptr_size != sizeof(void *)
+			|| h->rule_size != sizeof(struct rule)) {
+		return false;
+	}
+
+	if (h->key_size != (uint64_t)key->st_size
+			|| h->key_ino != (uint64_t)key->st_ino
+			|| h->key_dev != (uint64_t)key->st_dev
+			|| h->key_mtime_sec != key->st_mtim.tv_sec
+			|| h->key_mtime_nsec != key->st_mtim.tv_nsec) {
+		return false;
+	}
+
+	/* The string table is last, so every string in it is terminated
+	 * as long as the image ends with a terminator. */
+	if (h->n_rules == 0 || h->strings_off >= h->image_size
+			|| h->path_off < h->strings_off || h->path_off >= h->image_size
+			|| image[h->image_size - 1] != '\0') {
+		return false;
+	}
+
+	return strcmp(image + h->path_off, makefile_path) == 0;
+}
+
+
+/**
+ * Turn every offset in a mapped image back into a pointer. Every offset is
+ * checked to point into the section it belongs to.
+ *
+ * @param image The mapped image.
+ * @param h     The header of the image.
+ * @return      True on success, false if the image is corrupt.
+ */
+static bool relocate(char *image, const struct image_header *h)
+{
+	if (h->rules_off + h->n_rules * sizeof(struct rule) > h->slots_off
+			|| h->slots_off + h->n_slots * sizeof(char *) > h->index_off
+			|| h->index_off + h->index_size * sizeof(rule *) > h->strings_off
+			|| (h->index_size & (h->index_size - 1)) != 0) {
+		return false;
+	}
+
+	uint64_t rules_end = h->rules_off + h->n_rules * sizeof(struct rule);
+	struct rule *rules = (struct rule *)(image + h->rules_off);
+
+	for (uint64_t i = 0; i < h->n_rules; i++) {
+		struct rule *r = &rules[i];
+		if (!relocate_ptr((void **)&r->target, image, h->strings_off, h->image_size)
+				|| !relocate_ptr((void **)&r->prereq, image, h->slots_off, h->index_off)
+				|| !relocate_ptr((void **)&r->cmd, image, h->slots_off, h->index_off)
+				|| !relocate_array(r->prereq, image, h)
+				|| !relocate_array(r->cmd, image, h)) {
+			return false;
+		}
+		if (r->next != NULL
+				&& !relocate_ptr((void **)&r->next, image, h->rules_off, rules_end)) {
+			return false;
+		}
+	}
+
+	rule **index = (rule **)(image + h->index_off);
+	for (uint64_t i = 0; i < h->index_size; i++) {
+		if (index[i] != NULL
+				&& !relocate_ptr((void **)&index[i], image, h->rules_off, rules_end)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Turn one offset into a pointer, checking that it lies within [lo, hi).
+ *
+ * @param p     Pointer to the offset to relocate.
+ * @param image The mapped image.
+ * @param lo    The lowest allowed offset.
+ * @param hi    The offset one past the highest allowed offset.
+ * @return      True on success, false if the offset is out of range.
+ */
+static bool relocate_ptr(void **p, char *image, uint64_t lo, uint64_t hi)
+{
+	uint64_t off = (uintptr_t)*p;
+	if (off < lo || off >= hi) {
+		return false;
+	}
+
+	*p = image + off;
+
+	return true;
+}
+
+
+/**
+ * Relocate a NULL-terminated array of string offsets.
+ *
+ * @param arr   The array, already relocated itself.
+ * @param image The mapped image.
+ * @param h     The header of the image.
+ * @return      True on success, false if the array is corrupt.
+ */
+static bool relocate_array(char **arr, char *image, const struct image_header *h)
+{
+	char **end = (char **)(image + h->index_off);
+	for (; arr < end && *arr != NULL; arr++) {
+		if (!relocate_ptr((void **)arr, image, h->strings_off, h->image_size)) {
+			return false;
+		}
+	}
+
+	return arr < end;
+}
+
+
+/**
+ * Round a size up to a multiple of 8.
+ *
+ * @param n     The size.
+ * @return      The rounded size.
+ */
+static uint64_t align8(uint64_t n)
+{
+	return (n + 7) & ~(uint64_t)7;
+}
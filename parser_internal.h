@@ -0,0 +1,57 @@
+/**
+ * Internal structures of the makefile parser, shared between the parser and
+ * the module that stores parsed makefiles as binary images. Not to be used
+ * outside of the parser.
+ *
+ * @file parser_internal.h
+ */
+
+#ifndef PARSER_INTERNAL_H
+#define PARSER_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "parser.h"
+#include "arena.h"
+
+
+/* ------------------------------ Structures ------------------------------- */
+
+struct makefile {
+	struct rule *rules;
+	struct rule **index;
+	size_t index_size;
+	arena *arena;       /* Arena holding all rules, or NULL if loaded. */
+	void *image;        /* Mapped image backing all rules, or NULL. */
+	size_t image_len;
+};
+
+struct rule {
+	char *target;
+	char **prereq;
+	char **cmd;
+	rule *next;
+};
+
+
+/* ------------------------------- Functions ------------------------------- */
+
+/**
+ * Hash a string using 64-bit FNV-1a. The hash index of a makefile and
+ * that of its saved image must agree, so both use this function.
+ *
+ * @param s     The string to hash.
+ * @return      The hash value.
+ */
+static inline size_t hash_str(const char *s)
+{
+	uint64_t h = 14695981039346656037ULL;
+	while (*s != '\0') {
+		h ^= (unsigned char)*s++;
+		h *= 1099511628211ULL;
+	}
+
+	return (size_t)h;
+}
+
+#endif
@@ -0,0 +1,407 @@
+/**
+ * Prefetches file information for a known set of paths
+ * into the file handler's cache. All stat requests are
+ * submitted in batches through io_uring, so slow network
+ * or overlay filesystems can serve them concurrently. On
+ * systems without io_uring a small thread pool is used
+ * instead.
+ *
+ * @file prefetch.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "prefetch.h"
+#include "file_handler.h"
+#include "stats.h"
+
+// Prefetching only pays off for more than a few paths
+#define MIN_PREFETCH 16
+#define RING_ENTRIES 256
+#define MAX_THREADS 8
+#define PATHS_PER_THREAD 64
+
+// Marks a result that has not been filled in yet
+#define NOT_FETCHED -1
+
+typedef struct fetchresult {
+	int error;               // 0 on success, else the errno value
+	struct timespec mtime;   // Time of last modification
+	off_t size;              // Size of the file in bytes
+} fetchresult;
+
+typedef struct fetchwork {
+	const char **paths;      // The paths to stat
+	fetchresult *results;    // One result per path
+	size_t n_paths;          // Amount of paths
+	size_t next;             // Index of the next path to take
+	pthread_mutex_t lock;    // Protects 'next'
+} fetchwork;
+
+// * Internal functions
+
+#ifdef HAVE_IO_URING
+
+typedef struct uring {
+	int fd;                       // The io_uring file descriptor
+	unsigned *sq_tail;            // Submission queue tail
+	unsigned *sq_mask;            // Submission queue index mask
+	unsigned *sq_array;           // Submission queue index array
+	struct io_uring_sqe *sqes;    // Submission queue entries
+	unsigned *cq_head;            // Completion queue head
+	unsigned *cq_tail;            // Completion queue tail
+	unsigned *cq_mask;            // Completion queue index mask
+	struct io_uring_cqe *cqes;    // Completion queue entries
+	void *sq_ring;                // Mapping of the submission ring
+	size_t sq_ring_len;           // Length of the submission ring mapping
+	void *cq_ring;                // Mapping of the completion ring
+	size_t cq_ring_len;           // Length of the completion ring mapping
+	size_t sqes_len;              // Length of the entries mapping
+	unsigned entries;             // Amount of submission entries
+} uring;
+
+/**
+ * Releases all resources of an io_uring instance.
+ *
+ * @param ring	The ring to release
+ */
+static void uring_close(uring *ring)
+{
+	if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+		munmap(ring->sqes, ring->sqes_len);
+	if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED
+		&& ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_len);
+	if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+		munmap(ring->sq_ring, ring->sq_ring_len);
+
+	close(ring->fd);
+}
+
+/**
+ * Sets up an io_uring instance and maps its rings.
+ *
+ * @param ring	The ring to set up
+ *
+ * @return		0 on success, else 1.
+ */
+static int uring_open(uring *ring)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &params);
+	if (ring->fd < 0)
+		return 1;
+
+	ring->entries = params.sq_entries;
+	ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_len = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// Newer kernels map both rings with a single mapping
+	int single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap && ring->cq_ring_len > ring->sq_ring_len)
+		ring->sq_ring_len = ring->cq_ring_len;
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = single_mmap ? ring->sq_ring : mmap(NULL, ring->cq_ring_len,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED
+		|| ring->sqes == MAP_FAILED)
+	{
+		uring_close(ring);
+		return 1;
+	}
+
+	char *sq = ring->sq_ring;
+	char *cq = ring->cq_ring;
+
+	ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	return 0;
+}
+
+/**
+ * Stats one batch of paths through io_uring and waits for all
+ * of the requests to complete.
+ *
+ * @param ring		The ring to submit to
+ * @param paths		The paths of the batch
+ * @param results	One result per path of the batch
+ * @param bufs		One statx buffer per path of the batch
+ * @param n			The amount of paths in the batch
+ *
+ * @return			0 on success, else 1.
+ */
+static int uring_stat_batch(uring *ring, const char **paths, fetchresult *results,
+	struct statx *bufs, unsigned n)
+{
+	unsigned tail = *ring->sq_tail;
+
+	for (unsigned i = 0; i < n; i++)
+	{
+		unsigned index = tail & *ring->sq_mask;
+		struct io_uring_sqe *sqe = &ring->sqes[index];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (unsigned long)paths[i];
+		sqe->len = STATX_MTIME | STATX_SIZE;
+		sqe->off = (unsigned long)&bufs[i];
+		sqe->user_data = i;
+
+		ring->sq_array[index] = index;
+		tail++;
+	}
+
+	__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+
+	unsigned to_submit = n;
+	unsigned completed = 0;
+	while (completed < n)
+	{
+		int submitted = syscall(__NR_io_uring_enter, ring->fd, to_submit,
+			n - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if (submitted < 0 && errno != EINTR)
+			return 1;
+
+		if (submitted > 0)
+			to_submit -= submitted;
+
+		unsigned head = *ring->cq_head;
+		while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+			fetchresult *result = &results[cqe->user_data];
+
+			// Kernels without statx support for io_uring reject the
+			//	request, which is then left to the thread pool
+			if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+				result->error = NOT_FETCHED;
+			else if (cqe->res < 0)
+				result->error = -cqe->res;
+			else
+			{
+				struct statx *buf = &bufs[cqe->user_data];
+				result->error = 0;
+				result->mtime.tv_sec = buf->stx_mtime.tv_sec;
+				result->mtime.tv_nsec = buf->stx_mtime.tv_nsec;
+				result->size = buf->stx_size;
+			}
+
+			head++;
+			completed++;
+		}
+
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+/**
+ * Stats all paths through io_uring in batches of the ring's
+ * size.
+ *
+ * @param paths		The paths to stat
+ * @param results	One result per path
+ * @param n_paths	The amount of paths
+ *
+ * @return			0 on success, 1 if io_uring is unavailable.
+ */
+static int uring_stat_all(const char **paths, fetchresult *results, size_t n_paths)
+{
+	uring ring;
+	if (uring_open(&ring) != 0)
+		return 1;
+
+	struct statx *bufs = malloc(ring.entries * sizeof(*bufs));
+	if (bufs == NULL)
+	{
+		uring_close(&ring);
+		return 1;
+	}
+
+	int failed = 0;
+	for (size_t done = 0; done < n_paths && !failed; done += ring.entries)
+	{
+		unsigned n = n_paths - done < ring.entries ? n_paths - done : ring.entries;
+		failed = uring_stat_batch(&ring, &paths[done], &results[done], bufs, n);
+	}
+
+	uring_close(&ring);
+
+	// After a failed batch the kernel may still write to the
+	//	buffers, so they are leaked instead
+	if (!failed)
+		free(bufs);
+
+	return failed;
+}
+
+#endif
+
+/**
+ * Worker thread of the fallback thread pool. Takes paths one
+ * at a time and stats them until none are left.
+ *
+ * @param arg	The shared work description
+ *
+ * @return		NULL
+ */
+static void *stat_worker(void *arg)
+{
+	fetchwork *work = arg;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&work->lock);
+		size_t i = work->next++;
+		pthread_mutex_unlock(&work->lock);
+
+		if (i >= work->n_paths)
+			return NULL;
+
+		if (work->results[i].error != NOT_FETCHED)
+			continue;
+
+		struct stat fileinfo;
+		if (stat(work->paths[i], &fileinfo) == -1)
+			work->results[i].error = errno;
+		else
+		{
+			work->results[i].error = 0;
+			work->results[i].mtime = fileinfo.st_mtim;
+			work->results[i].size = fileinfo.st_size;
+		}
+	}
+}
+
+/**
+ * Stats all paths that have not been fetched yet using a small
+ * pool of threads.
+ *
+ * @param paths		The paths to stat
+ * @param results	One result per path
+ * @param n_paths	The amount of paths
+ */
+static void pool_stat_all(const char **paths, fetchresult *results, size_t n_paths)
+{
+	fetchwork work = {
+		.paths = paths,
+		.results = results,
+		.n_paths = n_paths,
+		.next = 0
+	};
+	pthread_mutex_init(&work.lock, NULL);
+
+	size_t n_threads = n_paths / PATHS_PER_THREAD + 1;
+	if (n_threads > MAX_THREADS)
+		n_threads = MAX_THREADS;
+
+	pthread_t threads[MAX_THREADS];
+	size_t n_started = 0;
+
+	while (n_started < n_threads
+		&& pthread_create(&threads[n_started], NULL, stat_worker, &work) == 0)
+	{
+		n_started++;
+	}
+
+	// Whatever the threads do not get to is handled here
+	stat_worker(&work);
+
+	for (size_t i = 0; i < n_started; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&work.lock);
+}
+
+// * Visible functions
+
+void prefetch_file_info(const char **paths, size_t n_paths)
+{
+	if (n_paths < MIN_PREFETCH)
+		return;
+
+	const char **pending = malloc(n_paths * sizeof(*pending));
+	fetchresult *results = malloc(n_paths * sizeof(*results));
+
+	if (pending == NULL || results == NULL)
+	{
+		free(pending);
+		free(results);
+		return;
+	}
+
+	// Skip paths that are already known
+	size_t n_pending = 0;
+	for (size_t i = 0; i < n_paths; i++)
+	{
+		if (!is_file_info_cached(paths[i]))
+		{
+			pending[n_pending] = paths[i];
+			results[n_pending].error = NOT_FETCHED;
+			n_pending++;
+		}
+	}
+
+	int use_pool = 1;
+
+#ifdef HAVE_IO_URING
+	if (uring_stat_all(pending, results, n_pending) == 0)
+	{
+		use_pool = 0;
+		for (size_t i = 0; i < n_pending && !use_pool; i++)
+			use_pool = results[i].error == NOT_FETCHED;
+	}
+#endif
+
+	if (use_pool)
+		pool_stat_all(pending, results, n_pending);
+
+	for (size_t i = 0; i < n_pending; i++)
+	{
+		if (results[i].error != NOT_FETCHED)
+		{
+			store_file_info(pending[i], results[i].error, results[i].mtime,
+				results[i].size);
+			stats_add(STAT_STAT_CALLS, 1);
+		}
+	}
+
+	free(pending);
+	free(results);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+/**
+ * Prefetches file information for a known set of paths
+ * into the file handler's cache. All stat requests are
+ * submitted in batches through io_uring, so slow network
+ * or overlay filesystems can serve them concurrently. On
+ * systems without io_uring a small thread pool is used
+ * instead.
+ *
+ * @file prefetch.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+
+/**
+ * Stats all given paths concurrently and stores the results
+ * in the file handler's cache. Paths that are already cached
+ * are skipped. Any path that could not be prefetched is left
+ * for a regular lookup.
+ *
+ * @param paths		The paths to prefetch
+ * @param n_paths	The amount of paths
+ */
+void prefetch_file_info(const char **paths, size_t n_paths);
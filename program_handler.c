@@ -9,15 +9,68 @@
  * @date 2025.10.01
  */
 
+#include <getopt.h>
+#include <string.h>
+#include <sys/stat.h>
+
 #include "program_handler.h"
 
 #include "parser.h"
+#include "jobserver.h"
+#include "spawn.h"
+#include "trace.h"
+#include "stats.h"
 #define MAX_FILENAME_LEN 256
+#define IMAGE_SUFFIX ".mmimg"
+#define DEFAULT_CACHE_MB 1024
+#define BYTES_PER_MB (1024ULL * 1024)
+
+// Values for options that only have a long form
+enum longopt {
+	OPT_HASH = 256,
+	OPT_SPAWN_HELPER,
+	OPT_REPORT,
+	OPT_WATCH,
+	OPT_TRACE,
+	OPT_STATS,
+	OPT_OUTPUT_SYNC,
+	OPT_CACHE_DIR,
+	OPT_CACHE_SIZE,
+	OPT_WORKERS
+};
+
+static const struct option long_options[] = {
+	{ "hash", no_argument, NULL, OPT_HASH },
+	{ "spawn-helper", no_argument, NULL, OPT_SPAWN_HELPER },
+	{ "report", no_argument, NULL, OPT_REPORT },
+	{ "watch", no_argument, NULL, OPT_WATCH },
+	{ "trace", required_argument, NULL, OPT_TRACE },
+	{ "stats", no_argument, NULL, OPT_STATS },
+	{ "output-sync", required_argument, NULL, OPT_OUTPUT_SYNC },
+	{ "cache-dir", required_argument, NULL, OPT_CACHE_DIR },
+	{ "cache-size", required_argument, NULL, OPT_CACHE_SIZE },
+	{ "workers", required_argument, NULL, OPT_WORKERS },
+	{ NULL, 0, NULL, 0 }
+};
 
 typedef struct optioninfo {
 	int silence_commands; // Related to -s flag
 	int force_rebuild;    // Related to -B flag
+	int keep_going;       // Related to -k flag
+	int dry_run;          // Related to -n flag
+	int question;         // Related to -q flag
 	int custom_targets;   // Related to [TARGETS ...] arguments. 
+	int jobs;             // Related to -j flag, amount of job slots
+	int content_hash;     // Related to --hash flag
+	int spawn_helper;     // Related to --spawn-helper flag
+	int build_report;     // Related to --report flag
+	int watch;            // Related to --watch flag
+	int print_stats;      // Related to --stats flag
+	int output_sync;      // Related to --output-sync flag, an outputsync
+	                      //	or -1 for the default
+	char *cache_dir;      // Related to --cache-dir flag, or NULL
+	uint64_t cache_size;  // Related to --cache-size flag, in bytes
+	char *workers;        // Related to --workers flag, or NULL
 	char *makefile_name;  // Name of the makefile to parse
 } optioninfo;
 
@@ -33,14 +86,28 @@ optioninfo *get_option_info(int argc, char **argv)
 
 	options->silence_commands = 0;
 	options->force_rebuild = 0;
+	options->keep_going = 0;
+	options->dry_run = 0;
+	options->question = 0;
 	options->custom_targets = 0;
+	options->jobs = 1;
+	options->content_hash = 0;
+	options->spawn_helper = 0;
+	options->build_report = 0;
+	options->watch = 0;
+	options->print_stats = 0;
+	options->output_sync = -1;
+	options->cache_dir = NULL;
+	options->cache_size = DEFAULT_CACHE_MB * BYTES_PER_MB;
+	options->workers = NULL;
 	options->makefile_name = NULL;
 
 	int uses_custom_makefile = 0;
+	int requested_jobs = 0;
 	int opt = 0;
 
 	// Check flags
-	while ((opt = getopt(argc, argv, "sBf:")) != -1)
+	while ((opt = getopt_long(argc, argv, "sBknqf:j:", long_options, NULL)) != -1)
 	{
 		switch(opt)
 		{
@@ -50,12 +117,85 @@ optioninfo *get_option_info(int argc, char **argv)
 			case 'B':
 				options->force_rebuild = 1;
 				break;
+			case 'k':
+				options->keep_going = 1;
+				break;
+			case 'n':
+				options->dry_run = 1;
+				break;
+			case 'q':
+				options->question = 1;
+				break;
 			case 'f':
 				uses_custom_makefile = 1;
 				options->makefile_name = strdup(optarg);
 				break;
+			case 'j':
+				requested_jobs = atoi(optarg);
+				if (requested_jobs < 1)
+				{
+					fprintf(stderr, "Invalid job count '%s'\n", optarg);
+					free_option_info(&options);
+					return NULL;
+				}
+				break;
+			case OPT_HASH:
+				options->content_hash = 1;
+				break;
+			case OPT_SPAWN_HELPER:
+				options->spawn_helper = 1;
+				break;
+			case OPT_REPORT:
+				options->build_report = 1;
+				break;
+			case OPT_WATCH:
+				options->watch = 1;
+				break;
+			case OPT_STATS:
+				options->print_stats = 1;
+				break;
+			case OPT_OUTPUT_SYNC:
+				if (strcmp(optarg, "none") == 0)
+					options->output_sync = OUTPUT_NONE;
+				else if (strcmp(optarg, "completion") == 0)
+					options->output_sync = OUTPUT_COMPLETION;
+				else if (strcmp(optarg, "makefile") == 0)
+					options->output_sync = OUTPUT_MAKEFILE;
+				else
+				{
+					fprintf(stderr, "Invalid output sync '%s', expected none, "
+						"completion or makefile\n", optarg);
+					free_option_info(&options);
+					return NULL;
+				}
+				break;
+			case OPT_CACHE_DIR:
+				free(options->cache_dir);
+				options->cache_dir = strdup(optarg);
+				break;
+			case OPT_CACHE_SIZE:
+				if (atoi(optarg) < 1)
+				{
+					fprintf(stderr, "Invalid cache size '%s'\n", optarg);
+					free_option_info(&options);
+					return NULL;
+				}
+				options->cache_size = atoi(optarg) * BYTES_PER_MB;
+				break;
+			case OPT_WORKERS:
+				free(options->workers);
+				options->workers = strdup(optarg);
+				break;
+			case OPT_TRACE:
+				if (!trace_enabled() && trace_open(optarg) != 0)
+				{
+					perror("Couldn't open trace file");
+					free_option_info(&options);
+					return NULL;
+				}
+				break;
 			default:
-				fprintf(stderr, "Usage: %s [-f FILENAME] -s -B\n", argv[0]);
+				fprintf(stderr, "Usage: %s [-f FILENAME] [-j JOBS] -s -B -k -n -q [--hash] [--spawn-helper] [--report] [--watch] [--trace FILE] [--stats] [--output-sync MODE] [--cache-dir DIR] [--cache-size MB] [--workers LIST]\n", argv[0]);
 				free_option_info(&options);
 				return NULL;
 		}
@@ -74,9 +214,24 @@ optioninfo *get_option_info(int argc, char **argv)
 		}
 	}
 	// Check if targets have been given
-	if (argc - 1 > optind)
+	if (argc > optind)
 		options->custom_targets = 1;
 
+	// Join or create a jobserver to share the job limit with
+	//	nested make processes
+	options->jobs = jobserver_init(requested_jobs);
+
+	// Output only needs to be kept apart if jobs run in parallel
+	if (options->output_sync == -1)
+		options->output_sync = options->jobs > 1 ? OUTPUT_COMPLETION : OUTPUT_NONE;
+
+	// Fork the spawn helper now, while the process is small and
+	//	after MAKEFLAGS has been set for the commands it starts.
+	//	With -n or -q no command is started, so nothing is forked
+	if (options->spawn_helper && !options->dry_run && !options->question
+		&& spawn_helper_start() != 0)
+		perror("Couldn't start spawn helper");
+
 	return options;
 }
 
@@ -88,16 +243,64 @@ int uses_flag(optioninfo *options, flagtype flag)
 			return options->silence_commands;
 		case FORCE_REBUILD:
 			return options->force_rebuild;
+		case KEEP_GOING:
+			return options->keep_going;
+		case DRY_RUN:
+			return options->dry_run;
+		case QUESTION:
+			return options->question;
 		case CUSTOM_TARGETS:
 			return options->custom_targets;
+		case CONTENT_HASH:
+			return options->content_hash;
+		case SPAWN_HELPER:
+			return options->spawn_helper;
+		case BUILD_REPORT:
+			return options->build_report;
+		case WATCH:
+			return options->watch;
+		case PRINT_STATS:
+			return options->print_stats;
 	}
 
 	return 0;
 }
 
+const char *get_makefile_name(optioninfo *options)
+{
+	return options->makefile_name;
+}
+
+int get_job_count(optioninfo *options)
+{
+	return options->jobs;
+}
+
+outputsync get_output_sync(optioninfo *options)
+{
+	return options->output_sync;
+}
+
+const char *get_cache_dir(optioninfo *options)
+{
+	return options->cache_dir;
+}
+
+uint64_t get_cache_size(optioninfo *options)
+{
+	return options->cache_size;
+}
+
+const char *get_workers(optioninfo *options)
+{
+	return options->workers;
+}
+
 makefile *get_makefile(optioninfo *options)
 {
+	uint64_t phase_start = stats_clock();
 	FILE *fptr = fopen(options->makefile_name, "r");
+	stats_add(STAT_OPEN_CALLS, 1);
 
 	if (fptr == NULL)
 	{
@@ -105,9 +308,46 @@ makefile *get_makefile(optioninfo *options)
 		return NULL;
 	}
 
-	makefile *mfile = parse_makefile(fptr);
+	// A makefile that hasn't changed since the last run is loaded
+	//	from the image saved by that run instead of being parsed
+	struct stat key;
+	int has_key = fstat(fileno(fptr), &key) == 0;
+
+	size_t image_len = strlen(options->makefile_name) + sizeof(IMAGE_SUFFIX);
+	char *image_path = has_key ? malloc(image_len) : NULL;
+
+	if (image_path != NULL)
+		snprintf(image_path, image_len, "%s" IMAGE_SUFFIX, options->makefile_name);
+
+	makefile *mfile = NULL;
+
+	uint64_t start = trace_now();
+
+	if (image_path != NULL)
+		mfile = makefile_load_image(image_path, options->makefile_name, &key);
+
+	if (mfile != NULL)
+		trace_span("makefile_load_image", "parse", TRACE_MAIN_TRACK, start, trace_now());
+	else
+	{
+		start = trace_now();
+		mfile = parse_makefile(fptr);
+		trace_span("parse_makefile", "parse", TRACE_MAIN_TRACK, start, trace_now());
+
+		// Nothing is written with -n or -q
+		if (mfile != NULL && image_path != NULL && !options->dry_run
+			&& !options->question)
+		{
+			start = trace_now();
+			makefile_save_image(mfile, image_path, options->makefile_name, &key);
+			trace_span("makefile_save_image", "parse", TRACE_MAIN_TRACK, start,
+				trace_now());
+		}
+	}
 
 	fclose(fptr);
+	free(image_path);
+	stats_end_phase(PHASE_PARSE, phase_start);
 
 	if (mfile == NULL)
 	{
@@ -120,6 +360,8 @@ makefile *get_makefile(optioninfo *options)
 
 void free_option_info(optioninfo **options_ptr)
 {
+	free((*options_ptr)->cache_dir);
+	free((*options_ptr)->workers);
 	free((*options_ptr)->makefile_name);
 	free(*options_ptr);
 	*options_ptr = NULL;
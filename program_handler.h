@@ -12,6 +12,7 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -23,9 +24,23 @@ typedef struct optioninfo optioninfo;
 typedef enum flagtype {
 	SILENCE_COMMANDS,
 	FORCE_REBUILD,
-	CUSTOM_TARGETS
+	KEEP_GOING,
+	CUSTOM_TARGETS,
+	CONTENT_HASH,
+	SPAWN_HELPER,
+	BUILD_REPORT,
+	DRY_RUN,
+	QUESTION,
+	WATCH,
+	PRINT_STATS
 } flagtype;
 
+typedef enum outputsync {
+	OUTPUT_NONE,           // Commands write to the output of 'mmake'
+	OUTPUT_COMPLETION,     // Output is shown as each job finishes
+	OUTPUT_MAKEFILE        // Output is shown in the order of the plan
+} outputsync;
+
 /**
  * Parses the flags given when running the 'mmake'
  * program and returns related informatio 
@@ -49,6 +64,70 @@ optioninfo *get_option_info(int argc, char **argv);
  */
 int uses_flag(optioninfo *options, flagtype flag);
 
+/**
+ * Gets the name of the makefile to use, as specified with
+ * the -f flag. Defaults to "mmakefile".
+ *
+ * @param options	Information about the program's flags
+ *
+ * @return		The name of the makefile
+ */
+const char *get_makefile_name(optioninfo *options);
+
+/**
+ * Gets the maximum amount of jobs that may run in parallel,
+ * as specified with the -j flag. Defaults to 1, unless a
+ * jobserver was inherited through MAKEFLAGS, in which case
+ * the jobserver's tokens limit the parallelism instead.
+ *
+ * @param options	Information about the program's flags
+ *
+ * @return		The maximum amount of parallel jobs
+ */
+int get_job_count(optioninfo *options);
+
+/**
+ * Gets how the output of commands is kept apart, as specified
+ * with the --output-sync flag. Defaults to OUTPUT_COMPLETION
+ * when more than one job may run, else OUTPUT_NONE.
+ *
+ * @param options	Information about the program's flags
+ *
+ * @return		The output sync mode
+ */
+outputsync get_output_sync(optioninfo *options);
+
+/**
+ * Gets the directory of the result cache, as specified with
+ * the --cache-dir flag.
+ *
+ * @param options	Information about the program's flags
+ *
+ * @return		The directory, or NULL if no cache is used
+ */
+const char *get_cache_dir(optioninfo *options);
+
+/**
+ * Gets the size the result cache is trimmed to, as specified
+ * in megabytes with the --cache-size flag. Defaults to 1 GiB.
+ *
+ * @param options	Information about the program's flags
+ *
+ * @return		The size in bytes
+ */
+uint64_t get_cache_size(optioninfo *options);
+
+/**
+ * Gets the addresses of the workers to send jobs to, as
+ * specified with the --workers flag.
+ *
+ * @param options	Information about the program's flags
+ *
+ * @return		The addresses separated by commas, or NULL if
+ *				all jobs are run locally
+ */
+const char *get_workers(optioninfo *options);
+
 /**
  * Opens and parses a makefile. Will use the filename from the
  * optioninfo instance. Will return NULL if any errors occurs.
@@ -0,0 +1,297 @@
+/**
+ * The protocol between the 'mmake' program and its workers,
+ * which run jobs for it, e.g. on other hosts. See remote.h
+ * for the layout of the frames.
+ *
+ * Frames are written with MSG_NOSIGNAL, so a worker that goes
+ * away is seen as a failed write instead of killing 'mmake'
+ * with SIGPIPE.
+ *
+ * @file remote.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "remote.h"
+
+#define UNIX_PREFIX "unix:"
+#define LISTEN_BACKLOG 64
+
+// * Internal functions
+
+/**
+ * Fills in a Unix socket address.
+ *
+ * @param path		The path of the socket
+ * @param addr		The address to fill in
+ *
+ * @return			0 on success, 1 if the path is too long.
+ */
+static int unix_address(const char *path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+
+	if (strlen(path) >= sizeof(addr->sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return 1;
+	}
+
+	strcpy(addr->sun_path, path);
+
+	return 0;
+}
+
+/**
+ * Looks up the TCP addresses of a "HOST:PORT" address.
+ *
+ * @param address	The address
+ * @param passive	Set to look up addresses to listen on
+ *
+ * @return			The addresses, which must be freed with
+ *					freeaddrinfo, or NULL on error.
+ */
+static struct addrinfo *tcp_addresses(const char *address, int passive)
+{
+	const char *colon = strrchr(address, ':');
+	if (colon == NULL)
+	{
+		fprintf(stderr, "Invalid address '%s', expected HOST:PORT or unix:PATH\n",
+			address);
+		return NULL;
+	}
+
+	char *host = strndup(address, colon - address);
+	if (host == NULL)
+		return NULL;
+
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_STREAM,
+		.ai_flags = passive ? AI_PASSIVE : 0
+	};
+	struct addrinfo *found = NULL;
+
+	int error = getaddrinfo(host[0] == '\0' ? NULL : host, colon + 1, &hints, &found);
+	if (error != 0)
+	{
+		fprintf(stderr, "Couldn't look up '%s': %s\n", address, gai_strerror(error));
+		found = NULL;
+	}
+
+	free(host);
+
+	return found;
+}
+
+// * Visible functions
+
+void remote_put_u32(unsigned char *buf, uint32_t value)
+{
+	for (int i = 3; i >= 0; i--)
+	{
+		buf[i] = value & 0xff;
+		value >>= 8;
+	}
+}
+
+uint32_t remote_get_u32(const unsigned char *buf)
+{
+	uint32_t value = 0;
+
+	for (int i = 0; i < 4; i++)
+		value = value << 8 | buf[i];
+
+	return value;
+}
+
+void remote_put_u64(unsigned char *buf, uint64_t value)
+{
+	remote_put_u32(buf, value >> 32);
+	remote_put_u32(buf + 4, value & 0xffffffff);
+}
+
+uint64_t remote_get_u64(const unsigned char *buf)
+{
+	return (uint64_t)remote_get_u32(buf) << 32 | remote_get_u32(buf + 4);
+}
+
+int remote_write_frame(int fd, frametype type, const void *head, size_t head_len,
+	const void *body, size_t body_len)
+{
+	if (head_len + body_len > REMOTE_MAX_FRAME)
+		return 1;
+
+	unsigned char header[8];
+	remote_put_u32(header, type);
+	remote_put_u32(header + 4, head_len + body_len);
+
+	struct iovec iov[3] = {
+		{ header, sizeof(header) },
+		{ (void *)head, head_len },
+		{ (void *)body, body_len }
+	};
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 3 };
+
+	while (msg.msg_iovlen > 0)
+	{
+		ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return 1;
+		}
+
+		// Skip what was written, which may end inside a part
+		while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len)
+		{
+			n -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+
+		if (msg.msg_iovlen > 0)
+		{
+			msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+			msg.msg_iov->iov_len -= n;
+		}
+	}
+
+	return 0;
+}
+
+int remote_read_header(int fd, frameheader *header)
+{
+	unsigned char buf[8];
+
+	if (remote_read_full(fd, buf, sizeof(buf)) != 0)
+		return 1;
+
+	header->type = remote_get_u32(buf);
+	header->len = remote_get_u32(buf + 4);
+
+	return header->len > REMOTE_MAX_FRAME;
+}
+
+int remote_read_full(int fd, void *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = read(fd, buf, len);
+
+		if (n <= 0 && !(n == -1 && errno == EINTR))
+			return 1;
+
+		if (n > 0)
+		{
+			buf = (char *)buf + n;
+			len -= n;
+		}
+	}
+
+	return 0;
+}
+
+int remote_connect(const char *address)
+{
+	if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+	{
+		struct sockaddr_un addr;
+		if (unix_address(address + strlen(UNIX_PREFIX), &addr) != 0)
+			return -1;
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd != -1 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+
+		return fd;
+	}
+
+	struct addrinfo *found = tcp_addresses(address, 0);
+	int fd = -1;
+
+	for (struct addrinfo *ai = found; ai != NULL && fd == -1; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	// Requests are written in several frames, which shouldn't wait
+	//	for each other's acknowledgements
+	int on = 1;
+	if (fd != -1)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	if (found != NULL)
+		freeaddrinfo(found);
+
+	return fd;
+}
+
+int remote_listen(const char *address)
+{
+	if (strncmp(address, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0)
+	{
+		struct sockaddr_un addr;
+		if (unix_address(address + strlen(UNIX_PREFIX), &addr) != 0)
+			return -1;
+
+		// A socket left behind by an earlier worker is replaced
+		unlink(addr.sun_path);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd != -1 && (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+			|| listen(fd, LISTEN_BACKLOG) != 0))
+		{
+			close(fd);
+			fd = -1;
+		}
+
+		return fd;
+	}
+
+	struct addrinfo *found = tcp_addresses(address, 1);
+	int fd = -1;
+
+	for (struct addrinfo *ai = found; ai != NULL && fd == -1; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+
+		int on = 1;
+		if (fd != -1 && (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+			|| bind(fd, ai->ai_addr, ai->ai_addrlen) != 0
+			|| listen(fd, LISTEN_BACKLOG) != 0))
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	if (found != NULL)
+		freeaddrinfo(found);
+
+	return fd;
+}
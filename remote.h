@@ -0,0 +1,139 @@
+#pragma once
+
+/**
+ * The protocol between the 'mmake' program and its workers,
+ * which run jobs for it, e.g. on other hosts. A connection
+ * carries one job at a time, as a stream of frames that each
+ * start with a type and the length of their payload.
+ *
+ * A job request is a frame for every argument of the command,
+ * one for the working directory, one for every input file and
+ * one for the target, and ends with a RUN frame. An input is
+ * sent with its contents the first time, and as a reference
+ * to those contents by hash after that. The reply streams the
+ * output and errors of the command in OUTPUT and ERROR frames,
+ * then the target file, if the command made one, and ends
+ * with the status.
+ *
+ * All numbers are sent in network byte order.
+ *
+ * Addresses are either "unix:PATH" for a Unix socket or
+ * "HOST:PORT" for TCP.
+ *
+ * @file remote.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest payload accepted, as a guard against corrupt streams
+#define REMOTE_MAX_FRAME (1U << 31)
+
+typedef enum frametype {
+	FRAME_ARG = 1,         // An argument of the command
+	FRAME_CWD,             // Working directory of the client
+	FRAME_INPUT,           // Mode, hash, name length, name and contents
+	FRAME_INPUT_REF,       // Mode, hash and name of contents sent before
+	FRAME_TARGET,          // Name of the file the command makes
+	FRAME_RUN,             // Ends a request
+	FRAME_OUTPUT,          // Output of the command
+	FRAME_FILE,            // Mode and contents of the target
+	FRAME_STATUS,          // Wait status of the command, ends a reply
+	FRAME_ERROR            // Standard error output of the command
+} frametype;
+
+typedef struct frameheader {
+	uint32_t type;           // A frametype
+	uint32_t len;            // Length of the payload that follows
+} frameheader;
+
+/**
+ * Stores a 32-bit number in network byte order.
+ *
+ * @param buf		Where to store it, 4 bytes
+ * @param value		The number
+ */
+void remote_put_u32(unsigned char *buf, uint32_t value);
+
+/**
+ * Loads a 32-bit number stored in network byte order.
+ *
+ * @param buf		Where it's stored, 4 bytes
+ *
+ * @return			The number
+ */
+uint32_t remote_get_u32(const unsigned char *buf);
+
+/**
+ * Stores a 64-bit number in network byte order.
+ *
+ * @param buf		Where to store it, 8 bytes
+ * @param value		The number
+ */
+void remote_put_u64(unsigned char *buf, uint64_t value);
+
+/**
+ * Loads a 64-bit number stored in network byte order.
+ *
+ * @param buf		Where it's stored, 8 bytes
+ *
+ * @return			The number
+ */
+uint64_t remote_get_u64(const unsigned char *buf);
+
+/**
+ * Writes a frame, blocking until it has been written.
+ *
+ * @param fd		The connection
+ * @param type		The type of the frame
+ * @param head		The start of the payload, may be NULL if empty
+ * @param head_len	The length of the start of the payload
+ * @param body		The rest of the payload, may be NULL if empty
+ * @param body_len	The length of the rest of the payload
+ *
+ * @return			0 on success, else 1.
+ */
+int remote_write_frame(int fd, frametype type, const void *head, size_t head_len,
+	const void *body, size_t body_len);
+
+/**
+ * Reads the header of the next frame, blocking until it has
+ * been read.
+ *
+ * @param fd		The connection
+ * @param header	Set to the header, in host byte order
+ *
+ * @return			0 on success, 1 on error or end of stream.
+ */
+int remote_read_header(int fd, frameheader *header);
+
+/**
+ * Reads exactly the given amount of bytes, e.g. a payload.
+ *
+ * @param fd		The connection
+ * @param buf		The buffer to read into
+ * @param len		The amount of bytes to read
+ *
+ * @return			0 on success, 1 on error or end of stream.
+ */
+int remote_read_full(int fd, void *buf, size_t len);
+
+/**
+ * Connects to a worker.
+ *
+ * @param address	The address of the worker
+ *
+ * @return			The connection, or -1 on error.
+ */
+int remote_connect(const char *address);
+
+/**
+ * Creates a socket accepting connections on an address.
+ *
+ * @param address	The address to listen on
+ *
+ * @return			The listening socket, or -1 on error.
+ */
+int remote_listen(const char *address);
@@ -0,0 +1,288 @@
+/**
+ * Character scanning primitives used by the makefile parser
+ * of the 'mmake' program. Besides a plain byte-at-a-time
+ * version, the module has versions that test 16 (SSE2) or
+ * 32 (AVX2) bytes at a time. The fastest version supported
+ * by the processor is chosen the first time it is needed.
+ *
+ * A vector version loads whole blocks only while they lie
+ * within the scanned text and leaves the tail to the plain
+ * version, so it never reads past the end of a mapping.
+ *
+ * @file scan.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef struct scanner {
+	const char *name;
+	const char *(*word_end)(const char *p, const char *end, char delim);
+	const char *(*skip_space)(const char *p, const char *end);
+	int (*supported)(void);
+} scanner;
+
+// * Internal functions
+
+/**
+ * Tells that a version of the scanning functions can always
+ * be used.
+ *
+ * @return			1
+ */
+static int always_supported(void)
+{
+	return 1;
+}
+
+/**
+ * Finds the end of a word one byte at a time. This is the
+ * reference that every other version must agree with.
+ *
+ * @param p			The start of the word
+ * @param end		The end of the text to scan
+ * @param delim		An extra delimiter, or '\0' for none
+ *
+ * @return			A pointer to the end of the word, or end.
+ */
+static const char *word_end_scalar(const char *p, const char *end, char delim)
+{
+	while (p < end && !isspace((unsigned char)*p) && *p != '\0' && *p != delim)
+		p++;
+
+	return p;
+}
+
+/**
+ * Skips past whitespace one byte at a time.
+ *
+ * @param p			The start of the text to scan
+ * @param end		The end of the text to scan
+ *
+ * @return			A pointer to the first character that isn't
+ *					whitespace, or end.
+ */
+static const char *skip_space_scalar(const char *p, const char *end)
+{
+	while (p < end && isspace((unsigned char)*p))
+		p++;
+
+	return p;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * Whitespace is ' ' and the range '\t' to '\r'. The range is
+ * tested with one unsigned comparison: c - '\t' <= 4, where
+ * min(x, 4) == x is the unsigned x <= 4 that SSE2 lacks.
+ */
+
+/**
+ * Checks if the processor supports SSE2.
+ *
+ * @return			Non-zero if it does, else 0.
+ */
+static int sse2_supported(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+/**
+ * Marks the whitespace bytes of a 16-byte block.
+ *
+ * @param v			The block
+ *
+ * @return			0xff for every whitespace byte, else 0.
+ */
+__attribute__((target("sse2")))
+static inline __m128i space_mask_sse2(__m128i v)
+{
+	__m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+	__m128i in_range = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+
+	return _mm_or_si128(in_range, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+/**
+ * Finds the end of a word 16 bytes at a time.
+ * See word_end_scalar.
+ */
+__attribute__((target("sse2")))
+static const char *word_end_sse2(const char *p, const char *end, char delim)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i d = _mm_set1_epi8(delim);
+
+	while (end - p >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i hit = _mm_or_si128(space_mask_sse2(v),
+			_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, d)));
+		unsigned mask = _mm_movemask_epi8(hit);
+
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+
+		p += 16;
+	}
+
+	return word_end_scalar(p, end, delim);
+}
+
+/**
+ * Skips past whitespace 16 bytes at a time.
+ * See skip_space_scalar.
+ */
+__attribute__((target("sse2")))
+static const char *skip_space_sse2(const char *p, const char *end)
+{
+	while (end - p >= 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		unsigned mask = ~_mm_movemask_epi8(space_mask_sse2(v)) & 0xffff;
+
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+
+		p += 16;
+	}
+
+	return skip_space_scalar(p, end);
+}
+
+/**
+ * Checks if the processor supports AVX2.
+ *
+ * @return			Non-zero if it does, else 0.
+ */
+static int avx2_supported(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+/**
+ * Marks the whitespace bytes of a 32-byte block.
+ *
+ * @param v			The block
+ *
+ * @return			0xff for every whitespace byte, else 0.
+ */
+__attribute__((target("avx2")))
+static inline __m256i space_mask_avx2(__m256i v)
+{
+	__m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+	__m256i in_range = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+
+	return _mm256_or_si256(in_range, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+/**
+ * Finds the end of a word 32 bytes at a time.
+ * See word_end_scalar.
+ */
+__attribute__((target("avx2")))
+static const char *word_end_avx2(const char *p, const char *end, char delim)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i d = _mm256_set1_epi8(delim);
+
+	while (end - p >= 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i hit = _mm256_or_si256(space_mask_avx2(v),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(v, d)));
+		unsigned mask = _mm256_movemask_epi8(hit);
+
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+
+		p += 32;
+	}
+
+	return word_end_sse2(p, end, delim);
+}
+
+/**
+ * Skips past whitespace 32 bytes at a time.
+ * See skip_space_scalar.
+ */
+__attribute__((target("avx2")))
+static const char *skip_space_avx2(const char *p, const char *end)
+{
+	while (end - p >= 32)
+	{
+		unsigned mask = ~_mm256_movemask_epi8(space_mask_avx2(
+			_mm256_loadu_si256((const __m256i *)p)));
+
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+
+		p += 32;
+	}
+
+	return skip_space_sse2(p, end);
+}
+
+#endif
+
+// Ordered from fastest to slowest
+static const scanner scanners[] = {
+#ifdef HAVE_X86_SIMD
+	{ "avx2", word_end_avx2, skip_space_avx2, avx2_supported },
+	{ "sse2", word_end_sse2, skip_space_sse2, sse2_supported },
+#endif
+	{ "scalar", word_end_scalar, skip_space_scalar, always_supported }
+};
+
+static const scanner *current = NULL;
+
+// * Visible functions
+
+const char *scan_word_end(const char *p, const char *end, char delim)
+{
+	if (current == NULL)
+		scan_select(NULL);
+
+	return current->word_end(p, end, delim);
+}
+
+const char *scan_skip_space(const char *p, const char *end)
+{
+	if (current == NULL)
+		scan_select(NULL);
+
+	return current->skip_space(p, end);
+}
+
+int scan_select(const char *name)
+{
+	for (size_t i = 0; i < sizeof(scanners) / sizeof(scanners[0]); i++)
+	{
+		if ((name == NULL || strcmp(scanners[i].name, name) == 0)
+			&& scanners[i].supported())
+		{
+			current = &scanners[i];
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+const char *scan_name(void)
+{
+	if (current == NULL)
+		scan_select(NULL);
+
+	return current->name;
+}
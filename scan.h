@@ -0,0 +1,60 @@
+#pragma once
+
+/**
+ * Character scanning primitives used by the makefile parser
+ * of the 'mmake' program. Besides a plain byte-at-a-time
+ * version, the module has versions that test 16 (SSE2) or
+ * 32 (AVX2) bytes at a time. The fastest version supported
+ * by the processor is chosen the first time it is needed.
+ *
+ * Every version gives exactly the same results. Whitespace
+ * is what isspace considers whitespace in the "C" locale.
+ *
+ * @file scan.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+
+/**
+ * Finds the end of a word, i.e. the first character that is
+ * whitespace, a NULL character or the given delimiter.
+ *
+ * @param p			The start of the word
+ * @param end		The end of the text to scan
+ * @param delim		An extra delimiter, or '\0' for none
+ *
+ * @return			A pointer to the end of the word, or end.
+ */
+const char *scan_word_end(const char *p, const char *end, char delim);
+
+/**
+ * Skips past whitespace.
+ *
+ * @param p			The start of the text to scan
+ * @param end		The end of the text to scan
+ *
+ * @return			A pointer to the first character that isn't
+ *					whitespace, or end.
+ */
+const char *scan_skip_space(const char *p, const char *end);
+
+/**
+ * Chooses the version of the scanning functions to use.
+ *
+ * @param name		"scalar", "sse2" or "avx2", or NULL for the
+ *					fastest version supported by the processor
+ *
+ * @return			0 on success, 1 if the version is unknown or
+ *					not supported by the processor.
+ */
+int scan_select(const char *name);
+
+/**
+ * Gets the name of the version of the scanning functions in
+ * use, choosing one first if none has been chosen yet.
+ *
+ * @return			The name of the version
+ */
+const char *scan_name(void);
@@ -0,0 +1,296 @@
+/**
+ * The signature database stores content hashes between runs
+ * of the 'mmake' program. For every file it remembers the
+ * size, time of last modification and hash of the contents,
+ * so unchanged files never have to be hashed again. For
+ * every target it remembers a signature of the contents of
+ * its prerequisites at the time it was last built.
+ *
+ * The database is kept in memory during the run and written
+ * back to disk in one go when it is closed.
+ *
+ * @file sigdb.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sigdb.h"
+#include "hash.h"
+
+#define SIGDB_MAGIC "MMSIGDB1"
+#define SIGDB_MAGIC_LEN 8
+#define MIN_TABLE_SIZE 64
+#define MAX_PATH_LEN 4096
+
+#define HAS_CONTENT 1
+#define HAS_SIGNATURE 2
+
+typedef struct record {
+	uint32_t path_len;       // Length of the path following the record
+	uint32_t flags;          // Which of the fields below are set
+	uint64_t size;           // Size of the file when it was hashed
+	int64_t mtime_sec;       // Time of last modification when hashed
+	int64_t mtime_nsec;
+	uint64_t content;        // Hash of the file's contents
+	uint64_t signature;      // Prerequisite signature of the target
+} record;
+
+typedef struct entry {
+	char *path;              // The file or target, NULL if empty
+	record rec;              // The stored information
+} entry;
+
+typedef struct sigdb {
+	char *path;              // Path of the database file
+	entry *entries;          // Open-addressing hash table of paths
+	size_t size;             // Size of the table, a power of two
+	size_t used;             // Amount of occupied slots
+	int dirty;               // Set if the database has changed
+	int read_only;           // Set if the file is never written
+} sigdb;
+
+// * Internal functions
+
+/**
+ * Finds the slot for a path. The slot either holds the entry
+ * for that path or is empty.
+ *
+ * @param entries	The hash table to search
+ * @param size		The size of the table
+ * @param path		The path to look for
+ *
+ * @return			A pointer to the slot
+ */
+static entry *find_slot(entry *entries, size_t size, const char *path)
+{
+	size_t i = hash_string(path) & (size - 1);
+
+	while (entries[i].path != NULL && strcmp(entries[i].path, path) != 0)
+		i = (i + 1) & (size - 1);
+
+	return &entries[i];
+}
+
+/**
+ * Gets the entry for a path, creating an empty one if the path
+ * is not in the database yet.
+ *
+ * @param db		The signature database
+ * @param path		The path of the entry
+ *
+ * @return			A pointer to the entry, or NULL on error.
+ */
+static entry *get_entry(sigdb *db, const char *path)
+{
+	// Keep the table at most half full
+	if (2 * (db->used + 1) > db->size)
+	{
+		size_t new_size = db->size == 0 ? MIN_TABLE_SIZE : db->size * 2;
+		entry *new_entries = calloc(new_size, sizeof(*new_entries));
+
+		if (new_entries == NULL)
+			return NULL;
+
+		for (size_t i = 0; i < db->size; i++)
+		{
+			if (db->entries[i].path != NULL)
+				*find_slot(new_entries, new_size, db->entries[i].path) = db->entries[i];
+		}
+
+		free(db->entries);
+		db->entries = new_entries;
+		db->size = new_size;
+	}
+
+	entry *slot = find_slot(db->entries, db->size, path);
+
+	if (slot->path == NULL)
+	{
+		slot->path = strdup(path);
+		if (slot->path == NULL)
+			return NULL;
+
+		memset(&slot->rec, 0, sizeof(slot->rec));
+		db->used++;
+	}
+
+	return slot;
+}
+
+/**
+ * Loads all records of a database file into memory. Loading
+ * stops at the first malformed record.
+ *
+ * @param db		The signature database
+ * @param fp		The opened database file
+ */
+static void load_records(sigdb *db, FILE *fp)
+{
+	char magic[SIGDB_MAGIC_LEN];
+	if (fread(magic, 1, SIGDB_MAGIC_LEN, fp) != SIGDB_MAGIC_LEN
+		|| memcmp(magic, SIGDB_MAGIC, SIGDB_MAGIC_LEN) != 0)
+		return;
+
+	record rec;
+	char path[MAX_PATH_LEN];
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1)
+	{
+		if (rec.path_len == 0 || rec.path_len >= MAX_PATH_LEN
+			|| fread(path, 1, rec.path_len, fp) != rec.path_len)
+			return;
+
+		path[rec.path_len] = '\0';
+
+		entry *slot = get_entry(db, path);
+		if (slot == NULL)
+			return;
+
+		slot->rec = rec;
+	}
+}
+
+// * Visible functions
+
+sigdb *sigdb_open(const char *path, int read_only)
+{
+	sigdb *db = calloc(1, sizeof(*db));
+
+	if (db == NULL || (db->path = strdup(path)) == NULL)
+	{
+		perror("Allocation failed");
+		free(db);
+		return NULL;
+	}
+
+	db->read_only = read_only;
+
+	FILE *fp = fopen(path, "rb");
+	if (fp != NULL)
+	{
+		load_records(db, fp);
+		fclose(fp);
+	}
+
+	return db;
+}
+
+int sigdb_file_hash(sigdb *db, const char *filename, off_t size,
+	struct timespec mtime, uint64_t *hash)
+{
+	entry *slot = get_entry(db, filename);
+
+	// Unchanged size and time of last modification means the
+	//	stored hash can be trusted without reading the file
+	if (slot != NULL && (slot->rec.flags & HAS_CONTENT)
+		&& slot->rec.size == (uint64_t)size
+		&& slot->rec.mtime_sec == mtime.tv_sec
+		&& slot->rec.mtime_nsec == mtime.tv_nsec)
+	{
+		*hash = slot->rec.content;
+		return 0;
+	}
+
+	if (hash_file(filename, hash) != 0)
+		return 1;
+
+	if (slot != NULL)
+	{
+		slot->rec.flags |= HAS_CONTENT;
+		slot->rec.size = size;
+		slot->rec.mtime_sec = mtime.tv_sec;
+		slot->rec.mtime_nsec = mtime.tv_nsec;
+		slot->rec.content = *hash;
+		db->dirty = 1;
+	}
+
+	return 0;
+}
+
+int sigdb_get_signature(sigdb *db, const char *target, uint64_t *signature)
+{
+	if (db->size == 0)
+		return 0;
+
+	entry *slot = find_slot(db->entries, db->size, target);
+
+	if (slot->path == NULL || !(slot->rec.flags & HAS_SIGNATURE))
+		return 0;
+
+	*signature = slot->rec.signature;
+
+	return 1;
+}
+
+void sigdb_set_signature(sigdb *db, const char *target, uint64_t signature)
+{
+	entry *slot = get_entry(db, target);
+
+	if (slot == NULL)
+		return;
+
+	if (!(slot->rec.flags & HAS_SIGNATURE) || slot->rec.signature != signature)
+	{
+		slot->rec.flags |= HAS_SIGNATURE;
+		slot->rec.signature = signature;
+		db->dirty = 1;
+	}
+}
+
+int sigdb_close(sigdb *db)
+{
+	int result = 0;
+
+	if (db->dirty && !db->read_only)
+	{
+		// Write to a temporary file first, so that an interrupted
+		//	write never leaves a broken database behind
+		size_t tmp_len = strlen(db->path) + sizeof(".tmp");
+		char *tmp_path = malloc(tmp_len);
+		FILE *fp = NULL;
+
+		if (tmp_path != NULL)
+		{
+			snprintf(tmp_path, tmp_len, "%s.tmp", db->path);
+			fp = fopen(tmp_path, "wb");
+		}
+
+		if (fp == NULL)
+			result = 1;
+		else
+		{
+			fwrite(SIGDB_MAGIC, 1, SIGDB_MAGIC_LEN, fp);
+
+			for (size_t i = 0; i < db->size; i++)
+			{
+				entry *slot = &db->entries[i];
+				if (slot->path == NULL || slot->rec.flags == 0)
+					continue;
+
+				slot->rec.path_len = strlen(slot->path);
+				fwrite(&slot->rec, sizeof(slot->rec), 1, fp);
+				fwrite(slot->path, 1, slot->rec.path_len, fp);
+			}
+
+			if (fclose(fp) != 0 || rename(tmp_path, db->path) != 0)
+				result = 1;
+		}
+
+		if (result != 0)
+			fprintf(stderr, "Couldn't write '%s'\n", db->path);
+
+		free(tmp_path);
+	}
+
+	for (size_t i = 0; i < db->size; i++)
+		free(db->entries[i].path);
+
+	free(db->entries);
+	free(db->path);
+	free(db);
+
+	return result;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+/**
+ * The signature database stores content hashes between runs
+ * of the 'mmake' program. For every file it remembers the
+ * size, time of last modification and hash of the contents,
+ * so unchanged files never have to be hashed again. For
+ * every target it remembers a signature of the contents of
+ * its prerequisites at the time it was last built.
+ *
+ * The database is kept in memory during the run and written
+ * back to disk in one go when it is closed.
+ *
+ * @file sigdb.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+
+typedef struct sigdb sigdb;
+
+/**
+ * Opens a signature database, loading its contents if the
+ * file exists. A missing or unreadable file results in an
+ * empty database.
+ *
+ * @param path		The path of the database file
+ * @param read_only	Set to never write the file, e.g. with -n,
+ *					changes are then only kept in memory
+ *
+ * @return			A pointer to the database, or NULL on error.
+ */
+sigdb *sigdb_open(const char *path, int read_only);
+
+/**
+ * Gets the hash of a file's contents. The stored hash is used
+ * if the file's size and time of last modification match the
+ * ones recorded with it, else the file is hashed again.
+ *
+ * @param db		The signature database
+ * @param filename	The name of the file
+ * @param size		The current size of the file
+ * @param mtime		The current time of last modification
+ * @param hash		Set to the hash of the file's contents
+ *
+ * @return			0 on success, 1 if the file can't be hashed.
+ */
+int sigdb_file_hash(sigdb *db, const char *filename, off_t size,
+	struct timespec mtime, uint64_t *hash);
+
+/**
+ * Gets the prerequisite signature recorded for a target.
+ *
+ * @param db		The signature database
+ * @param target	The name of the target
+ * @param signature	Set to the recorded signature
+ *
+ * @return			1 if a signature was recorded, else 0.
+ */
+int sigdb_get_signature(sigdb *db, const char *target, uint64_t *signature);
+
+/**
+ * Records the prerequisite signature of a target.
+ *
+ * @param db		The signature database
+ * @param target	The name of the target
+ * @param signature	The signature to record
+ */
+void sigdb_set_signature(sigdb *db, const char *target, uint64_t signature);
+
+/**
+ * Writes the database back to its file if it has changed,
+ * then frees all memory used by it.
+ *
+ * @param db		The signature database
+ *
+ * @return			0 on success, 1 if writing failed.
+ */
+int sigdb_close(sigdb *db);
@@ -0,0 +1,485 @@
+/**
+ * Starts the commands of the 'mmake' program. Commands are
+ * started with posix_spawnp, which doesn't copy the page
+ * tables of the parent like fork does, so the cost of
+ * starting a command doesn't grow with the memory used by
+ * the parsed makefile and caches.
+ *
+ * The optional spawn helper is forked while the process is
+ * still small and talks to it over a socket. For every
+ * request it clones a child with CLONE_PARENT, which makes
+ * the command a child of the 'mmake' process itself, and
+ * with CLONE_VM | CLONE_VFORK, so nothing is copied and the
+ * helper learns whether the command could be executed.
+ * Descriptors for the output and errors of the command are
+ * passed to the helper along with the request.
+ *
+ * @file spawn.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "spawn.h"
+
+#define HELPER_STACK_SIZE (256 * 1024)
+
+extern char **environ;
+
+typedef struct request {
+	uint32_t len;            // Length of the arguments that follow
+	uint32_t argc;           // Amount of arguments that follow
+} request;
+
+typedef struct reply {
+	int32_t pid;             // Pid of the child, or -1 if none
+	int32_t error;           // Error number if the command failed
+} reply;
+
+typedef struct launch {
+	char **argv;             // The command to execute
+	int out_fd;              // Output of the command, or -1 to inherit
+	int err_fd;              // Errors of the command, or -1 to inherit
+	int error;               // Set to errno if executing failed
+} launch;
+
+static struct {
+	pid_t pid;        // Pid of the helper, -1 if not running
+	int fd;           // Socket to the helper
+} helper = { -1, -1 };
+
+// * Internal functions
+
+/**
+ * Reads exactly the given amount of bytes from a descriptor.
+ *
+ * @param fd		The descriptor
+ * @param buf		The buffer to read into
+ * @param len		The amount of bytes to read
+ *
+ * @return			0 on success, 1 on error or end of file.
+ */
+static int read_full(int fd, void *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = read(fd, buf, len);
+
+		if (n <= 0 && !(n == -1 && errno == EINTR))
+			return 1;
+
+		if (n > 0)
+		{
+			buf = (char *)buf + n;
+			len -= n;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Writes exactly the given amount of bytes to a descriptor.
+ *
+ * @param fd		The descriptor
+ * @param buf		The bytes to write
+ * @param len		The amount of bytes to write
+ *
+ * @return			0 on success, else 1.
+ */
+static int write_full(int fd, const void *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, buf, len);
+
+		if (n == -1 && errno != EINTR)
+			return 1;
+
+		if (n > 0)
+		{
+			buf = (const char *)buf + n;
+			len -= n;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Reads the fixed part of a request, and the descriptors sent
+ * along with it, if any.
+ *
+ * @param fd		The helper's end of the socket
+ * @param req		The request to read into
+ * @param out_fds	Set to the received output and error
+ *					descriptors, or -1
+ *
+ * @return			0 on success, 1 on error or end of file.
+ */
+static int read_request(int fd, request *req, int out_fds[2])
+{
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+	} control;
+	struct iovec iov = { req, sizeof(*req) };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf)
+	};
+
+	out_fds[0] = -1;
+	out_fds[1] = -1;
+
+	ssize_t n;
+	do
+		n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	while (n == -1 && errno == EINTR);
+
+	if (n <= 0)
+		return 1;
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+		&& cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))
+		memcpy(out_fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+
+	return read_full(fd, (char *)req + n, sizeof(*req) - n);
+}
+
+/**
+ * Writes a request, and sends the output and error
+ * descriptors along with it.
+ *
+ * @param fd		The socket to the helper
+ * @param buf		The request
+ * @param len		The length of the request
+ * @param out_fds	The descriptors to send, or -1 for none
+ *
+ * @return			0 on success, else 1.
+ */
+static int write_request(int fd, const char *buf, size_t len, const int out_fds[2])
+{
+	if (out_fds[0] == -1)
+		return write_full(fd, buf, len);
+
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+	} control;
+	struct iovec iov = { (void *)buf, len };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf)
+	};
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), out_fds, 2 * sizeof(int));
+
+	// The descriptors go with the first byte, the rest is
+	//	written as usual
+	ssize_t n;
+	do
+		n = sendmsg(fd, &msg, 0);
+	while (n == -1 && errno == EINTR);
+
+	if (n == -1)
+		return 1;
+
+	return write_full(fd, buf + n, len - n);
+}
+
+/**
+ * Runs in the cloned child of the helper, sharing its memory
+ * until the command is executed.
+ *
+ * @param arg		The launch request
+ *
+ * @return			Never returns.
+ */
+static int exec_child(void *arg)
+{
+	launch *l = arg;
+
+	// The child has a copy of the helper's descriptors, so this
+	//	doesn't affect the helper
+	if (l->out_fd != -1
+		&& (dup2(l->out_fd, STDOUT_FILENO) == -1 || dup2(l->err_fd, STDERR_FILENO) == -1))
+	{
+		l->error = errno;
+		_exit(127);
+	}
+
+	execvp(l->argv[0], l->argv);
+
+	// The helper is suspended until this exits, and reads the
+	//	error from the shared memory afterwards
+	l->error = errno;
+	_exit(127);
+}
+
+/**
+ * Splits the arguments of a request into a list.
+ *
+ * @param buf		The arguments, each terminated by '\0'
+ * @param len		The length of the arguments
+ * @param argv		The list to fill, with room for argc + 1
+ * @param argc		The amount of arguments
+ *
+ * @return			0 on success, 1 if the request is malformed.
+ */
+static int split_args(char *buf, size_t len, char **argv, size_t argc)
+{
+	size_t pos = 0;
+
+	for (size_t i = 0; i < argc; i++)
+	{
+		char *end = memchr(buf + pos, '\0', len - pos);
+		if (end == NULL)
+			return 1;
+
+		argv[i] = buf + pos;
+		pos = end - buf + 1;
+	}
+
+	argv[argc] = NULL;
+
+	return argc == 0 || pos != len;
+}
+
+/**
+ * The main loop of the helper. Starts one command for every
+ * request and replies with its pid, and an error number if it
+ * couldn't be executed, until the socket is closed.
+ *
+ * @param fd		The helper's end of the socket
+ */
+static void run_helper(int fd)
+{
+	char *stack = mmap(NULL, HELPER_STACK_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	char *buf = NULL;
+	char **argv = NULL;
+	request req;
+	int out_fds[2] = { -1, -1 };
+
+	if (stack == MAP_FAILED)
+		_exit(EXIT_FAILURE);
+
+	while (read_request(fd, &req, out_fds) == 0)
+	{
+		free(buf);
+		free(argv);
+		buf = malloc(req.len);
+		argv = malloc((req.argc + 1) * sizeof(*argv));
+
+		reply answer = { -1, ENOMEM };
+
+		if (buf == NULL || argv == NULL)
+			break;
+
+		if (read_full(fd, buf, req.len) != 0)
+			break;
+
+		if (split_args(buf, req.len, argv, req.argc) != 0)
+			answer.error = EINVAL;
+		else
+		{
+			launch l = { argv, out_fds[0], out_fds[1], 0 };
+			pid_t pid = clone(exec_child, stack + HELPER_STACK_SIZE,
+				CLONE_PARENT | CLONE_VM | CLONE_VFORK | SIGCHLD, &l);
+
+			// A child that failed to execute has already exited as a
+			//	child of 'mmake', which reaps it right away
+			answer.pid = pid;
+			answer.error = pid == -1 ? errno : l.error;
+		}
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (out_fds[i] != -1)
+				close(out_fds[i]);
+		}
+
+		if (write_full(fd, &answer, sizeof(answer)) != 0)
+			break;
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+/**
+ * Asks the helper to start a command.
+ *
+ * @param cmd		The command
+ * @param out_fds	The output and errors of the command, or -1
+ *					to inherit
+ * @param error		Set to the error number on failure
+ *
+ * @return			The pid of the started process, -1 if the
+ *					command couldn't be started, or -2 if the
+ *					helper couldn't be reached.
+ */
+static pid_t spawn_through_helper(char **cmd, const int out_fds[2], int *error)
+{
+	request req = { 0, 0 };
+
+	while (cmd[req.argc] != NULL)
+		req.len += strlen(cmd[req.argc++]) + 1;
+
+	char *buf = malloc(sizeof(req) + req.len);
+	if (buf == NULL)
+		return -2;
+
+	memcpy(buf, &req, sizeof(req));
+
+	size_t pos = sizeof(req);
+	for (uint32_t i = 0; i < req.argc; i++)
+	{
+		size_t len = strlen(cmd[i]) + 1;
+		memcpy(buf + pos, cmd[i], len);
+		pos += len;
+	}
+
+	reply answer = { -1, 0 };
+	int failed = write_request(helper.fd, buf, pos, out_fds) != 0
+		|| read_full(helper.fd, &answer, sizeof(answer)) != 0;
+	free(buf);
+
+	if (failed)
+		return -2;
+
+	if (answer.error != 0)
+	{
+		// Reap the child that failed to execute, as no one else
+		//	waits for a pid that was never handed out
+		if (answer.pid > 0)
+		{
+			while (waitpid(answer.pid, NULL, 0) == -1 && errno == EINTR)
+				;
+		}
+
+		*error = answer.error;
+		return -1;
+	}
+
+	return answer.pid;
+}
+
+// * Visible functions
+
+int spawn_helper_start(void)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+		return 1;
+
+	// Don't let the helper inherit unwritten output
+	fflush(NULL);
+
+	pid_t pid = fork();
+
+	if (pid == -1)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return 1;
+	}
+
+	if (pid == 0)
+	{
+		close(fds[0]);
+		run_helper(fds[1]);
+	}
+
+	close(fds[1]);
+	helper.pid = pid;
+	helper.fd = fds[0];
+
+	return 0;
+}
+
+pid_t spawn_command(char **cmd, int out_fd, int err_fd)
+{
+	int error = 0;
+	pid_t pid = -2;
+
+	// Errors go with the output unless they have a descriptor of
+	//	their own
+	if (err_fd == -1 || out_fd == -1)
+		err_fd = out_fd;
+
+	if (helper.fd != -1)
+	{
+		int out_fds[2] = { out_fd, err_fd };
+		pid = spawn_through_helper(cmd, out_fds, &error);
+
+		// Fall back to spawning directly if the helper is gone
+		if (pid == -2)
+		{
+			fprintf(stderr, "Spawn helper failed, spawning directly\n");
+			spawn_helper_stop();
+		}
+	}
+
+	if (pid == -2)
+	{
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_t *actions_ptr = NULL;
+
+		if (out_fd != -1)
+		{
+			actions_ptr = &actions;
+			posix_spawn_file_actions_init(actions_ptr);
+			posix_spawn_file_actions_adddup2(actions_ptr, out_fd, STDOUT_FILENO);
+			posix_spawn_file_actions_adddup2(actions_ptr, err_fd, STDERR_FILENO);
+		}
+
+		error = posix_spawnp(&pid, cmd[0], actions_ptr, NULL, cmd, environ);
+		if (error != 0)
+			pid = -1;
+
+		if (actions_ptr != NULL)
+			posix_spawn_file_actions_destroy(actions_ptr);
+	}
+
+	if (pid == -1)
+		fprintf(stderr, "Couldn't run '%s': %s\n", cmd[0], strerror(error));
+
+	return pid;
+}
+
+void spawn_helper_stop(void)
+{
+	if (helper.fd == -1)
+		return;
+
+	// The helper exits once its end of the socket is closed
+	close(helper.fd);
+	waitpid(helper.pid, NULL, 0);
+
+	helper.fd = -1;
+	helper.pid = -1;
+}
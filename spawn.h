@@ -0,0 +1,55 @@
+#pragma once
+
+/**
+ * Starts the commands of the 'mmake' program. Commands are
+ * started with posix_spawnp, which doesn't copy the page
+ * tables of the parent like fork does, so the cost of
+ * starting a command doesn't grow with the memory used by
+ * the parsed makefile and caches.
+ *
+ * Optionally, a small helper process is forked before the
+ * makefile is loaded, and starts all commands on request.
+ * The commands it starts are children of the 'mmake'
+ * process, not of the helper, so they are waited for as
+ * usual.
+ *
+ * The output of a command can be sent to a descriptor, e.g.
+ * a pipe to capture it, which is passed on to the helper.
+ *
+ * @file spawn.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/**
+ * Forks the spawn helper. Should be called as early as
+ * possible, while the process is still small.
+ *
+ * @return			0 on success, else 1.
+ */
+int spawn_helper_start(void);
+
+/**
+ * Starts a command without waiting for it to finish, through
+ * the spawn helper if it's running. The started process is
+ * always a child of the calling process.
+ *
+ * @param cmd		The command as a NULL-terminated list of
+ *					arguments, the first being the program
+ * @param out_fd	Descriptor to use as the standard output of
+ *					the command, or -1 to share those of the
+ *					calling process
+ * @param err_fd	Descriptor to use as the standard error of
+ *					the command, or -1 to use out_fd
+ *
+ * @return			The pid of the started process, or -1 on error.
+ */
+pid_t spawn_command(char **cmd, int out_fd, int err_fd);
+
+/**
+ * Stops the spawn helper if it's running.
+ */
+void spawn_helper_stop(void);
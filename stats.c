@@ -0,0 +1,98 @@
+/**
+ * Counts what the 'mmake' program does during a run, e.g. how
+ * many rules it parsed, files it stated and commands it ran,
+ * and how long each phase of the run took. The counters are
+ * always kept, since updating one is a single addition, and
+ * are printed at exit when the --stats flag is used.
+ *
+ * Every value is printed on a line of its own as a name and a
+ * number, so that the output of two runs can be compared with
+ * standard tools.
+ *
+ * @file stats.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <time.h>
+
+#include "stats.h"
+
+#define NS_PER_MS 1e6
+
+static const char *counter_names[STAT_N_COUNTERS] = {
+	[STAT_RULES_PARSED] = "rules_parsed",
+	[STAT_BYTES_PARSED] = "bytes_parsed",
+	[STAT_RULE_LOOKUPS] = "rule_lookups",
+	[STAT_STAT_CALLS] = "stat_calls",
+	[STAT_OPEN_CALLS] = "open_calls",
+	[STAT_CACHE_HITS] = "cache_hits",
+	[STAT_SAVED_SYSCALLS] = "saved_syscalls",
+	[STAT_TARGETS_CHECKED] = "targets_checked",
+	[STAT_TARGETS_REBUILT] = "targets_rebuilt",
+	[STAT_COMMANDS_STARTED] = "commands_started",
+	[STAT_OUTPUT_BYTES] = "output_bytes",
+	[STAT_RESULT_HITS] = "result_cache_hits",
+	[STAT_RESULT_MISSES] = "result_cache_misses",
+	[STAT_RESULT_STORES] = "result_cache_stores",
+	[STAT_RESULT_EVICTIONS] = "result_cache_evicted",
+	[STAT_CHILD_CPU_NS] = NULL
+};
+
+static const char *phase_names[STAT_N_PHASES] = {
+	[PHASE_PARSE] = "parse_ms",
+	[PHASE_LINK] = "link_ms",
+	[PHASE_STAT] = "stat_ms",
+	[PHASE_BUILD] = "build_ms"
+};
+
+static struct {
+	uint64_t counters[STAT_N_COUNTERS];
+	uint64_t phases_ns[STAT_N_PHASES];
+	uint64_t start_ns;       // Time of the first clock reading, or 0
+} stats;
+
+// * Visible functions
+
+void stats_add(statcounter counter, uint64_t amount)
+{
+	stats.counters[counter] += amount;
+}
+
+uint64_t stats_clock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+	if (stats.start_ns == 0)
+		stats.start_ns = now_ns;
+
+	return now_ns;
+}
+
+void stats_end_phase(statphase phase, uint64_t start_ns)
+{
+	stats.phases_ns[phase] += stats_clock() - start_ns;
+}
+
+void stats_print(FILE *out)
+{
+	uint64_t total_ns = stats_clock() - stats.start_ns;
+
+	for (int i = 0; i < STAT_N_COUNTERS; i++)
+	{
+		if (counter_names[i] != NULL)
+			fprintf(out, "%-20s %llu\n", counter_names[i],
+				(unsigned long long)stats.counters[i]);
+	}
+
+	fprintf(out, "%-20s %.3f\n", "child_cpu_ms",
+		stats.counters[STAT_CHILD_CPU_NS] / NS_PER_MS);
+
+	for (int i = 0; i < STAT_N_PHASES; i++)
+		fprintf(out, "%-20s %.3f\n", phase_names[i], stats.phases_ns[i] / NS_PER_MS);
+
+	fprintf(out, "%-20s %.3f\n", "total_ms", total_ns / NS_PER_MS);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/**
+ * Counts what the 'mmake' program does during a run, e.g. how
+ * many rules it parsed, files it stated and commands it ran,
+ * and how long each phase of the run took. The counters are
+ * always kept, since updating one is a single addition, and
+ * are printed at exit when the --stats flag is used.
+ *
+ * @file stats.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+typedef enum statcounter {
+	STAT_RULES_PARSED,     // Rules read by parse_makefile
+	STAT_BYTES_PARSED,     // Bytes of makefile text parsed
+	STAT_RULE_LOOKUPS,     // Calls to makefile_rule
+	STAT_STAT_CALLS,       // Files stated, one by one or prefetched
+	STAT_OPEN_CALLS,       // Files opened, e.g. to hash their contents
+	STAT_CACHE_HITS,       // File lookups answered by the cache
+	STAT_SAVED_SYSCALLS,   // Syscalls the file cache saved compared to
+	                       //	uncached lookups
+	STAT_TARGETS_CHECKED,  // Targets checked for being up to date
+	STAT_TARGETS_REBUILT,  // Targets whose command succeeded
+	STAT_COMMANDS_STARTED, // Commands started, locally or on a worker
+	STAT_OUTPUT_BYTES,     // Bytes of command output captured
+	STAT_RESULT_HITS,      // Targets restored from the result cache
+	STAT_RESULT_MISSES,    // Targets not found in the result cache
+	STAT_RESULT_STORES,    // Targets stored in the result cache
+	STAT_RESULT_EVICTIONS, // Entries removed from the result cache
+	STAT_CHILD_CPU_NS,     // User and system time of all commands
+	STAT_N_COUNTERS
+} statcounter;
+
+typedef enum statphase {
+	PHASE_PARSE,           // Loading or parsing the makefile
+	PHASE_LINK,            // Linking the dependency graph
+	PHASE_STAT,            // Collecting targets and stating their files
+	PHASE_BUILD,           // Checking targets and running commands
+	STAT_N_PHASES
+} statphase;
+
+/**
+ * Adds to a counter.
+ *
+ * @param counter	The counter
+ * @param amount	The amount to add
+ */
+void stats_add(statcounter counter, uint64_t amount);
+
+/**
+ * Gets the current time to measure a phase from.
+ *
+ * @return			The time in nanoseconds of CLOCK_MONOTONIC
+ */
+uint64_t stats_clock(void);
+
+/**
+ * Adds the time passed since a given time to a phase. A phase
+ * may be timed several times, e.g. once per build with --watch.
+ *
+ * @param phase		The phase
+ * @param start_ns	The time the phase started, from stats_clock
+ */
+void stats_end_phase(statphase phase, uint64_t start_ns);
+
+/**
+ * Prints all counters and phase times, and the time since the
+ * first call to stats_clock.
+ *
+ * @param out		The stream to print to
+ */
+void stats_print(FILE *out);
@@ -0,0 +1,165 @@
+/**
+ * Records where the time of a build goes as a Chrome
+ * trace-event file, which can be opened in chrome://tracing
+ * or Perfetto. Every recorded span is written as a complete
+ * event on a track, where track 0 is the 'mmake' process
+ * itself and every job slot has a track of its own.
+ *
+ * The file uses the JSON array format, whose closing bracket
+ * is optional, so a trace of a build that exited early can
+ * still be opened.
+ *
+ * @file trace.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+static struct {
+	FILE *file;              // The trace file, NULL if not tracing
+	char *buffer;            // Output buffer of the file
+	uint64_t base_ns;        // Time the trace was opened
+	int pid;                 // Process id shown in the trace
+	size_t n_events;         // Amount of events written so far
+} trace = { NULL, NULL, 0, 0, 0 };
+
+// * Internal functions
+
+/**
+ * Reads CLOCK_MONOTONIC.
+ *
+ * @return		The current time in nanoseconds
+ */
+static uint64_t monotonic_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ *
+ * @param str	The string to write
+ */
+static void write_string(const char *str)
+{
+	putc('"', trace.file);
+
+	for (const unsigned char *c = (const unsigned char *)str; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			fprintf(trace.file, "\\%c", *c);
+		else if (*c < 0x20)
+			fprintf(trace.file, "\\u%04x", *c);
+		else
+			putc(*c, trace.file);
+	}
+
+	putc('"', trace.file);
+}
+
+/**
+ * Writes a duration in the microseconds used by the trace
+ * format.
+ *
+ * @param ns	The duration in nanoseconds
+ */
+static void write_micros(uint64_t ns)
+{
+	fprintf(trace.file, "%llu.%03llu", (unsigned long long)(ns / 1000),
+		(unsigned long long)(ns % 1000));
+}
+
+/**
+ * Starts a new event, separating it from the previous one.
+ */
+static void begin_event(void)
+{
+	fputs(trace.n_events++ == 0 ? "{" : ",\n{", trace.file);
+}
+
+// * Visible functions
+
+int trace_open(const char *path)
+{
+	// Commands must not inherit the trace file
+	trace.file = fopen(path, "we");
+
+	if (trace.file == NULL)
+		return 1;
+
+	// A large buffer keeps the cost of a span to a memory copy
+	trace.buffer = malloc(TRACE_BUFFER_SIZE);
+	if (trace.buffer != NULL)
+		setvbuf(trace.file, trace.buffer, _IOFBF, TRACE_BUFFER_SIZE);
+
+	trace.base_ns = monotonic_ns();
+	trace.pid = getpid();
+
+	fputs("[\n", trace.file);
+	trace_name_track(TRACE_MAIN_TRACK, "mmake");
+
+	return 0;
+}
+
+int trace_enabled(void)
+{
+	return trace.file != NULL;
+}
+
+uint64_t trace_now(void)
+{
+	return trace.file == NULL ? 0 : monotonic_ns();
+}
+
+void trace_span(const char *name, const char *category, int track,
+	uint64_t start_ns, uint64_t end_ns)
+{
+	if (trace.file == NULL)
+		return;
+
+	begin_event();
+	fputs("\"name\":", trace.file);
+	write_string(name);
+	fprintf(trace.file, ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":",
+		category, trace.pid, track);
+	write_micros(start_ns > trace.base_ns ? start_ns - trace.base_ns : 0);
+	fputs(",\"dur\":", trace.file);
+	write_micros(end_ns > start_ns ? end_ns - start_ns : 0);
+	putc('}', trace.file);
+}
+
+void trace_name_track(int track, const char *name)
+{
+	if (trace.file == NULL)
+		return;
+
+	begin_event();
+	fprintf(trace.file, "\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+		"\"args\":{\"name\":", trace.pid, track);
+	write_string(name);
+	fputs("}}", trace.file);
+}
+
+void trace_close(void)
+{
+	if (trace.file == NULL)
+		return;
+
+	fputs("\n]\n", trace.file);
+	fclose(trace.file);
+	free(trace.buffer);
+
+	trace.file = NULL;
+	trace.buffer = NULL;
+	trace.n_events = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/**
+ * Records where the time of a build goes as a Chrome
+ * trace-event file, which can be opened in chrome://tracing
+ * or Perfetto. Every recorded span is written as a complete
+ * event on a track, where track 0 is the 'mmake' process
+ * itself and every job slot has a track of its own.
+ *
+ * All times are nanoseconds of CLOCK_MONOTONIC. When no trace
+ * is open, recording is skipped after a single check, so the
+ * calls can stay in place at no real cost.
+ *
+ * @file trace.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Track of the 'mmake' process itself, job slot i uses i + 1
+#define TRACE_MAIN_TRACK 0
+
+/**
+ * Opens a trace file, replacing any existing file.
+ *
+ * @param path		The path of the trace file
+ *
+ * @return			0 on success, else 1.
+ */
+int trace_open(const char *path);
+
+/**
+ * Checks if a trace is being recorded.
+ *
+ * @return			1 if a trace is open, else 0.
+ */
+int trace_enabled(void);
+
+/**
+ * Gets the current time for a span, without any cost when no
+ * trace is being recorded.
+ *
+ * @return			The current time, or 0 if no trace is open.
+ */
+uint64_t trace_now(void);
+
+/**
+ * Records a span that has ended.
+ *
+ * @param name		The name of the span
+ * @param category	The category of the span, e.g. "job"
+ * @param track		The track to show the span on
+ * @param start_ns	The time the span started
+ * @param end_ns	The time the span ended
+ */
+void trace_span(const char *name, const char *category, int track,
+	uint64_t start_ns, uint64_t end_ns);
+
+/**
+ * Names a track, e.g. after the job slot it shows.
+ *
+ * @param track		The track
+ * @param name		The name to show for the track
+ */
+void trace_name_track(int track, const char *name);
+
+/**
+ * Finishes and closes the trace file, if one is open.
+ */
+void trace_close(void);
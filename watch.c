@@ -0,0 +1,495 @@
+/**
+ * The watch module keeps the 'mmake' program running after a
+ * build. The parsed makefile, its dependency graph and the file
+ * information cache stay in memory, and inotify is used to find
+ * out which files changed, so that a rebuild only has to check
+ * the targets that depend on them.
+ *
+ * Every directory holding a node of the graph or the makefile
+ * is watched, instead of every file, so that files replaced by
+ * a rename and files that don't exist yet are noticed as well.
+ * An event only marks a node as changed if the file's cached
+ * information differs from its current one. This filters out
+ * the events caused by the build itself, since the builder
+ * reads the information of every target again once it has
+ * been rebuilt.
+ *
+ * @file watch.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "builder.h"
+#include "file_handler.h"
+#include "hash.h"
+
+#define MIN_TABLE_SIZE 16
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE \
+	| IN_DELETE | IN_ATTRIB)
+
+// Editors and compilers often write a file in several steps, so
+//	events are gathered until none arrive for this long
+#define QUIET_MS 10
+
+typedef struct watchdir {
+	char *prefix;            // Directory prefix of the node names, including
+	                         //	the final '/', "" for the current directory
+	int wd;                  // Watch descriptor, -1 if it couldn't be added
+} watchdir;
+
+typedef struct watcher {
+	int fd;                  // The inotify instance
+	watchdir *dirs;          // Open-addressing hash table of prefixes
+	size_t size;             // Size of the table, a power of two
+	size_t used;             // Amount of occupied slots
+	node **stack;            // Work stack for marking changed nodes
+	int reparse;             // Set if the makefile has changed
+	int changed;             // Set if any node has changed
+} watcher;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+// * Internal functions
+
+/**
+ * Notes that the watch should stop.
+ *
+ * @param signum	The caught signal
+ */
+static void request_stop(int signum)
+{
+	(void)signum;
+	stop_requested = 1;
+}
+
+/**
+ * Finds the table slot for a directory prefix. The slot either
+ * holds that prefix or is empty.
+ *
+ * @param dirs		The hash table to search
+ * @param size		The size of the table
+ * @param prefix	The prefix to look for, not NULL-terminated
+ * @param len		The length of the prefix
+ *
+ * @return			A pointer to the slot
+ */
+static watchdir *find_slot(watchdir *dirs, size_t size, const char *prefix, size_t len)
+{
+	size_t i = hash_bytes(prefix, len, 0) & (size - 1);
+
+	while (dirs[i].prefix != NULL && (strlen(dirs[i].prefix) != len
+		|| memcmp(dirs[i].prefix, prefix, len) != 0))
+		i = (i + 1) & (size - 1);
+
+	return &dirs[i];
+}
+
+/**
+ * Watches the directory of a path, unless it is watched already.
+ * Directories that don't exist are remembered but not watched.
+ *
+ * @param w		The watcher
+ * @param path	The path of a file in the directory
+ *
+ * @return		0 on success, 1 if allocation failed.
+ */
+static int watch_dir_of(watcher *w, const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	size_t len = slash == NULL ? 0 : (size_t)(slash - path) + 1;
+
+	// Keep the table at most half full
+	if (2 * (w->used + 1) > w->size)
+	{
+		size_t new_size = w->size == 0 ? MIN_TABLE_SIZE : w->size * 2;
+		watchdir *new_dirs = calloc(new_size, sizeof(*new_dirs));
+
+		if (new_dirs == NULL)
+			return 1;
+
+		for (size_t i = 0; i < w->size; i++)
+		{
+			watchdir *dir = &w->dirs[i];
+			if (dir->prefix != NULL)
+				*find_slot(new_dirs, new_size, dir->prefix, strlen(dir->prefix)) = *dir;
+		}
+
+		free(w->dirs);
+		w->dirs = new_dirs;
+		w->size = new_size;
+	}
+
+	watchdir *slot = find_slot(w->dirs, w->size, path, len);
+	if (slot->prefix != NULL)
+		return 0;
+
+	if ((slot->prefix = strndup(path, len)) == NULL)
+		return 1;
+
+	slot->wd = inotify_add_watch(w->fd, len == 0 ? "." : slot->prefix, WATCH_MASK);
+	w->used++;
+
+	return 0;
+}
+
+/**
+ * Removes all watches and frees the memory used by a watcher.
+ *
+ * @param w		The watcher
+ */
+static void close_watcher(watcher *w)
+{
+	if (w->fd != -1)
+		close(w->fd);
+
+	for (size_t i = 0; i < w->size; i++)
+		free(w->dirs[i].prefix);
+
+	free(w->dirs);
+	free(w->stack);
+	*w = (watcher){ .fd = -1 };
+}
+
+/**
+ * Sets up a watcher for every directory that holds a node of
+ * the graph or the makefile.
+ *
+ * @param w			The watcher to set up
+ * @param options	Information about the program's flags
+ * @param dag		The dependency graph
+ *
+ * @return			0 on success, else 1.
+ */
+static int open_watcher(watcher *w, optioninfo *options, graph *dag)
+{
+	*w = (watcher){ .fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC) };
+
+	if (w->fd == -1)
+	{
+		perror("Couldn't watch for changes");
+		return 1;
+	}
+
+	size_t n_nodes = graph_size(dag);
+	int failed = (w->stack = malloc((n_nodes + 1) * sizeof(*w->stack))) == NULL
+		|| watch_dir_of(w, get_makefile_name(options)) != 0;
+
+	for (size_t i = 0; i < n_nodes && !failed; i++)
+		failed = watch_dir_of(w, graph_node_at(dag, i)->name);
+
+	if (failed)
+	{
+		perror("Allocation failed");
+		close_watcher(w);
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Checks if a file differs from its cached information, and
+ * drops that information so that the file is stated again.
+ * Files without cached information are always seen as changed.
+ *
+ * @param path	The path of the file
+ *
+ * @return		1 if the file has changed, else 0.
+ */
+static int file_changed(const char *path)
+{
+	if (!is_file_info_cached(path))
+		return 1;
+
+	int existed = file_exists(path);
+	struct timespec mtime = get_last_mod_time(path);
+	off_t size = get_file_size(path);
+
+	invalidate_file_info(path);
+
+	struct timespec new_mtime = get_last_mod_time(path);
+
+	return existed != file_exists(path) || size != get_file_size(path)
+		|| mtime.tv_sec != new_mtime.tv_sec || mtime.tv_nsec != new_mtime.tv_nsec;
+}
+
+/**
+ * Resets a changed node and every node depending on it, so
+ * that the next build checks them again. Nodes that are already
+ * reset are not followed, since nothing depending on them can
+ * be up to date.
+ *
+ * @param w			The watcher
+ * @param target	The changed node
+ */
+static void mark_changed(watcher *w, node *target)
+{
+	w->changed = 1;
+
+	if (target->state == NODE_UNVISITED)
+		return;
+
+	size_t top = 0;
+	target->state = NODE_UNVISITED;
+	w->stack[top++] = target;
+
+	while (top > 0)
+	{
+		node *current = w->stack[--top];
+
+		for (size_t i = 0; i < current->n_dependents; i++)
+		{
+			node *dependent = current->dependents[i];
+
+			if (dependent->state != NODE_UNVISITED)
+			{
+				dependent->state = NODE_UNVISITED;
+				w->stack[top++] = dependent;
+			}
+		}
+	}
+}
+
+/**
+ * Handles a single inotify event.
+ *
+ * @param w			The watcher
+ * @param options	Information about the program's flags
+ * @param dag		The dependency graph
+ * @param event		The event
+ */
+static void handle_event(watcher *w, optioninfo *options, graph *dag,
+	const struct inotify_event *event)
+{
+	// Events were lost, so nothing that is cached can be trusted
+	if (event->mask & IN_Q_OVERFLOW)
+	{
+		free_file_cache();
+		for (size_t i = 0; i < graph_size(dag); i++)
+			graph_node_at(dag, i)->state = NODE_UNVISITED;
+		w->changed = 1;
+		w->reparse = 1;
+		return;
+	}
+
+	if (event->len == 0)
+		return;
+
+	// A directory may be watched under several prefixes, e.g.
+	//	"" and "./", so the event is tried with each of them
+	for (size_t i = 0; i < w->size; i++)
+	{
+		watchdir *dir = &w->dirs[i];
+		if (dir->prefix == NULL || dir->wd != event->wd)
+			continue;
+
+		char path[PATH_MAX];
+		if (snprintf(path, sizeof(path), "%s%s", dir->prefix, event->name)
+			>= (int)sizeof(path))
+			continue;
+
+		if (strcmp(path, get_makefile_name(options)) == 0)
+		{
+			w->reparse = 1;
+			continue;
+		}
+
+		node *target = graph_node(dag, path);
+		if (target != NULL && file_changed(path))
+			mark_changed(w, target);
+	}
+}
+
+/**
+ * Reads and handles all queued inotify events.
+ *
+ * @param w			The watcher
+ * @param options	Information about the program's flags
+ * @param dag		The dependency graph
+ */
+static void read_events(watcher *w, optioninfo *options, graph *dag)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while ((len = read(w->fd, buf, sizeof(buf))) > 0)
+	{
+		for (char *pos = buf; pos < buf + len; )
+		{
+			const struct inotify_event *event = (const struct inotify_event *)pos;
+			handle_event(w, options, dag, event);
+			pos += sizeof(*event) + event->len;
+		}
+	}
+}
+
+/**
+ * Waits until a file of the graph or the makefile has changed,
+ * then keeps reading events until the changes have settled.
+ *
+ * @param w			The watcher
+ * @param options	Information about the program's flags
+ * @param dag		The dependency graph
+ *
+ * @return			0 if a rebuild is needed, 1 if the watch
+ *					should stop.
+ */
+static int wait_for_changes(watcher *w, optioninfo *options, graph *dag)
+{
+	struct pollfd pfd = { .fd = w->fd, .events = POLLIN };
+	sigset_t stop_signals, old_mask;
+
+	sigemptyset(&stop_signals);
+	sigaddset(&stop_signals, SIGINT);
+	sigaddset(&stop_signals, SIGTERM);
+
+	w->changed = 0;
+	w->reparse = 0;
+
+	while (!w->changed && !w->reparse)
+	{
+		// Only let the signals through while waiting, so that a
+		//	signal arriving right before the wait is not missed
+		sigprocmask(SIG_BLOCK, &stop_signals, &old_mask);
+
+		int ready = stop_requested ? -1 : ppoll(&pfd, 1, NULL, &old_mask);
+		sigprocmask(SIG_SETMASK, &old_mask, NULL);
+
+		if (stop_requested)
+			return 1;
+
+		if (ready < 0 && errno != EINTR)
+		{
+			perror("Couldn't watch for changes");
+			return 1;
+		}
+
+		while (ready > 0)
+		{
+			read_events(w, options, dag);
+			ready = poll(&pfd, 1, QUIET_MS);
+		}
+	}
+
+	return stop_requested;
+}
+
+/**
+ * Parses the makefile again and links its graph. The previous
+ * makefile and graph are only replaced if this succeeds.
+ *
+ * @param options	Information about the program's flags
+ * @param mfile_ptr	A pointer to the current makefile
+ * @param dag_ptr	A pointer to the current dependency graph
+ * @param targets	The targets to build, or NULL
+ *
+ * @return			0 if the makefile was replaced, else 1.
+ */
+static int reload_makefile(optioninfo *options, makefile **mfile_ptr,
+	graph **dag_ptr, char **targets)
+{
+	makefile *mfile = get_makefile(options);
+	graph *dag = mfile == NULL ? NULL : link_graph(mfile);
+
+	if (dag == NULL || (targets != NULL && validate_targets(mfile, targets) != 0))
+	{
+		fprintf(stderr, "Keeping the previous version of '%s'\n",
+			get_makefile_name(options));
+		if (dag != NULL)
+			graph_del(dag);
+		if (mfile != NULL)
+			makefile_del(mfile);
+		return 1;
+	}
+
+	graph_del(*dag_ptr);
+	makefile_del(*mfile_ptr);
+	*dag_ptr = dag;
+	*mfile_ptr = mfile;
+
+	return 0;
+}
+
+/**
+ * Builds the targets, or the default target of the makefile.
+ *
+ * @param options	Information about the program's flags
+ * @param mfile		The makefile
+ * @param dag		The dependency graph
+ * @param targets	The targets to build, or NULL
+ */
+static void build(optioninfo *options, makefile *mfile, graph *dag, char **targets)
+{
+	const char *default_targets[] = { makefile_default_target(mfile), NULL };
+
+	if (targets == NULL)
+		build_targets(options, dag, default_targets);
+	else
+		build_targets(options, dag, (const char **)targets);
+
+	fflush(stdout);
+}
+
+// * Visible functions
+
+int watch_targets(optioninfo *options, makefile **mfile_ptr, graph **dag_ptr,
+	char **targets)
+{
+	watcher w;
+	int result = 0;
+
+	// Set up the watches before building, so that no change made
+	//	during the first build is missed
+	if (open_watcher(&w, options, *dag_ptr) != 0)
+		return 1;
+
+	struct sigaction action = { .sa_handler = request_stop, .sa_flags = SA_RESTART };
+	struct sigaction old_int, old_term;
+
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, &old_int);
+	sigaction(SIGTERM, &action, &old_term);
+
+	build(options, *mfile_ptr, *dag_ptr, targets);
+	fprintf(stderr, "Watching for changes, press Ctrl-C to stop\n");
+
+	while (wait_for_changes(&w, options, *dag_ptr) == 0)
+	{
+		if (w.reparse && reload_makefile(options, mfile_ptr, dag_ptr, targets) == 0)
+		{
+			// Start over with the new graph. Changes made while the
+			//	watches are replaced are missed, so nothing cached
+			//	from before is trusted
+			watcher new_w;
+			if (open_watcher(&new_w, options, *dag_ptr) != 0)
+			{
+				result = 1;
+				break;
+			}
+
+			close_watcher(&w);
+			w = new_w;
+			free_file_cache();
+		}
+
+		build(options, *mfile_ptr, *dag_ptr, targets);
+	}
+
+	close_watcher(&w);
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+
+	return result;
+}
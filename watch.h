@@ -0,0 +1,38 @@
+#pragma once
+
+/**
+ * The watch module keeps the 'mmake' program running after a
+ * build. The parsed makefile, its dependency graph and the file
+ * information cache stay in memory, and inotify is used to find
+ * out which files changed, so that a rebuild only has to check
+ * the targets that depend on them.
+ *
+ * @file watch.h
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#include "program_handler.h"
+#include "parser.h"
+#include "graph.h"
+
+/**
+ * Builds the targets, then waits for changes to any file in the
+ * graph and rebuilds after every change until interrupted with
+ * SIGINT or SIGTERM. Only the nodes depending on a changed file
+ * are checked again. When the makefile itself changes it is
+ * parsed again, and the old makefile and graph are kept if that
+ * fails. A failed build does not stop the watch.
+ *
+ * @param options	Information about the program's flags
+ * @param mfile_ptr	A pointer to the parsed makefile, replaced when
+ *					the makefile is parsed again
+ * @param dag_ptr	A pointer to the makefile's dependency graph,
+ *					replaced along with the makefile
+ * @param targets	A NULL-terminated list of the targets to build,
+ *					or NULL to build the default target
+ *
+ * @return	0 when interrupted, 1 if the watches couldn't be set up.
+ */
+int watch_targets(optioninfo *options, makefile **mfile_ptr, graph **dag_ptr,
+	char **targets);
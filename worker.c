@@ -0,0 +1,876 @@
+/**
+ * The 'mmake-worker' program runs jobs for the 'mmake'
+ * program, which sends them over a Unix or TCP socket with
+ * the protocol in remote.h. Every connection is served by a
+ * process of its own, which runs one job at a time.
+ *
+ * Each job runs in a new scratch directory, filled with the
+ * input files sent with the request. The output and errors
+ * of the command are streamed back as they're written,
+ * followed by the target file and the status of the command,
+ * after which the scratch directory is removed. The working
+ * directory of the client is given to the command as
+ * MMAKE_CWD.
+ *
+ * The contents of inputs are kept by hash in the worker's
+ * directory, so a client only sends each of them once.
+ * When stopped with SIGINT or SIGTERM, the worker ends its
+ * connections and their commands, so clients run those jobs
+ * themselves.
+ *
+ * Usage:
+ *  ./mmake-worker [-d DIR] [-v] ADDRESS
+ *
+ *  ADDRESS		: "unix:PATH" or "HOST:PORT" to listen on
+ *  -d DIR		: Directory for inputs and scratch directories,
+ *				  a new temporary one by default
+ *  -v			: Prints every job that is run
+ *
+ * @file worker.c
+ * @author c24nen
+ * @date 2025.10.01
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "remote.h"
+#include "spawn.h"
+
+#define OUTPUT_CHUNK (1 << 16)
+#define INPUT_FIXED_LEN 16
+#define INPUT_REF_FIXED_LEN 12
+#define STATUS_NOT_RUN (127 << 8)
+#define MAX_OPEN_FDS 64
+
+typedef struct request {
+	char **argv;             // The command, NULL-terminated
+	size_t argc;             // Amount of arguments
+	char *cwd;               // Working directory of the client, or NULL
+	char *target;            // Target to send back, or NULL
+	char *scratch;           // Scratch directory of the job, or NULL
+	char *error;             // Why the job can't run, or NULL
+} request;
+
+static volatile sig_atomic_t stopping = 0;
+static int verbose = 0;
+
+// Processes serving connections, each leading a process group
+//	with the command it runs
+static pid_t *servers = NULL;
+static size_t n_servers = 0;
+
+// * Internal functions
+
+/**
+ * Stops accepting connections on SIGINT or SIGTERM.
+ *
+ * @param signum	The signal number
+ */
+static void handle_stop(int signum)
+{
+	(void)signum;
+	stopping = 1;
+}
+
+/**
+ * Interrupts accept when a connection process exits, so that
+ * it's reaped.
+ *
+ * @param signum	The signal number
+ */
+static void handle_child(int signum)
+{
+	(void)signum;
+}
+
+/**
+ * Reaps the connection processes that have exited.
+ */
+static void reap_servers(void)
+{
+	pid_t pid;
+
+	while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+	{
+		for (size_t i = 0; i < n_servers; i++)
+		{
+			if (servers[i] == pid)
+			{
+				servers[i] = servers[--n_servers];
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Ends all connections along with the commands they run, so
+ * that nothing uses the worker's directory once it's removed.
+ * Clients see the connection close and run the jobs
+ * themselves.
+ */
+static void stop_servers(void)
+{
+	for (size_t i = 0; i < n_servers; i++)
+		kill(-servers[i], SIGTERM);
+
+	for (size_t i = 0; i < n_servers; i++)
+	{
+		while (waitpid(servers[i], NULL, 0) == -1 && errno == EINTR)
+			;
+	}
+
+	n_servers = 0;
+}
+
+/**
+ * Removes a file or an emptied directory, for nftw.
+ *
+ * @param path		The path of the file
+ * @param info		Information about the file, unused
+ * @param flag		The type of the file, unused
+ * @param ftw		The position in the walk, unused
+ *
+ * @return			Always 0, so the walk goes on.
+ */
+static int remove_entry(const char *path, const struct stat *info, int flag,
+	struct FTW *ftw)
+{
+	(void)info;
+	(void)flag;
+	(void)ftw;
+
+	remove(path);
+
+	return 0;
+}
+
+/**
+ * Remembers the first reason a job can't run.
+ *
+ * @param req		The request
+ * @param what		What went wrong
+ * @param name		The file it went wrong for
+ */
+static void fail_request(request *req, const char *what, const char *name)
+{
+	if (req->error != NULL)
+		return;
+
+	if (asprintf(&req->error, "mmake-worker: %s '%s': %s\n", what, name,
+		strerror(errno)) == -1)
+		req->error = NULL;
+}
+
+/**
+ * Checks that a path sent by the client stays inside the
+ * scratch directory, i.e. is relative and has no '..' parts.
+ *
+ * @param path		The path
+ *
+ * @return			1 if the path is safe, else 0.
+ */
+static int is_safe_path(const char *path)
+{
+	if (path[0] == '\0' || path[0] == '/')
+		return 0;
+
+	for (const char *part = path; part != NULL; part = strchr(part, '/'))
+	{
+		if (*part == '/')
+			part++;
+		if (strncmp(part, "..", 2) == 0 && (part[2] == '/' || part[2] == '\0'))
+			return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Creates the parent directories of a path inside the scratch
+ * directory.
+ *
+ * @param path		The path, relative to the scratch directory
+ */
+static void make_parents(const char *path)
+{
+	char *copy = strdup(path);
+	if (copy == NULL)
+		return;
+
+	for (char *slash = strchr(copy, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+	{
+		*slash = '\0';
+		mkdir(copy, 0777);
+		*slash = '/';
+	}
+
+	free(copy);
+}
+
+/**
+ * Reads a payload into a new string.
+ *
+ * @param fd		The connection
+ * @param len		The length of the payload
+ *
+ * @return			The string, or NULL on error.
+ */
+static char *read_string(int fd, size_t len)
+{
+	char *str = malloc(len + 1);
+
+	if (str == NULL || remote_read_full(fd, str, len) != 0)
+	{
+		free(str);
+		return NULL;
+	}
+
+	str[len] = '\0';
+
+	return str;
+}
+
+/**
+ * Gets the path of the stored contents with a given hash.
+ *
+ * @param root		The worker's directory
+ * @param hash		The hash of the contents
+ *
+ * @return			The path, which must be freed, or NULL on error.
+ */
+static char *blob_path(const char *root, uint64_t hash)
+{
+	char *path = NULL;
+
+	if (asprintf(&path, "%s/blobs/%016llx", root, (unsigned long long)hash) == -1)
+		return NULL;
+
+	return path;
+}
+
+/**
+ * Copies stored contents into the scratch directory.
+ *
+ * @param blob		The path of the stored contents
+ * @param name		The path of the input in the scratch directory
+ * @param mode		The mode of the input
+ *
+ * @return			0 on success, else 1.
+ */
+static int place_input(const char *blob, const char *name, mode_t mode)
+{
+	int src = open(blob, O_RDONLY | O_CLOEXEC);
+	if (src == -1)
+		return 1;
+
+	make_parents(name);
+	int dst = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+
+	struct stat info;
+	int result = dst == -1 || fstat(src, &info) != 0;
+
+	for (off_t done = 0; result == 0 && done < info.st_size; )
+	{
+		ssize_t n = copy_file_range(src, NULL, dst, NULL, info.st_size - done, 0);
+
+		if (n <= 0)
+			result = !(n == -1 && errno == EINTR);
+		else
+			done += n;
+	}
+
+	if (dst != -1)
+	{
+		fchmod(dst, mode);
+		close(dst);
+	}
+	close(src);
+
+	return result;
+}
+
+/**
+ * Reads an input sent with its contents, stores the contents
+ * by hash and places the input in the scratch directory.
+ *
+ * @param fd		The connection
+ * @param root		The worker's directory
+ * @param req		The request
+ * @param len		The length of the payload
+ *
+ * @return			0 on success, 1 if the connection failed.
+ */
+static int read_input(int fd, const char *root, request *req, size_t len)
+{
+	unsigned char fixed[INPUT_FIXED_LEN];
+	if (len < sizeof(fixed) || remote_read_full(fd, fixed, sizeof(fixed)) != 0)
+		return 1;
+
+	mode_t mode = remote_get_u32(fixed) & 07777;
+	uint64_t hash = remote_get_u64(fixed + 4);
+	size_t name_len = remote_get_u32(fixed + 12);
+
+	if (name_len > len - sizeof(fixed))
+		return 1;
+
+	char *name = read_string(fd, name_len);
+	if (name == NULL)
+		return 1;
+
+	// The contents are written to a temporary file and renamed,
+	//	since other connections may store the same contents
+	char *blob = blob_path(root, hash);
+	char *temp = NULL;
+	int temp_fd = -1;
+
+	if (blob != NULL && asprintf(&temp, "%s.XXXXXX", blob) != -1)
+		temp_fd = mkostemp(temp, O_CLOEXEC);
+
+	char buf[OUTPUT_CHUNK];
+	int result = 0;
+	int failed = temp_fd == -1;
+
+	for (size_t left = len - sizeof(fixed) - name_len; result == 0 && left > 0; )
+	{
+		size_t chunk = left < sizeof(buf) ? left : sizeof(buf);
+		result = remote_read_full(fd, buf, chunk);
+
+		if (result == 0 && !failed)
+		{
+			for (size_t done = 0; !failed && done < chunk; )
+			{
+				ssize_t n = write(temp_fd, buf + done, chunk - done);
+				failed = n == -1 && errno != EINTR;
+				if (n > 0)
+					done += n;
+			}
+		}
+
+		left -= chunk;
+	}
+
+	if (temp_fd != -1)
+		failed |= close(temp_fd) != 0;
+	if (result == 0 && !failed)
+		failed = rename(temp, blob) != 0;
+	if (temp != NULL && (result != 0 || failed))
+		unlink(temp);
+
+	if (result == 0)
+	{
+		if (!is_safe_path(name))
+		{
+			errno = EINVAL;
+			fail_request(req, "Refusing input", name);
+		}
+		else if (failed || place_input(blob, name, mode) != 0)
+			fail_request(req, "Couldn't write input", name);
+	}
+
+	free(name);
+	free(blob);
+	free(temp);
+
+	return result;
+}
+
+/**
+ * Reads an input sent as a reference to contents sent before
+ * and places it in the scratch directory.
+ *
+ * @param fd		The connection
+ * @param root		The worker's directory
+ * @param req		The request
+ * @param len		The length of the payload
+ *
+ * @return			0 on success, 1 if the connection failed.
+ */
+static int read_input_ref(int fd, const char *root, request *req, size_t len)
+{
+	unsigned char fixed[INPUT_REF_FIXED_LEN];
+	if (len < sizeof(fixed) || remote_read_full(fd, fixed, sizeof(fixed)) != 0)
+		return 1;
+
+	mode_t mode = remote_get_u32(fixed) & 07777;
+	uint64_t hash = remote_get_u64(fixed + 4);
+
+	char *name = read_string(fd, len - sizeof(fixed));
+	if (name == NULL)
+		return 1;
+
+	char *blob = blob_path(root, hash);
+
+	if (!is_safe_path(name))
+	{
+		errno = EINVAL;
+		fail_request(req, "Refusing input", name);
+	}
+	else if (blob == NULL || place_input(blob, name, mode) != 0)
+		fail_request(req, "Couldn't place input", name);
+
+	free(name);
+	free(blob);
+
+	return 0;
+}
+
+/**
+ * Adds an argument to the command of a request.
+ *
+ * @param req		The request
+ * @param arg		The argument, owned by the request afterwards
+ *
+ * @return			0 on success, else 1.
+ */
+static int add_arg(request *req, char *arg)
+{
+	char **argv = realloc(req->argv, (req->argc + 2) * sizeof(*argv));
+
+	if (argv == NULL)
+	{
+		free(arg);
+		return 1;
+	}
+
+	argv[req->argc++] = arg;
+	argv[req->argc] = NULL;
+	req->argv = argv;
+
+	return 0;
+}
+
+/**
+ * Sends the target file of a job, if the command made one.
+ *
+ * @param fd		The connection
+ * @param target	The path of the target in the scratch directory
+ *
+ * @return			0 on success, 1 if the connection failed.
+ */
+static int send_target(int fd, const char *target)
+{
+	int file = open(target, O_RDONLY | O_CLOEXEC);
+	if (file == -1)
+		return 0;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(file);
+		return 0;
+	}
+
+	unsigned char mode[4];
+	remote_put_u32(mode, info.st_mode & 07777);
+
+	void *contents = NULL;
+	if (info.st_size > 0)
+	{
+		contents = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (contents == MAP_FAILED)
+		{
+			close(file);
+			return 0;
+		}
+	}
+
+	int result = remote_write_frame(fd, FRAME_FILE, mode, sizeof(mode), contents,
+		info.st_size);
+
+	if (contents != NULL)
+		munmap(contents, info.st_size);
+	close(file);
+
+	return result;
+}
+
+/**
+ * Passes the output and errors of a command on as they
+ * arrive, so the client sees them even if the connection
+ * ends early, until both pipes have ended.
+ *
+ * @param fd		The connection
+ * @param pipes		Read ends of the output and error pipes
+ *
+ * @return			0 on success, 1 if the connection failed.
+ */
+static int forward_output(int fd, int pipes[2])
+{
+	static const frametype types[2] = { FRAME_OUTPUT, FRAME_ERROR };
+	struct pollfd polls[2];
+	char buf[OUTPUT_CHUNK];
+	int result = 0;
+
+	for (int i = 0; i < 2; i++)
+		polls[i] = (struct pollfd){ .fd = pipes[i], .events = POLLIN };
+
+	while (polls[0].fd != -1 || polls[1].fd != -1)
+	{
+		if (poll(polls, 2, -1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (int i = 0; i < 2; i++)
+		{
+			if (polls[i].fd == -1 || polls[i].revents == 0)
+				continue;
+
+			ssize_t n = read(polls[i].fd, buf, sizeof(buf));
+
+			if (n == -1 && errno == EINTR)
+				continue;
+
+			if (n <= 0)
+			{
+				polls[i].fd = -1;
+				continue;
+			}
+
+			if (result == 0)
+				result = remote_write_frame(fd, types[i], buf, n, NULL, 0);
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Runs the command of a request in its scratch directory and
+ * streams back the output, the target file and the status.
+ *
+ * @param fd		The connection
+ * @param req		The request
+ *
+ * @return			0 on success, 1 if the connection failed.
+ */
+static int run_request(int fd, request *req)
+{
+	int status = STATUS_NOT_RUN;
+	int out_fds[2];
+	int err_fds[2];
+
+	if (req->error == NULL && req->argc == 0)
+	{
+		errno = EINVAL;
+		fail_request(req, "No command for", req->target != NULL ? req->target : "");
+	}
+
+	if (req->error == NULL && pipe2(out_fds, O_CLOEXEC) != 0)
+		fail_request(req, "Couldn't capture output of", req->argv[0]);
+	else if (req->error == NULL && pipe2(err_fds, O_CLOEXEC) != 0)
+	{
+		close(out_fds[0]);
+		close(out_fds[1]);
+		fail_request(req, "Couldn't capture output of", req->argv[0]);
+	}
+
+	unsigned char reply[4];
+
+	if (req->error != NULL)
+	{
+		remote_put_u32(reply, status);
+		return remote_write_frame(fd, FRAME_ERROR, req->error, strlen(req->error), NULL, 0)
+			|| remote_write_frame(fd, FRAME_STATUS, reply, sizeof(reply), NULL, 0);
+	}
+
+	if (req->cwd != NULL)
+		setenv("MMAKE_CWD", req->cwd, 1);
+
+	pid_t pid = spawn_command(req->argv, out_fds[1], err_fds[1]);
+	close(out_fds[1]);
+	close(err_fds[1]);
+
+	int result = 0;
+
+	if (pid == -1)
+	{
+		char *msg = NULL;
+		int len = asprintf(&msg, "Couldn't run '%s'\n", req->argv[0]);
+		if (len != -1)
+			result = remote_write_frame(fd, FRAME_ERROR, msg, len, NULL, 0);
+		free(msg);
+	}
+
+	int pipes[2] = { out_fds[0], err_fds[0] };
+	if (forward_output(fd, pipes) != 0)
+		result = 1;
+	close(out_fds[0]);
+	close(err_fds[0]);
+
+	if (pid != -1)
+	{
+		while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+			;
+	}
+
+	if (verbose)
+		fprintf(stderr, "mmake-worker: %s -> %s, status %d\n", req->argv[0],
+			req->target != NULL ? req->target : "-", status);
+
+	if (result == 0 && status == 0 && req->target != NULL)
+		result = send_target(fd, req->target);
+
+	remote_put_u32(reply, status);
+
+	return result || remote_write_frame(fd, FRAME_STATUS, reply, sizeof(reply), NULL, 0);
+}
+
+/**
+ * Frees a request and removes its scratch directory.
+ *
+ * @param req		The request
+ * @param root		The worker's directory
+ */
+static void clear_request(request *req, const char *root)
+{
+	for (size_t i = 0; i < req->argc; i++)
+		free(req->argv[i]);
+	free(req->argv);
+	free(req->cwd);
+	free(req->target);
+	free(req->error);
+
+	if (req->scratch != NULL)
+	{
+		if (chdir(root) == 0)
+			nftw(req->scratch, remove_entry, MAX_OPEN_FDS, FTW_DEPTH | FTW_PHYS);
+		free(req->scratch);
+	}
+
+	*req = (request){ 0 };
+}
+
+/**
+ * Serves the jobs sent over one connection until it's closed.
+ *
+ * @param fd		The connection
+ * @param root		The worker's directory
+ */
+static void serve(int fd, const char *root)
+{
+	request req = { 0 };
+	frameheader header;
+	int result = 0;
+
+	while (result == 0 && remote_read_header(fd, &header) == 0)
+	{
+		// Every request gets a fresh scratch directory to run in
+		if (req.scratch == NULL)
+		{
+			if (asprintf(&req.scratch, "%s/job-XXXXXX", root) == -1)
+				break;
+
+			if (mkdtemp(req.scratch) == NULL || chdir(req.scratch) != 0)
+			{
+				fail_request(&req, "Couldn't create", req.scratch);
+				free(req.scratch);
+				req.scratch = NULL;
+			}
+		}
+
+		switch (header.type)
+		{
+			case FRAME_ARG:
+			{
+				char *arg = read_string(fd, header.len);
+				result = arg == NULL || add_arg(&req, arg) != 0;
+				break;
+			}
+			case FRAME_CWD:
+				free(req.cwd);
+				req.cwd = read_string(fd, header.len);
+				result = req.cwd == NULL;
+				break;
+			case FRAME_TARGET:
+				free(req.target);
+				req.target = read_string(fd, header.len);
+				result = req.target == NULL;
+				if (result == 0 && !is_safe_path(req.target))
+				{
+					errno = EINVAL;
+					fail_request(&req, "Refusing target", req.target);
+				}
+				else if (result == 0)
+					make_parents(req.target);
+				break;
+			case FRAME_INPUT:
+				result = read_input(fd, root, &req, header.len);
+				break;
+			case FRAME_INPUT_REF:
+				result = read_input_ref(fd, root, &req, header.len);
+				break;
+			case FRAME_RUN:
+				result = run_request(fd, &req);
+				clear_request(&req, root);
+				break;
+			default:
+				fprintf(stderr, "mmake-worker: Unknown frame type %u\n", header.type);
+				result = 1;
+				break;
+		}
+	}
+
+	clear_request(&req, root);
+	close(fd);
+}
+
+// * Main
+
+int main(int argc, char **argv)
+{
+	char *root = NULL;
+	const char *dir = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd':
+				dir = optarg;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-d DIR] [-v] ADDRESS\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "Usage: %s [-d DIR] [-v] ADDRESS\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Scratch directories are entered, so the directory is kept
+	//	as an absolute path
+	if (dir != NULL)
+	{
+		if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+			dir = NULL;
+		root = dir != NULL ? realpath(dir, NULL) : NULL;
+	}
+	else
+	{
+		root = strdup("/tmp/mmake-worker-XXXXXX");
+
+		if (root != NULL && mkdtemp(root) == NULL)
+		{
+			free(root);
+			root = NULL;
+		}
+	}
+
+	char *blobs = NULL;
+	if (root == NULL || asprintf(&blobs, "%s/blobs", root) == -1
+		|| (mkdir(blobs, 0777) != 0 && errno != EEXIST))
+	{
+		perror("Couldn't create worker directory");
+		return EXIT_FAILURE;
+	}
+	free(blobs);
+
+	int listen_fd = remote_listen(argv[optind]);
+	if (listen_fd == -1)
+	{
+		perror("Couldn't listen");
+		return EXIT_FAILURE;
+	}
+
+	// SIGINT and SIGTERM interrupt accept so the worker can clean
+	//	up, and SIGCHLD so exited connection processes are reaped
+	struct sigaction stop = { .sa_handler = handle_stop };
+	sigemptyset(&stop.sa_mask);
+	sigaction(SIGINT, &stop, NULL);
+	sigaction(SIGTERM, &stop, NULL);
+
+	struct sigaction child = { .sa_handler = handle_child };
+	sigemptyset(&child.sa_mask);
+	sigaction(SIGCHLD, &child, NULL);
+
+	if (verbose)
+		fprintf(stderr, "mmake-worker: Listening on %s, using %s\n", argv[optind], root);
+
+	while (!stopping)
+	{
+		reap_servers();
+
+		int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (fd == -1)
+		{
+			if (errno != EINTR && errno != ECONNABORTED)
+				perror("Accept failed");
+			continue;
+		}
+
+		pid_t *grown = realloc(servers, (n_servers + 1) * sizeof(*servers));
+		if (grown == NULL)
+		{
+			perror("Allocation failed");
+			close(fd);
+			continue;
+		}
+		servers = grown;
+
+		pid_t pid = fork();
+
+		if (pid == 0)
+		{
+			setpgid(0, 0);
+			close(listen_fd);
+			signal(SIGCHLD, SIG_DFL);
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			serve(fd, root);
+			_exit(EXIT_SUCCESS);
+		}
+
+		if (pid == -1)
+			perror("Couldn't fork");
+		else
+		{
+			// Also set here, so the group exists before it may be
+			//	signalled
+			setpgid(pid, pid);
+			servers[n_servers++] = pid;
+		}
+
+		close(fd);
+	}
+
+	close(listen_fd);
+	stop_servers();
+	free(servers);
+
+	if (strncmp(argv[optind], "unix:", 5) == 0)
+		unlink(argv[optind] + 5);
+
+	if (dir == NULL)
+		nftw(root, remove_entry, MAX_OPEN_FDS, FTW_DEPTH | FTW_PHYS);
+
+	free(root);
+
+	return EXIT_SUCCESS;
+}